@@ -0,0 +1,53 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_BENCH_BENCH_HPP_
+#define SAPTAPPER_BENCH_BENCH_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace saptapper::bench {
+
+/// Keeps the benchmarked computation from being optimized away.
+inline volatile std::uint64_t sink = 0;
+
+/// Runs the function repeatedly and returns the best wall time in seconds.
+template <typename Function>
+double MeasureSeconds(Function&& function, int repeat = 5) {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repeat; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  return best;
+}
+
+/// Returns pseudo-random bytes, which are identical across runs.
+inline std::string RandomBytes(std::size_t size, std::uint32_t seed = 1) {
+  std::mt19937 engine{seed};
+  std::string bytes(size, 0);
+  for (auto& c : bytes) c = static_cast<char>(engine());
+  return bytes;
+}
+
+inline std::string FormatDouble(double value, int precision = 2) {
+  std::ostringstream stream;
+  stream << std::fixed << std::setprecision(precision) << value;
+  return stream.str();
+}
+
+inline std::string FormatThroughput(std::size_t bytes, double seconds) {
+  return FormatDouble(static_cast<double>(bytes) / seconds / 1048576.0);
+}
+
+}  // namespace saptapper::bench
+
+#endif
@@ -0,0 +1,74 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "bytes_bench.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "bench.hpp"
+#include "saptapper/bytes.hpp"
+#include "saptapper/tabulate.hpp"
+
+namespace saptapper::bench {
+
+void RunBytesBench(std::ostream& out) {
+  constexpr std::size_t kSize = 0x2000000;
+  const std::string buffer = RandomBytes(kSize);
+
+  // std::string::const_iterator is not a pointer, so it takes the generic
+  // byte-by-byte path of the templates.
+  const double iterator_time = MeasureSeconds([&] {
+    std::uint32_t sum = 0;
+    for (auto it = buffer.cbegin(); it + 4 <= buffer.cend(); it += 4)
+      sum += ReadInt32L(it);
+    sink = sink + sum;
+  });
+
+  const double pointer_time = MeasureSeconds([&] {
+    std::uint32_t sum = 0;
+    const char* data = buffer.data();
+    for (std::size_t pos = 0; pos + 4 <= kSize; pos += 4)
+      sum += ReadInt32L(&data[pos]);
+    sink = sink + sum;
+  });
+
+  const double bulk_time = MeasureSeconds([&] {
+    std::uint32_t sum = 0;
+    std::array<std::uint32_t, 256> words;
+    const char* data = buffer.data();
+    for (std::size_t pos = 0; pos + sizeof(words) <= kSize;
+         pos += sizeof(words)) {
+      ReadInt32LArray(&data[pos], words.data(), words.size());
+      for (const auto word : words) sum += word;
+    }
+    sink = sink + sum;
+  });
+
+  const double unaligned_time = MeasureSeconds([&] {
+    std::uint32_t sum = 0;
+    const char* data = buffer.data();
+    for (std::size_t pos = 1; pos + 4 <= kSize; pos += 4)
+      sum += ReadInt32L(&data[pos]);
+    sink = sink + sum;
+  });
+
+  out << "ReadInt32L over " << (kSize >> 20) << " MiB:" << std::endl
+      << std::endl;
+
+  using row_t = std::array<std::string, 3>;
+  const row_t header{"Case", "Time (ms)", "Throughput (MiB/s)"};
+  std::array items{
+      row_t{"iterator (byte-by-byte)", FormatDouble(iterator_time * 1000),
+            FormatThroughput(kSize, iterator_time)},
+      row_t{"pointer (memcpy)", FormatDouble(pointer_time * 1000),
+            FormatThroughput(kSize, pointer_time)},
+      row_t{"pointer, unaligned", FormatDouble(unaligned_time * 1000),
+            FormatThroughput(kSize, unaligned_time)},
+      row_t{"ReadInt32LArray", FormatDouble(bulk_time * 1000),
+            FormatThroughput(kSize, bulk_time)},
+  };
+  tabulate(out, header, items);
+}
+
+}  // namespace saptapper::bench
@@ -0,0 +1,15 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_BENCH_BYTES_BENCH_HPP_
+#define SAPTAPPER_BENCH_BYTES_BENCH_HPP_
+
+#include <iostream>
+
+namespace saptapper::bench {
+
+/// Compares the little-endian loads of bytes.hpp.
+void RunBytesBench(std::ostream& out);
+
+}  // namespace saptapper::bench
+
+#endif
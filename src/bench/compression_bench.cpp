@@ -0,0 +1,80 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "compression_bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bench.hpp"
+#include "saptapper/deflater.hpp"
+#include "saptapper/gsf_header.hpp"
+#include "saptapper/gsf_writer.hpp"
+#include "saptapper/tabulate.hpp"
+
+namespace saptapper::bench {
+
+/// Returns ROM-like data: code and tables with repeated patterns, noisy
+/// samples, and the padding at the end.
+static std::string SyntheticRom(std::size_t size) {
+  std::string rom;
+  rom.reserve(size);
+
+  const std::string noise = RandomBytes(size / 4, 2);
+  std::size_t noise_pos = 0;
+  std::uint32_t seed = 3;
+  while (rom.size() < size * 3 / 4) {
+    // Code and tables: 4-byte words with few distinct values.
+    const std::string words = RandomBytes(64, seed++);
+    for (int i = 0; i < 256; i++) {
+      const std::size_t word = static_cast<unsigned char>(words[i % 64]) % 16;
+      rom.append(words, word * 4, 4);
+    }
+
+    // Samples: 8-bit PCM which is hard to compress.
+    const std::size_t noise_size = std::min<std::size_t>(0x400, noise.size() -
+                                                                    noise_pos);
+    rom.append(noise, noise_pos, noise_size);
+    noise_pos += noise_size;
+  }
+  rom.resize(size, '\xff');
+  return rom;
+}
+
+void RunCompressionBench(std::ostream& out) {
+  constexpr std::size_t kSize = 0x400000;
+  const std::string rom = SyntheticRom(kSize);
+  const GsfHeader header{0x8000000, 0x8000000, kSize};
+
+  out << "GsfWriter::SaveToStream of " << (kSize >> 20)
+      << " MiB synthetic ROM:" << std::endl
+      << std::endl;
+
+  using row_t = std::array<std::string, 5>;
+  const row_t header_row{"Profile", "Size (bytes)", "Ratio (%)", "Time (ms)",
+                         "Throughput (MiB/s)"};
+  constexpr std::array profiles{CompressionProfile::kFast,
+                                CompressionProfile::kBalanced,
+                                CompressionProfile::kMax,
+                                CompressionProfile::kOptimal};
+  std::array<row_t, profiles.size()> items;
+  for (std::size_t i = 0; i < profiles.size(); i++) {
+    const CompressionProfile profile = profiles[i];
+    std::size_t size = 0;
+    const double time = MeasureSeconds(
+        [&] {
+          std::ostringstream stream;
+          GsfWriter::SaveToStream(stream, header, rom, {}, profile);
+          size = stream.str().size();
+        },
+        profile == CompressionProfile::kOptimal ? 1 : 3);
+    items[i] = row_t{to_string(profile), std::to_string(size),
+                     FormatDouble(100.0 * size / kSize),
+                     FormatDouble(time * 1000), FormatThroughput(kSize, time)};
+  }
+  tabulate(out, header_row, items);
+}
+
+}  // namespace saptapper::bench
@@ -0,0 +1,15 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_BENCH_COMPRESSION_BENCH_HPP_
+#define SAPTAPPER_BENCH_COMPRESSION_BENCH_HPP_
+
+#include <iostream>
+
+namespace saptapper::bench {
+
+/// Compares the throughput and the ratio of the compression profiles.
+void RunCompressionBench(std::ostream& out);
+
+}  // namespace saptapper::bench
+
+#endif
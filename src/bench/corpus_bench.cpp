@@ -0,0 +1,460 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "corpus_bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bench.hpp"
+#include "saptapper/bytes.hpp"
+#include "saptapper/cartridge.hpp"
+#include "saptapper/mp2k_driver.hpp"
+#include "saptapper/mp2k_driver_param.hpp"
+#include "saptapper/tabulate.hpp"
+#include "saptapper/types.hpp"
+
+namespace saptapper::bench {
+
+// The detected values of a ROM, in the order of kFieldNames. A missing
+// address is agbnullptr, and a missing song table length is 0.
+using Fields = std::array<std::uint32_t, 6>;
+
+static constexpr std::array<std::string_view, 6> kFieldNames{
+    "m4aSoundVSync",   "m4aSoundInit", "m4aSoundMain",
+    "m4aSongNumStart", "song_table",   "len(song_table)"};
+static constexpr std::size_t kSongCountField = 5;
+
+static constexpr Fields kNoFields{agbnullptr, agbnullptr, agbnullptr,
+                                  agbnullptr, agbnullptr, 0};
+
+struct RomResult {
+  std::string name;
+  std::size_t size = 0;
+  double seconds = 0;
+  Fields actual = kNoFields;
+  std::optional<Fields> expected;
+  std::string error;
+  int true_positives = 0;
+  int false_positives = 0;
+  int false_negatives = 0;
+};
+
+static Fields ToFields(const Mp2kDriverParam& param) {
+  return {param.vsync_fn(),
+          param.init_fn(),
+          param.main_fn(),
+          param.select_song_fn(),
+          param.song_table(),
+          static_cast<std::uint32_t>(param.song_count())};
+}
+
+static bool IsPresent(std::size_t field, std::uint32_t value) {
+  return field == kSongCountField ? value != 0 : value != agbnullptr;
+}
+
+static std::string FormatField(std::size_t field, std::uint32_t value) {
+  if (!IsPresent(field, value)) return "-";
+  if (field == kSongCountField) return std::to_string(value);
+  return to_string(value);
+}
+
+static std::string FormatRatio(int numerator, int denominator) {
+  if (denominator == 0) return "-";
+  return FormatDouble(static_cast<double>(numerator) / denominator, 3);
+}
+
+/// Returns the value at the percentile (0 to 100) by the nearest rank.
+static double Percentile(std::vector<double> values, double percentile) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  const auto rank = static_cast<std::size_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(values.size())));
+  return values[std::max<std::size_t>(rank, 1) - 1];
+}
+
+// Builds a ROM with the MusicPlayer2000 driver at a random place, and returns
+// the parameters that the inspection has to find. The seed also selects the
+// variant: a regular driver, one with a near-miss copy of m4aSongNumStart
+// before it, one with the alternate m4aSoundVSync, or no driver at all.
+static std::string SyntheticDriverRom(std::uint32_t seed, Fields& expected) {
+  using namespace std::literals::string_view_literals;
+  enum Variant { kRegular, kDecoy, kAlternateVSync, kNoDriver };
+  const auto variant = static_cast<Variant>(seed % 4);
+
+  std::mt19937 engine{seed};
+  const auto random = [&](std::uint32_t min, std::uint32_t max) {
+    return std::uniform_int_distribution<std::uint32_t>{min, max}(engine);
+  };
+  const auto romptr = [](std::size_t offset) {
+    return static_cast<std::uint32_t>(0x8000000 + offset);
+  };
+
+  const std::size_t size = std::size_t{0x100000} << random(0, 2);
+  std::string rom = RandomBytes(size * 3 / 4, seed);
+  rom.resize(size, '\xff');
+  const auto put = [&](std::size_t offset, std::string_view bytes) {
+    rom.replace(offset, bytes.size(), bytes);
+  };
+  const auto put16 = [&](std::size_t offset, std::uint16_t value) {
+    WriteInt16L(&rom[offset], value);
+  };
+  const auto put32 = [&](std::size_t offset, std::uint32_t value) {
+    WriteInt32L(&rom[offset], value);
+  };
+  const auto clear = [&](std::size_t offset, std::size_t length) {
+    std::fill_n(rom.begin() + offset, length, '\0');
+  };
+
+  expected = kNoFields;
+  if (variant == kNoDriver) return rom;
+
+  // The functions, in the order of the library.
+  const std::size_t base = random(0x10, size / 2 / 0x100 - 0x20) * 0x100;
+  clear(base, 0x2000);
+  const std::size_t init = base + 0x800;
+  const std::size_t main = init + 0x40;
+  const std::size_t select = main + 0x10;
+  const std::size_t mplay_table = select + 0x60;
+  std::size_t vsync = base;
+  if (variant == kAlternateVSync) {
+    vsync = init + 0x400;
+    put(vsync, "\x00\xb5\x18\x48\x02\x68\x10\x68\x17\x49"sv);
+    put32(vsync + 0x64, 0x03007ff0);
+  } else {
+    // ...; subs r3, r3, r2; cmp r3, #1; bhi
+    put(vsync, "\x07\x48\x00\x68\x07\x4a\x03\x68\x9b\x1a\x01\x2b\x1d\xd8"sv);
+    put32(vsync + 0x20, 0x03007ff0);
+    put32(vsync + 0x24, 0x68736d53);
+  }
+  put(init, "\x70\xb5\x14\x48\x70\xbc\x01\xbc\x00\x47"sv);
+  put32(init + 0x54, romptr(base + 0x1800) | 1);
+  put(main, "\x00\xb5\x00\xf0\x10\xf8\x01\xbc\x00\x47"sv);
+  put(select,
+      "\x00\xb5\x00\x04\x07\x4a\x08\x49\x40\x0b\x40\x18\x83\x88\x59\x00"
+      "\xc9\x18\x89\x00\x89\x18\x0a\x68\x01\x68\x10\x1c\x00\xf0\x10\xf8"
+      "\x01\xbc\x00\x47"sv);
+  put32(mplay_table, 0x03000100);
+  put32(select + 0x24, romptr(mplay_table));
+
+  // The song table, the song headers and the tracks.
+  const std::size_t table =
+      random(size / 2 / 4, (size * 3 / 4 - 0x4000) / 4) * 4;
+  clear(table, 0x4000);
+  const std::size_t tone = table + 0x3000;
+  const std::uint32_t song_count = random(1, 64);
+  for (std::uint32_t song = 0; song < song_count; song++) {
+    const std::size_t header = table + 0x400 + song * 0x10;
+    const std::size_t track = table + 0x1000 + song * 0x10;
+    put32(table + song * 8, romptr(header));
+    put16(table + song * 8 + 4, static_cast<std::uint16_t>(song % 4));
+    put16(table + song * 8 + 6, static_cast<std::uint16_t>(song % 4));
+    put(header, "\x01\x00\x00\x00"sv);
+    put32(header + 4, romptr(tone));
+    put32(header + 8, romptr(track));
+    put(track, "\xbe\x7f\xe7\x3c\x64\xb1"sv);
+  }
+  put32(select + 0x28, romptr(table));
+
+  if (variant == kDecoy) {
+    // Loosely matches the pattern, but refers to no song table.
+    const std::size_t decoy = base - 0x400;
+    rom.replace(decoy, 0x2c, rom, select, 0x2c);
+    rom[decoy + 6] ^= 0x5a;
+    rom[decoy + 12] ^= 0x5a;
+    put32(decoy + 0x28, 0x12345678);
+  }
+
+  expected = {romptr(vsync),  romptr(init),  romptr(main),
+              romptr(select), romptr(table), song_count};
+  return rom;
+}
+
+static std::map<std::string, Fields> LoadExpected(
+    const std::filesystem::path& path) {
+  std::map<std::string, Fields> expected;
+  std::ifstream file{path};
+  if (!file)
+    throw std::runtime_error(
+        path.string() +
+        ": Unable to open the expected results (run with --update-expected).");
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream columns{line};
+    std::string name;
+    std::getline(columns, name, '\t');
+    Fields fields = kNoFields;
+    for (std::size_t field = 0; field < fields.size(); field++) {
+      std::string value;
+      if (!std::getline(columns, value, '\t'))
+        throw std::runtime_error(path.string() + ": Too few columns for " +
+                                 name + ".");
+      if (value != "-") {
+        fields[field] =
+            static_cast<std::uint32_t>(std::stoul(value, nullptr, 0));
+      }
+    }
+    expected[name] = fields;
+  }
+  return expected;
+}
+
+static void SaveExpected(const std::filesystem::path& path,
+                         const std::vector<RomResult>& results) {
+  std::ofstream file{path};
+  if (!file) throw std::runtime_error(path.string() + ": Unable to open.");
+
+  file << "# Expected results of Mp2kDriver::Inspect\n# path";
+  for (const auto name : kFieldNames) file << '\t' << name;
+  file << '\n';
+  for (const RomResult& result : results) {
+    file << result.name;
+    for (std::size_t field = 0; field < result.actual.size(); field++)
+      file << '\t' << FormatField(field, result.actual[field]);
+    file << '\n';
+  }
+}
+
+static RomResult InspectRom(std::string name, std::string_view rom,
+                            std::optional<Fields> expected) {
+  RomResult result;
+  result.name = std::move(name);
+  result.size = rom.size();
+  result.expected = expected;
+  result.seconds = MeasureSeconds(
+      [&] { result.actual = ToFields(Mp2kDriver::Inspect(rom)); }, 3);
+  return result;
+}
+
+static void Score(RomResult& result) {
+  if (!result.expected) return;
+
+  for (std::size_t field = 0; field < result.actual.size(); field++) {
+    const std::uint32_t actual = result.actual[field];
+    const std::uint32_t expected = (*result.expected)[field];
+    if (IsPresent(field, actual) && actual == expected) {
+      result.true_positives++;
+    } else {
+      if (IsPresent(field, actual)) result.false_positives++;
+      if (IsPresent(field, expected)) result.false_negatives++;
+    }
+  }
+}
+
+static std::string Describe(const RomResult& result) {
+  if (!result.error.empty()) return "error: " + result.error;
+  if (!result.expected) return "new";
+
+  std::string mismatches;
+  for (std::size_t field = 0; field < result.actual.size(); field++) {
+    if (result.actual[field] == (*result.expected)[field]) continue;
+    if (!mismatches.empty()) mismatches += ", ";
+    mismatches += std::string{kFieldNames[field]} + "=" +
+                  FormatField(field, result.actual[field]);
+  }
+  return mismatches.empty() ? "ok" : "mismatch: " + mismatches;
+}
+
+static std::vector<RomResult> InspectCorpus(std::ostream& out,
+                                            const CorpusOptions& options) {
+  std::vector<RomResult> results;
+  if (options.corpus_dir.empty()) {
+    out << "Mp2kDriver::Inspect of " << options.synthetic_count
+        << " synthetic ROMs:" << std::endl
+        << std::endl;
+    for (int i = 0; i < options.synthetic_count; i++) {
+      Fields expected;
+      const std::string rom =
+          SyntheticDriverRom(static_cast<std::uint32_t>(i + 1), expected);
+      results.push_back(
+          InspectRom("synthetic-" + std::to_string(i + 1), rom, expected));
+    }
+    return results;
+  }
+
+  const std::filesystem::path expected_path =
+      options.expected_path.empty() ? options.corpus_dir / "expected.tsv"
+                                    : options.expected_path;
+  const auto expected = options.update_expected
+                            ? std::map<std::string, Fields>{}
+                            : LoadExpected(expected_path);
+
+  std::vector<std::filesystem::path> paths;
+  for (const auto& entry :
+       std::filesystem::recursive_directory_iterator(options.corpus_dir)) {
+    std::string extension = entry.path().extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (entry.is_regular_file() &&
+        (extension == ".gba" || extension == ".agb" || extension == ".bin"))
+      paths.push_back(entry.path());
+  }
+  std::sort(paths.begin(), paths.end());
+
+  out << "Mp2kDriver::Inspect of " << paths.size() << " ROMs in "
+      << options.corpus_dir.string() << ":" << std::endl
+      << std::endl;
+  for (const auto& path : paths) {
+    const std::string name =
+        path.lexically_relative(options.corpus_dir).generic_string();
+    const auto it = expected.find(name);
+    const std::optional<Fields> expected_fields =
+        it != expected.end() ? std::optional<Fields>{it->second}
+                             : std::nullopt;
+    try {
+      const Cartridge cartridge = Cartridge::LoadFromFile(path);
+      results.push_back(InspectRom(name, cartridge.rom(), expected_fields));
+    } catch (std::exception& e) {
+      RomResult result;
+      result.name = name;
+      result.expected = expected_fields;
+      result.error = e.what();
+      results.push_back(std::move(result));
+    }
+  }
+
+  // An expected ROM which has gone from the corpus is not a silent pass.
+  for (const auto& [name, fields] : expected) {
+    if (std::find_if(results.begin(), results.end(), [&](const RomResult& r) {
+          return r.name == name;
+        }) != results.end())
+      continue;
+
+    RomResult result;
+    result.name = name;
+    result.expected = fields;
+    result.error = "No such file in the corpus.";
+    results.push_back(std::move(result));
+  }
+
+  if (options.update_expected) {
+    SaveExpected(expected_path, results);
+    out << "Saved the expected results to " << expected_path.string() << "."
+        << std::endl
+        << std::endl;
+  }
+  return results;
+}
+
+bool RunCorpusBench(std::ostream& out, const CorpusOptions& options) {
+  std::vector<RomResult> results;
+  try {
+    results = InspectCorpus(out, options);
+  } catch (std::exception& e) {
+    out << "REGRESSION: " << e.what() << std::endl;
+    return false;
+  }
+
+  using row_t = std::array<std::string, 6>;
+  const row_t header{"ROM",       "Size (KiB)", "Time (ms)",
+                     "Precision", "Recall",     "Result"};
+  std::vector<row_t> items;
+  int true_positives = 0;
+  int false_positives = 0;
+  int false_negatives = 0;
+  std::size_t checked = 0;
+  std::size_t unchecked = 0;
+  std::size_t errors = 0;
+  std::size_t total_size = 0;
+  double total_seconds = 0;
+  std::vector<double> latencies;
+  for (RomResult& result : results) {
+    Score(result);
+    true_positives += result.true_positives;
+    false_positives += result.false_positives;
+    false_negatives += result.false_negatives;
+    if (result.expected)
+      checked++;
+    else
+      unchecked++;
+    if (result.error.empty()) {
+      total_size += result.size;
+      total_seconds += result.seconds;
+      latencies.push_back(result.seconds * 1000);
+    } else {
+      errors++;
+    }
+
+    items.push_back(row_t{
+        result.name, std::to_string(result.size >> 10),
+        FormatDouble(result.seconds * 1000, 3),
+        FormatRatio(result.true_positives,
+                    result.true_positives + result.false_positives),
+        FormatRatio(result.true_positives,
+                    result.true_positives + result.false_negatives),
+        Describe(result)});
+  }
+  tabulate(out, header, items);
+
+  const int detected = true_positives + false_positives;
+  const int relevant = true_positives + false_negatives;
+  const double precision =
+      detected != 0 ? static_cast<double>(true_positives) / detected : 1.0;
+  const double recall =
+      relevant != 0 ? static_cast<double>(true_positives) / relevant : 1.0;
+  const double throughput =
+      total_seconds > 0 ? total_size / total_seconds / 1048576.0 : 0;
+  const double p50 = Percentile(latencies, 50);
+  const double p99 = Percentile(latencies, 99);
+
+  using summary_row_t = std::array<std::string, 2>;
+  const summary_row_t summary_header{"Metric", "Value"};
+  const std::array summary{
+      summary_row_t{"ROMs", std::to_string(results.size())},
+      summary_row_t{"ROMs with expected results", std::to_string(checked)},
+      summary_row_t{"ROMs with errors", std::to_string(errors)},
+      summary_row_t{"Precision", FormatDouble(precision, 3)},
+      summary_row_t{"Recall", FormatDouble(recall, 3)},
+      summary_row_t{"Throughput (MiB/s)", FormatDouble(throughput)},
+      summary_row_t{"p50 latency (ms)", FormatDouble(p50, 3)},
+      summary_row_t{"p99 latency (ms)", FormatDouble(p99, 3)},
+  };
+  out << std::endl;
+  tabulate(out, summary_header, summary);
+
+  if (options.update_expected) return true;
+
+  // Every ROM must be compared, or a gap in the corpus would pass unnoticed.
+  std::vector<std::string> failures;
+  if (unchecked != 0)
+    failures.push_back(std::to_string(unchecked) +
+                       " ROMs without expected results");
+  if (errors != 0)
+    failures.push_back(std::to_string(errors) + " ROMs with errors");
+  if (precision < options.min_precision)
+    failures.push_back("precision " + FormatDouble(precision, 3) + " < " +
+                       FormatDouble(options.min_precision, 3));
+  if (recall < options.min_recall)
+    failures.push_back("recall " + FormatDouble(recall, 3) + " < " +
+                       FormatDouble(options.min_recall, 3));
+  if (options.min_throughput > 0 && throughput < options.min_throughput)
+    failures.push_back("throughput " + FormatDouble(throughput) + " MiB/s < " +
+                       FormatDouble(options.min_throughput) + " MiB/s");
+  if (options.max_p99_ms > 0 && p99 > options.max_p99_ms)
+    failures.push_back("p99 latency " + FormatDouble(p99, 3) + " ms > " +
+                       FormatDouble(options.max_p99_ms, 3) + " ms");
+
+  out << std::endl;
+  for (const auto& failure : failures)
+    out << "REGRESSION: " << failure << std::endl;
+  if (failures.empty()) out << "No regressions." << std::endl;
+  return failures.empty();
+}
+
+}  // namespace saptapper::bench
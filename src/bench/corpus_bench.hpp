@@ -0,0 +1,43 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_BENCH_CORPUS_BENCH_HPP_
+#define SAPTAPPER_BENCH_CORPUS_BENCH_HPP_
+
+#include <filesystem>
+#include <iostream>
+
+namespace saptapper::bench {
+
+/// Options of the corpus regression run.
+struct CorpusOptions {
+  /// The directory of the ROMs, or empty to generate a synthetic corpus.
+  std::filesystem::path corpus_dir;
+
+  /// The expected results, or empty for expected.tsv in the corpus directory.
+  std::filesystem::path expected_path;
+
+  /// Save the current results as the expected ones, instead of comparing.
+  bool update_expected = false;
+
+  /// The number of ROMs of the synthetic corpus.
+  int synthetic_count = 32;
+
+  /// The run fails below these ratios (0 to 1) of the detected functions.
+  double min_precision = 1.0;
+  double min_recall = 1.0;
+
+  /// The run fails below this throughput in MiB/s (0 to disable).
+  double min_throughput = 0;
+
+  /// The run fails above this p99 latency in milliseconds (0 to disable).
+  double max_p99_ms = 0;
+};
+
+/// Runs Mp2kDriver::Inspect over a corpus and compares the results with the
+/// expected ones. Returns false if the results regress beyond the thresholds,
+/// or if any ROM cannot be compared with its expected results.
+bool RunCorpusBench(std::ostream& out, const CorpusOptions& options);
+
+}  // namespace saptapper::bench
+
+#endif
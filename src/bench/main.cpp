@@ -0,0 +1,107 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+//
+// Microbenchmarks for the performance-sensitive parts of saptapper.
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "args.hxx"
+#include "bytes_bench.hpp"
+#include "compression_bench.hpp"
+#include "corpus_bench.hpp"
+
+using namespace saptapper::bench;
+
+int main(int argc, const char** argv) {
+  args::ArgumentParser parser("Microbenchmarks for saptapper.");
+  args::HelpFlag help(parser, "help", "Show this help message and exit",
+                      {'h', "help"});
+  args::ValueFlag<std::string> corpus_arg(
+      parser, "directory",
+      "The ROMs of the corpus suite (the default is a synthetic corpus)",
+      {"corpus"});
+  args::ValueFlag<std::string> expected_arg(
+      parser, "file",
+      "The expected results of the corpus (the default is expected.tsv in "
+      "the corpus)",
+      {"expected"});
+  args::Flag update_expected_arg(
+      parser, "update-expected",
+      "Save the results of the corpus as the expected ones",
+      {"update-expected"});
+  args::ValueFlag<int> synthetic_count_arg(
+      parser, "count", "The number of ROMs of the synthetic corpus",
+      {"synthetic-count"}, 32);
+  args::ValueFlag<double> min_precision_arg(
+      parser, "ratio", "Fail the corpus suite below this precision",
+      {"min-precision"}, 1.0);
+  args::ValueFlag<double> min_recall_arg(
+      parser, "ratio", "Fail the corpus suite below this recall",
+      {"min-recall"}, 1.0);
+  args::ValueFlag<double> min_throughput_arg(
+      parser, "MiB/s", "Fail the corpus suite below this throughput",
+      {"min-throughput"}, 0);
+  args::ValueFlag<double> max_p99_arg(
+      parser, "ms", "Fail the corpus suite above this p99 latency",
+      {"max-p99"}, 0);
+  args::PositionalList<std::string> suites_arg(
+      parser, "suite", "The benchmark suites to run (default: all)");
+
+  CorpusOptions corpus_options;
+  const std::map<std::string, std::function<bool(std::ostream&)>> suites{
+      {"bytes",
+       [](std::ostream& out) {
+         RunBytesBench(out);
+         return true;
+       }},
+      {"compression",
+       [](std::ostream& out) {
+         RunCompressionBench(out);
+         return true;
+       }},
+      {"corpus",
+       [&](std::ostream& out) { return RunCorpusBench(out, corpus_options); }},
+  };
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (args::Help&) {
+    std::cout << parser;
+    std::cout << "Suites:";
+    for (const auto& suite : suites) std::cout << " " << suite.first;
+    std::cout << std::endl;
+    return EXIT_SUCCESS;
+  } catch (args::Error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  corpus_options.corpus_dir = args::get(corpus_arg);
+  corpus_options.expected_path = args::get(expected_arg);
+  corpus_options.update_expected = update_expected_arg;
+  corpus_options.synthetic_count = args::get(synthetic_count_arg);
+  corpus_options.min_precision = args::get(min_precision_arg);
+  corpus_options.min_recall = args::get(min_recall_arg);
+  corpus_options.min_throughput = args::get(min_throughput_arg);
+  corpus_options.max_p99_ms = args::get(max_p99_arg);
+
+  std::vector<std::string> names{args::get(suites_arg)};
+  if (names.empty()) {
+    for (const auto& suite : suites) names.push_back(suite.first);
+  }
+
+  bool succeeded = true;
+  for (const auto& name : names) {
+    const auto suite = suites.find(name);
+    if (suite == suites.end()) {
+      std::cerr << name << ": Unknown benchmark suite" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (!suite->second(std::cout)) succeeded = false;
+    std::cout << std::endl;
+  }
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,17 +1,37 @@
 // Saptapper: Automated GSF ripper for MusicPlayer2000.
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 #include "args.hxx"
+#include "saptapper/buffer_pool.hpp"
 #include "saptapper/cartridge.hpp"
+#include "saptapper/gsf_repacker.hpp"
+#include "saptapper/gsf_verifier.hpp"
+#include "saptapper/inspection.hpp"
+#include "saptapper/rom_hashes.hpp"
 #include "saptapper/saptapper.hpp"
+#include "saptapper/server.hpp"
+#include "saptapper/song_selection.hpp"
+#include "saptapper/thread_pool.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using namespace saptapper;
 using namespace std::literals::string_literals;
 
 inline static const std::string kAppName = "Saptapper"s;
-inline static const std::string kAppVersion = "2.0"s;
+inline static const std::string kAppVersion = Saptapper::kVersion;
 inline static const std::string kAppCredits =
     "Original created by Caitsith2, reimplemented by loveemu from scratch."s
     "\nVisit <http://github.com/loveemu/saptapper> for details."s;
@@ -30,23 +50,111 @@ int main(int argc, const char** argv) {
     args::Flag force_arg(parser, "force",
                          "Save all songs including duplicated ones",
                          {'f', "force"});
+    args::Flag keep_silent_arg(
+        parser, "keep-silent",
+        "Save the songs which play no note, such as dummy entries",
+        {"keep-silent"});
+    args::ValueFlag<std::string> songs_arg(
+        parser, "songs",
+        "The songs to be saved, such as 0-9,12,20- (the default is all)",
+        {"songs"});
+    args::ValueFlag<int> max_songs_arg(
+        parser, "count",
+        "Save at most the given number of songs, after skipping duplicated "
+        "and silent ones",
+        {"max-songs"}, 0);
     args::ValueFlag<std::filesystem::path> outdir_arg(
         parser, "directory",
         "The output directory (the default is the working directory)",
         {'d', "outdir"});
     args::ValueFlag<std::filesystem::path> basename_arg(
         parser, "basename", "The output filename (without extension)", {'o'});
+    args::ValueFlag<std::filesystem::path> store_arg(
+        parser, "directory",
+        "Share identical gsflibs across sets and runs through the store",
+        {"store"});
+    args::ValueFlag<std::string> compression_arg(
+        parser, "profile",
+        "The compression profile of the gsflib (fast, balanced, max or "
+        "optimal)",
+        {"compression"}, "balanced");
+    args::Flag max_compression_arg(
+        parser, "max-compression",
+        "Search for the smallest gsflib (same as --compression=optimal, slow)",
+        {"max-compression"});
+    args::Flag incremental_arg(
+        parser, "incremental",
+        "Skip the outputs which are unchanged since the previous run",
+        {"incremental"});
+    args::Flag smoke_test_arg(
+        parser, "smoke-test",
+        "Run each song on the built-in ARM7TDMI interpreter before saving it",
+        {"smoke-test"});
+    args::ValueFlag<int> song_limit_arg(
+        parser, "count",
+        "Fail if a song table has more entries than this (the default is "
+        "8192, 0 for no limit)",
+        {"song-limit"}, ConvertLimits{}.max_song_count);
+    args::ValueFlag<double> time_limit_arg(
+        parser, "seconds",
+        "Fail if a ROM takes longer than this to convert (the default is no "
+        "limit)",
+        {"time-limit"}, 0);
+    args::ValueFlag<std::uintmax_t> output_limit_arg(
+        parser, "MiB",
+        "Fail if the files of a ROM exceed this size (the default is no "
+        "limit)",
+        {"output-limit"}, 0);
+    args::Flag no_validate_songs_arg(
+        parser, "no-validate-songs",
+        "Accept song table entries which do not point to a valid song header",
+        {"no-validate-songs"});
+    args::Flag repack_arg(
+        parser, "repack",
+        "Repack monolithic GSF files into a gsflib and minigsfs",
+        {"repack"});
+    args::Flag verify_arg(
+        parser, "verify",
+        "Verify GSF files and their gsflibs without saving files and quit",
+        {"verify"});
+    args::ValueFlag<std::string> format_arg(
+        parser, "format",
+        "The format of the inspection result (table, json, ndjson or csv)",
+        {"format"}, "table");
+    args::ValueFlag<std::string> hash_arg(
+        parser, "hashes",
+        "The ROM hashes to be shown in the inspection result (crc32, sha1, "
+        "xxh64 or all, separated by commas)",
+        {"hash"});
+    args::Flag serve_arg(
+        parser, "serve",
+        "Process requests from stdin and write responses to stdout",
+        {"serve"});
+    args::ValueFlag<unsigned int> jobs_arg(
+        parser, "count",
+        "The number of worker threads (the default is the number of CPUs)",
+        {'j', "jobs"}, 0);
+    args::ValueFlag<std::size_t> buffer_pool_arg(
+        parser, "MiB",
+        "The cap of pooled and used ROM and compression buffers, beyond "
+        "which idle ones are freed (the default is 256)",
+        {"buffer-pool"}, BufferPool::kDefaultLimit >> 20);
+    args::Flag huge_pages_arg(
+        parser, "huge-pages",
+        "Back large buffers by transparent huge pages, where supported",
+        {"huge-pages"});
     args::ValueFlag<std::string> gsfby_arg(
         parser, "name", "The creator name to be tagged to minigsfs", {"gsfby"},
         args::Options::HiddenFromUsage | args::Options::HiddenFromDescription);
-    args::Positional<std::filesystem::path> input_arg(
-        parser, "romfile", "The ROM file to be processed",
-        args::Options::Required);
+    args::PositionalList<std::filesystem::path> input_arg(
+        parser, "romfile", "The ROM files to be processed");
 
     try {
       if (argc < 2) throw args::Help(help.Name());
 
       parser.ParseCLI(argc, argv);
+      if (!serve_arg && !input_arg)
+        throw args::RequiredError("Option 'romfile' is required");
     } catch (args::Help&) {
       std::cout << kAppName << " " << kAppVersion << std::endl << std::endl;
       std::cout << kAppCredits << std::endl << std::endl;
@@ -54,38 +162,161 @@ int main(int argc, const char** argv) {
       return EXIT_SUCCESS;
     }
 
-    const auto in_path = args::get(input_arg);
-    if (!exists(in_path)) {
-      std::cerr << in_path.string() << ": File does not exist" << std::endl;
-      return EXIT_FAILURE;
+    BufferPool& buffer_pool = BufferPool::Default();
+    buffer_pool.set_limit(args::get(buffer_pool_arg) << 20);
+    buffer_pool.set_huge_pages(huge_pages_arg);
+
+    ConvertOptions options;
+    options.gsfby = args::get(gsfby_arg);
+    if (options.gsfby != "Caitsith2") {
+      if (options.gsfby.empty()) {
+        options.gsfby = "Saptapper";
+      } else {
+        options.gsfby.insert(0, "Saptapper, with help of ");
+      }
     }
+    options.keep_duplicated = force_arg;
+    options.keep_silent = keep_silent_arg;
+    if (songs_arg) options.songs = SongSelection::Parse(args::get(songs_arg));
+    if (args::get(max_songs_arg) < 0)
+      throw std::invalid_argument("--max-songs must not be negative");
+    options.songs.set_limit(args::get(max_songs_arg));
+    options.store_dir = args::get(store_arg);
+    options.incremental = incremental_arg;
+    options.smoke_test = smoke_test_arg;
+    options.thread_count = args::get(jobs_arg);
+    if (args::get(song_limit_arg) < 0)
+      throw std::invalid_argument("--song-limit must not be negative");
+    if (args::get(time_limit_arg) < 0)
+      throw std::invalid_argument("--time-limit must not be negative");
+    options.limits.max_song_count = args::get(song_limit_arg);
+    options.limits.max_seconds = args::get(time_limit_arg);
+    options.limits.max_output_size = args::get(output_limit_arg) << 20;
+    options.limits.validate_songs = !no_validate_songs_arg;
+    options.compression =
+        max_compression_arg
+            ? CompressionProfile::kOptimal
+            : ParseCompressionProfile(args::get(compression_arg));
 
-    Cartridge cartridge = Cartridge::LoadFromFile(in_path);
+    const unsigned int hash_types = RomHashes::ParseTypes(args::get(hash_arg));
 
-    if (inspect_arg) {
-      Mp2kDriverParam param;
-      MinigsfDriverParam minigsf;
-      agbptr_t gsf_driver_addr = agbnullptr;
-      Saptapper::Inspect(cartridge, param, minigsf, gsf_driver_addr);
-      Saptapper::PrintParam(param, minigsf);
-    } else {
+    if (serve_arg) {
+#ifdef _WIN32
+      _setmode(_fileno(stdin), _O_BINARY);
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+      std::ios::sync_with_stdio(false);
+      Server server{options, args::get(jobs_arg)};
+      server.set_format(InspectionWriter::ParseFormat(args::get(format_arg)));
+      server.set_hash_types(hash_types);
+      server.Serve(std::cin, std::cout);
+      return EXIT_SUCCESS;
+    }
+
+    const auto in_paths = args::get(input_arg);
+    if (verify_arg) {
+      const auto start = std::chrono::steady_clock::now();
+      const std::vector<GsfVerification> results =
+          GsfVerifier::Verify(in_paths, args::get(jobs_arg));
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::size_t failed = 0;
+      double read_size = 0;
+      double program_size = 0;
+      for (const auto& result : results) {
+        read_size += result.file_size;
+        program_size += result.program_size;
+        if (!result.ok()) {
+          std::cerr << result.path.string() << ": " << result.error
+                    << std::endl;
+          failed++;
+        }
+      }
+
+      const double seconds = std::max(elapsed.count(), 1e-6);
+      std::cout << std::fixed << std::setprecision(1) << "Verified "
+                << results.size() << " files (" << read_size / 1048576
+                << " MiB read, " << program_size / 1048576
+                << " MiB decompressed) in " << std::setprecision(2)
+                << elapsed.count() << " s: " << std::setprecision(1)
+                << results.size() / seconds << " files/s, "
+                << program_size / 1048576 / seconds << " MiB/s, " << failed
+                << " failed" << std::endl;
+      return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (repack_arg) {
+      RepackOptions repack_options;
+      repack_options.compression = options.compression;
+      repack_options.thread_count = args::get(jobs_arg);
       const std::filesystem::path basename{
-          basename_arg ? args::get(basename_arg) : in_path.stem()};
-      const std::filesystem::path outdir{args::get(outdir_arg)};
+          basename_arg ? args::get(basename_arg)
+                       : GsfRepacker::GuessBasename(in_paths)};
+      GsfRepacker::Repack(in_paths, basename, args::get(outdir_arg),
+                          repack_options);
+      return EXIT_SUCCESS;
+    }
+
+    if (basename_arg && in_paths.size() > 1) {
+      std::cerr << "-o cannot be used with multiple ROM files" << std::endl;
+      return EXIT_FAILURE;
+    }
 
-      std::string gsfby{args::get(gsfby_arg)};
-      if (gsfby != "Caitsith2") {
-        if (gsfby.empty()) {
-          gsfby = "Saptapper";
+    bool succeeded = true;
+    if (inspect_arg) {
+      const auto format = InspectionWriter::ParseFormat(args::get(format_arg));
+      InspectionWriter writer{std::cout, format};
+      writer.set_show_path(in_paths.size() > 1);
+      writer.Begin();
+      ThreadPool pool{args::get(jobs_arg)};
+      for (const auto& in_path : in_paths) {
+        InspectionResult result;
+        if (exists(in_path)) {
+          result = Saptapper::InspectFile(in_path, hash_types,
+                                          options.limits, &pool);
         } else {
-          gsfby.insert(0, "Saptapper, with help of ");
+          result.path = in_path.string();
+          result.error = "File does not exist";
+        }
+
+        if (!result.error.empty()) {
+          succeeded = false;
+          if (format == InspectionWriter::Format::kTable) {
+            std::cerr << result.path << ": " << result.error << std::endl;
+            continue;
+          }
         }
+        writer.Write(result);
       }
+      writer.End();
+    } else {
+      for (const auto& in_path : in_paths) {
+        if (!exists(in_path)) {
+          std::cerr << in_path.string() << ": File does not exist"
+                    << std::endl;
+          succeeded = false;
+          continue;
+        }
+
+        try {
+          const Cartridge cartridge = Cartridge::LoadFromFile(
+              in_path, Saptapper::hash_types(options));
+
+          const std::filesystem::path basename{
+              basename_arg ? args::get(basename_arg) : in_path.stem()};
+          const std::filesystem::path outdir{args::get(outdir_arg)};
 
-      bool keep_duplicated = force_arg;
-      Saptapper::ConvertToGsfSet(cartridge, basename, outdir, gsfby,
-                                 keep_duplicated);
+          Saptapper::ConvertToGsfSet(cartridge, basename, outdir, options);
+        } catch (std::exception& e) {
+          if (in_paths.size() == 1) throw;
+          std::cerr << in_path.string() << ": " << e.what() << std::endl;
+          succeeded = false;
+        }
+      }
     }
+
+    if (!succeeded) return EXIT_FAILURE;
   } catch (std::exception& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -3,15 +3,20 @@
 #ifndef SAPTAPPER_ALGORITHM_HPP_
 #define SAPTAPPER_ALGORITHM_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstring>
+#include <future>
 #include <string_view>
+#include <utility>
+#include <vector>
+#include "thread_pool.hpp"
 #include "types.hpp"
 
 namespace saptapper {
 
-static bool memcmp_loose(const char* buf1, const char* buf2, size_t n,
+inline bool memcmp_loose(const char* buf1, const char* buf2, size_t n,
                          unsigned int max_diff) {
   unsigned int diff = 0;
   for (size_t pos = 0; pos < n; pos++) {
@@ -22,38 +27,103 @@ static bool memcmp_loose(const char* buf1, const char* buf2, size_t n,
   return true;
 }
 
-static agbptr_t find_loose(std::string_view rom, std::string_view pattern,
-                           unsigned int max_diff, agbsize_t pos = 0) {
-  if (rom.size() < pattern.size()) return agbnullptr;
+inline unsigned int count_mismatches(const char* buf1, const char* buf2,
+                                     size_t n) {
+  unsigned int diff = 0;
+  for (size_t pos = 0; pos < n; pos++) {
+    if (buf1[pos] != buf2[pos]) diff++;
+  }
+  return diff;
+}
+
+inline std::vector<agbptr_t> find_loose_all(std::string_view rom,
+                                            std::string_view pattern,
+                                            unsigned int max_diff,
+                                            agbsize_t pos = 0) {
+  std::vector<agbptr_t> matches;
+  if (rom.size() < pattern.size()) return matches;
 
   constexpr agbsize_t align = 4;
   for (agbsize_t offset = pos; offset < rom.size() - pattern.size();
        offset += align) {
     if (memcmp_loose(&rom[offset], pattern.data(), pattern.size(), max_diff))
-      return to_romptr(offset);
+      matches.push_back(to_romptr(offset));
+  }
+  return matches;
+}
+
+// Splits the offsets pos, pos + align, ... below end into chunks for the
+// workers of the pool. A worker reads the pattern past the end of its chunk,
+// so the matches across the boundaries are not lost.
+inline std::vector<std::pair<agbsize_t, agbsize_t>> split_scan_range(
+    agbsize_t pos, agbsize_t end, agbsize_t align, unsigned int thread_count) {
+  constexpr agbsize_t min_chunk_size = 0x10000;
+  std::vector<std::pair<agbsize_t, agbsize_t>> chunks;
+  if (pos >= end) return chunks;
+
+  // Several chunks per thread, so that a slow chunk does not idle the others.
+  agbsize_t chunk_size = (end - pos) / (thread_count * 8);
+  chunk_size = std::max(chunk_size - chunk_size % align, min_chunk_size);
+  for (agbsize_t start = pos; start < end; start += chunk_size)
+    chunks.emplace_back(start, end - start > chunk_size ? start + chunk_size
+                                                        : end);
+  return chunks;
+}
+
+// Same as find_loose_all, but scans the chunks of the ROM on the pool. The
+// matches are in the order of the serial scan.
+inline std::vector<agbptr_t> find_loose_all(std::string_view rom,
+                                            std::string_view pattern,
+                                            unsigned int max_diff,
+                                            agbsize_t pos, ThreadPool& pool) {
+  std::vector<agbptr_t> matches;
+  if (rom.size() < pattern.size()) return matches;
+
+  constexpr agbsize_t align = 4;
+  const agbsize_t end = static_cast<agbsize_t>(rom.size() - pattern.size());
+  std::vector<std::future<std::vector<agbptr_t>>> tasks;
+  for (const auto& [start, stop] :
+       split_scan_range(pos, end, align, pool.size())) {
+    tasks.push_back(pool.Async([&, start = start, stop = stop] {
+      std::vector<agbptr_t> chunk_matches;
+      for (agbsize_t offset = start; offset < stop; offset += align) {
+        if (memcmp_loose(&rom[offset], pattern.data(), pattern.size(),
+                         max_diff))
+          chunk_matches.push_back(to_romptr(offset));
+      }
+      return chunk_matches;
+    }));
+  }
+  for (auto& task : tasks) task.wait();
+  for (auto& task : tasks) {
+    const std::vector<agbptr_t> chunk_matches = task.get();
+    matches.insert(matches.end(), chunk_matches.begin(), chunk_matches.end());
   }
-  return agbnullptr;
+  return matches;
 }
 
 template <size_t _Size>
-static agbptr_t find_backwards(std::string_view rom,
-                               std::array<std::string_view, _Size> patterns,
-                               agbsize_t pos, agbsize_t length) {
-  if (pos >= rom.size()) return agbnullptr;
+inline std::vector<agbptr_t> find_backwards_all(
+    std::string_view rom, std::array<std::string_view, _Size> patterns,
+    agbsize_t pos, agbsize_t length, size_t max_count) {
+  std::vector<agbptr_t> matches;
+  if (pos >= rom.size()) return matches;
 
   constexpr agbsize_t align = 4;
   assert(length % align == 0);
-  if (length < align || rom.size() < length) return agbnullptr;
+  if (length < align || rom.size() < length || pos < length) return matches;
 
-  const agbsize_t max_pos = pos - align;
-  const agbsize_t min_pos = pos - length;
-  for (agbsize_t offset = max_pos; offset >= min_pos; offset -= align) {
+  for (agbsize_t distance = align; distance <= length; distance += align) {
+    const agbsize_t offset = pos - distance;
     for (const auto& pattern : patterns) {
-      if (std::memcmp(&rom[offset], pattern.data(), pattern.size()) == 0)
-        return to_romptr(offset);
+      if (std::memcmp(&rom[offset], pattern.data(), pattern.size()) == 0) {
+        matches.push_back(to_romptr(offset));
+        if (matches.size() >= max_count) return matches;
+        break;
+      }
     }
   }
-  return agbnullptr;
+  return matches;
 }
 
 }  // namespace saptapper
@@ -0,0 +1,957 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "arm7tdmi.hpp"
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include "types.hpp"
+
+namespace saptapper {
+
+static constexpr std::uint32_t kIrqVector = 0x18;
+
+static constexpr std::uint32_t rotate_right(std::uint32_t value,
+                                            unsigned int amount) noexcept {
+  amount &= 31;
+  return amount == 0 ? value : (value >> amount) | (value << (32 - amount));
+}
+
+static constexpr std::uint32_t sign_extend(std::uint32_t value,
+                                           unsigned int bits) noexcept {
+  const std::uint32_t sign = 1u << (bits - 1);
+  return (value ^ sign) - sign;
+}
+
+static int count_registers(std::uint32_t list) noexcept {
+  int count = 0;
+  for (; list != 0; list &= list - 1) count++;
+  return count;
+}
+
+void Arm7tdmi::Jump(std::uint32_t address) {
+  if ((address & 1) != 0) {
+    cpsr_ |= kFlagThumb;
+    regs_[15] = address & ~1u;
+  } else {
+    cpsr_ &= ~kFlagThumb;
+    regs_[15] = address & ~3u;
+  }
+}
+
+void Arm7tdmi::set_cpsr(std::uint32_t value) {
+  SwitchMode(value & 0x1f);
+  cpsr_ = value;
+}
+
+std::uint32_t Arm7tdmi::banked_sp(std::uint32_t mode) const {
+  const int bank = bank_of(mode);
+  return bank == bank_of(this->mode()) ? regs_[13] : banked_r13_[bank];
+}
+
+void Arm7tdmi::set_banked_sp(std::uint32_t mode, std::uint32_t value) {
+  const int bank = bank_of(mode);
+  if (bank == bank_of(this->mode())) {
+    regs_[13] = value;
+  } else {
+    banked_r13_[bank] = value;
+  }
+}
+
+void Arm7tdmi::Step() {
+  // While an instruction runs, r15 reads as its address plus 8 (ARM) or 4
+  // (Thumb), as with the pipeline of the real processor.
+  current_pc_ = regs_[15];
+  if (thumb()) {
+    const std::uint16_t instruction = bus_.Read16(current_pc_);
+    next_pc_ = current_pc_ + 2;
+    regs_[15] = current_pc_ + 4;
+    ExecuteThumb(instruction);
+  } else {
+    const std::uint32_t instruction = bus_.Read32(current_pc_);
+    next_pc_ = current_pc_ + 4;
+    regs_[15] = current_pc_ + 8;
+    if (CheckCondition(instruction >> 28)) ExecuteArm(instruction);
+  }
+  regs_[15] = next_pc_;
+}
+
+bool Arm7tdmi::InterruptRequest() {
+  if ((cpsr_ & kFlagIrqDisabled) != 0) return false;
+
+  // "subs pc, lr, #4" returns to the next instruction.
+  const std::uint32_t old_cpsr = cpsr_;
+  const std::uint32_t return_address = regs_[15] + 4;
+  set_cpsr((cpsr_ & ~(0x1fu | kFlagThumb)) | kModeIrq | kFlagIrqDisabled);
+  spsr_[bank_of(kModeIrq)] = old_cpsr;
+  regs_[14] = return_address;
+  regs_[15] = kIrqVector;
+  return true;
+}
+
+int Arm7tdmi::bank_of(std::uint32_t mode) {
+  switch (mode) {
+    case kModeFiq:
+      return 1;
+    case kModeIrq:
+      return 2;
+    case kModeSupervisor:
+      return 3;
+    case kModeAbort:
+      return 4;
+    case kModeUndefined:
+      return 5;
+    default:
+      return 0;
+  }
+}
+
+void Arm7tdmi::SetNZ(std::uint32_t result) noexcept {
+  cpsr_ = (cpsr_ & 0x3fffffff) | (result & 0x80000000) |
+          (result == 0 ? 0x40000000 : 0);
+}
+
+void Arm7tdmi::SetC(bool carry) noexcept {
+  cpsr_ = (cpsr_ & ~0x20000000u) | (carry ? 0x20000000 : 0);
+}
+
+void Arm7tdmi::SetV(bool overflow) noexcept {
+  cpsr_ = (cpsr_ & ~0x10000000u) | (overflow ? 0x10000000 : 0);
+}
+
+std::uint32_t Arm7tdmi::Add(std::uint32_t lhs, std::uint32_t rhs,
+                            bool carry_in, bool set_flags) noexcept {
+  const std::uint64_t sum = std::uint64_t{lhs} + rhs + (carry_in ? 1 : 0);
+  const auto result = static_cast<std::uint32_t>(sum);
+  if (set_flags) {
+    SetNZ(result);
+    SetC((sum >> 32) != 0);
+    SetV((((lhs ^ result) & (rhs ^ result)) >> 31) != 0);
+  }
+  return result;
+}
+
+std::uint32_t Arm7tdmi::Shift(int type, std::uint32_t value,
+                              std::uint32_t amount, bool immediate,
+                              bool& carry) const noexcept {
+  switch (type) {
+    case 0:  // LSL
+      if (amount == 0) return value;
+      if (amount < 32) {
+        carry = ((value >> (32 - amount)) & 1) != 0;
+        return value << amount;
+      }
+      carry = amount == 32 && (value & 1) != 0;
+      return 0;
+
+    case 1:  // LSR
+      if (immediate && amount == 0) amount = 32;
+      if (amount == 0) return value;
+      if (amount < 32) {
+        carry = ((value >> (amount - 1)) & 1) != 0;
+        return value >> amount;
+      }
+      carry = amount == 32 && (value >> 31) != 0;
+      return 0;
+
+    case 2:  // ASR
+      if (immediate && amount == 0) amount = 32;
+      if (amount == 0) return value;
+      if (amount < 32) {
+        carry = ((value >> (amount - 1)) & 1) != 0;
+        return static_cast<std::uint32_t>(static_cast<std::int32_t>(value) >>
+                                          amount);
+      }
+      carry = (value >> 31) != 0;
+      return carry ? 0xffffffff : 0;
+
+    default:  // ROR
+      if (immediate && amount == 0) {  // RRX
+        const bool carry_in = carry;
+        carry = (value & 1) != 0;
+        return (carry_in ? 0x80000000 : 0) | (value >> 1);
+      }
+      if (amount == 0) return value;
+      if ((amount & 31) == 0) {
+        carry = (value >> 31) != 0;
+        return value;
+      }
+      carry = ((value >> ((amount & 31) - 1)) & 1) != 0;
+      return rotate_right(value, amount);
+  }
+}
+
+bool Arm7tdmi::CheckCondition(std::uint32_t condition) const noexcept {
+  switch (condition) {
+    case 0x0:  // EQ
+      return flag_z();
+    case 0x1:  // NE
+      return !flag_z();
+    case 0x2:  // CS
+      return flag_c();
+    case 0x3:  // CC
+      return !flag_c();
+    case 0x4:  // MI
+      return flag_n();
+    case 0x5:  // PL
+      return !flag_n();
+    case 0x6:  // VS
+      return flag_v();
+    case 0x7:  // VC
+      return !flag_v();
+    case 0x8:  // HI
+      return flag_c() && !flag_z();
+    case 0x9:  // LS
+      return !flag_c() || flag_z();
+    case 0xa:  // GE
+      return flag_n() == flag_v();
+    case 0xb:  // LT
+      return flag_n() != flag_v();
+    case 0xc:  // GT
+      return !flag_z() && flag_n() == flag_v();
+    case 0xd:  // LE
+      return flag_z() || flag_n() != flag_v();
+    case 0xe:  // AL
+      return true;
+    default:  // NV
+      return false;
+  }
+}
+
+std::uint32_t Arm7tdmi::ReadRotated32(std::uint32_t address) {
+  // Unaligned word loads rotate the aligned word.
+  return rotate_right(bus_.Read32(address & ~3u), (address & 3) * 8);
+}
+
+void Arm7tdmi::WriteReg(int index, std::uint32_t value) {
+  if (index == 15) {
+    next_pc_ = value & (thumb() ? ~1u : ~3u);
+  } else {
+    regs_[index] = value;
+  }
+}
+
+void Arm7tdmi::SwitchMode(std::uint32_t new_mode) {
+  const int old_bank = bank_of(mode());
+  const int new_bank = bank_of(new_mode);
+  if (old_bank == new_bank) return;
+
+  banked_r13_[old_bank] = regs_[13];
+  banked_r14_[old_bank] = regs_[14];
+  if (old_bank == bank_of(kModeFiq)) {
+    for (int i = 0; i < 5; i++) {
+      fiq_r8_r12_[i] = regs_[8 + i];
+      regs_[8 + i] = user_r8_r12_[i];
+    }
+  }
+  if (new_bank == bank_of(kModeFiq)) {
+    for (int i = 0; i < 5; i++) {
+      user_r8_r12_[i] = regs_[8 + i];
+      regs_[8 + i] = fiq_r8_r12_[i];
+    }
+  }
+  regs_[13] = banked_r13_[new_bank];
+  regs_[14] = banked_r14_[new_bank];
+}
+
+void Arm7tdmi::ReturnFromException() {
+  const int bank = bank_of(mode());
+  if (bank != 0) set_cpsr(spsr_[bank]);
+}
+
+void Arm7tdmi::CallSwi(std::uint32_t number) {
+  if (!swi_handler_) {
+    std::ostringstream message;
+    message << "Unhandled SWI 0x" << std::hex << number << " at "
+            << to_string(current_pc_) << ".";
+    throw std::runtime_error(message.str());
+  }
+  swi_handler_(number);
+}
+
+void Arm7tdmi::ThrowUndefined(std::uint32_t instruction) const {
+  std::ostringstream message;
+  message << "Undefined " << (thumb() ? "Thumb" : "ARM") << " instruction 0x"
+          << std::hex << instruction << " at " << to_string(current_pc_)
+          << ".";
+  throw std::runtime_error(message.str());
+}
+
+void Arm7tdmi::ExecuteArm(std::uint32_t instruction) {
+  if ((instruction & 0x0ffffff0) == 0x012fff10) {  // BX
+    const std::uint32_t target = regs_[instruction & 15];
+    if ((target & 1) != 0) {
+      cpsr_ |= kFlagThumb;
+      next_pc_ = target & ~1u;
+    } else {
+      next_pc_ = target & ~3u;
+    }
+  } else if ((instruction & 0x0fc000f0) == 0x00000090) {
+    ExecuteArmMultiply(instruction);
+  } else if ((instruction & 0x0f8000f0) == 0x00800090) {
+    ExecuteArmMultiplyLong(instruction);
+  } else if ((instruction & 0x0fb00ff0) == 0x01000090) {  // SWP
+    const std::uint32_t address = regs_[(instruction >> 16) & 15];
+    const std::uint32_t source = regs_[instruction & 15];
+    std::uint32_t value;
+    if ((instruction & (1 << 22)) != 0) {
+      value = bus_.Read8(address);
+      bus_.Write8(address, static_cast<std::uint8_t>(source));
+    } else {
+      value = ReadRotated32(address);
+      bus_.Write32(address & ~3u, source);
+    }
+    WriteReg((instruction >> 12) & 15, value);
+  } else if ((instruction & 0x0e000090) == 0x00000090) {
+    if ((instruction & 0x60) == 0) ThrowUndefined(instruction);
+    ExecuteArmHalfwordTransfer(instruction);
+  } else if ((instruction & 0x0fbf0fff) == 0x010f0000 ||
+             (instruction & 0x0fb0fff0) == 0x0120f000 ||
+             (instruction & 0x0fb0f000) == 0x0320f000) {
+    ExecuteArmStatusTransfer(instruction);
+  } else {
+    switch ((instruction >> 25) & 7) {
+      case 0:
+      case 1:
+        ExecuteArmDataProcessing(instruction);
+        break;
+
+      case 2:
+      case 3:
+        if ((instruction & 0x02000010) == 0x02000010)
+          ThrowUndefined(instruction);
+        ExecuteArmSingleTransfer(instruction);
+        break;
+
+      case 4:
+        ExecuteArmBlockTransfer(instruction);
+        break;
+
+      case 5: {  // B, BL
+        if ((instruction & (1 << 24)) != 0) regs_[14] = current_pc_ + 4;
+        WriteReg(15, regs_[15] + (sign_extend(instruction & 0xffffff, 24) << 2));
+        break;
+      }
+
+      case 7:
+        if ((instruction & (1 << 24)) == 0) ThrowUndefined(instruction);
+        CallSwi((instruction >> 16) & 0xff);
+        break;
+
+      default:  // coprocessor instructions
+        ThrowUndefined(instruction);
+    }
+  }
+}
+
+void Arm7tdmi::ExecuteArmDataProcessing(std::uint32_t instruction) {
+  const int opcode = (instruction >> 21) & 15;
+  const bool set_flags = (instruction & (1 << 20)) != 0;
+  const int rn = (instruction >> 16) & 15;
+  const int rd = (instruction >> 12) & 15;
+
+  bool carry = flag_c();
+  std::uint32_t operand;
+  std::uint32_t lhs = regs_[rn];
+  if ((instruction & (1 << 25)) != 0) {
+    const unsigned int rotation = ((instruction >> 8) & 15) * 2;
+    operand = rotate_right(instruction & 0xff, rotation);
+    if (rotation != 0) carry = (operand >> 31) != 0;
+  } else {
+    const int rm = instruction & 15;
+    const int type = (instruction >> 5) & 3;
+    if ((instruction & 0x10) != 0) {
+      // r15 reads one word further when the shift amount is a register.
+      const std::uint32_t value = regs_[rm] + (rm == 15 ? 4 : 0);
+      if (rn == 15) lhs += 4;
+      operand = Shift(type, value, regs_[(instruction >> 8) & 15] & 0xff,
+                      false, carry);
+    } else {
+      operand = Shift(type, regs_[rm], (instruction >> 7) & 31, true, carry);
+    }
+  }
+
+  // Writing r15 with the S bit returns from an exception instead of setting
+  // the flags.
+  const bool flags = set_flags && rd != 15;
+  const bool test = opcode >= 8 && opcode <= 11;
+  std::uint32_t result = 0;
+  switch (opcode) {
+    case 0x0:  // AND
+    case 0x8:  // TST
+      result = lhs & operand;
+      break;
+    case 0x1:  // EOR
+    case 0x9:  // TEQ
+      result = lhs ^ operand;
+      break;
+    case 0x2:  // SUB
+      result = Sub(lhs, operand, true, flags);
+      break;
+    case 0x3:  // RSB
+      result = Sub(operand, lhs, true, flags);
+      break;
+    case 0x4:  // ADD
+      result = Add(lhs, operand, false, flags);
+      break;
+    case 0x5:  // ADC
+      result = Add(lhs, operand, flag_c(), flags);
+      break;
+    case 0x6:  // SBC
+      result = Sub(lhs, operand, flag_c(), flags);
+      break;
+    case 0x7:  // RSC
+      result = Sub(operand, lhs, flag_c(), flags);
+      break;
+    case 0xa:  // CMP
+      result = Sub(lhs, operand, true, true);
+      break;
+    case 0xb:  // CMN
+      result = Add(lhs, operand, false, true);
+      break;
+    case 0xc:  // ORR
+      result = lhs | operand;
+      break;
+    case 0xd:  // MOV
+      result = operand;
+      break;
+    case 0xe:  // BIC
+      result = lhs & ~operand;
+      break;
+    default:  // MVN
+      result = ~operand;
+      break;
+  }
+
+  const bool logical = opcode <= 1 || opcode == 8 || opcode == 9 ||
+                       opcode >= 12;
+  if (logical && (flags || test)) {
+    SetNZ(result);
+    SetC(carry);
+  }
+  if (test) return;
+
+  if (rd == 15 && set_flags) {
+    ReturnFromException();
+    next_pc_ = result & (thumb() ? ~1u : ~3u);
+  } else {
+    WriteReg(rd, result);
+  }
+}
+
+void Arm7tdmi::ExecuteArmMultiply(std::uint32_t instruction) {
+  const int rd = (instruction >> 16) & 15;
+  std::uint32_t result =
+      regs_[instruction & 15] * regs_[(instruction >> 8) & 15];
+  if ((instruction & (1 << 21)) != 0) result += regs_[(instruction >> 12) & 15];
+  if ((instruction & (1 << 20)) != 0) SetNZ(result);
+  WriteReg(rd, result);
+}
+
+void Arm7tdmi::ExecuteArmMultiplyLong(std::uint32_t instruction) {
+  const int rd_hi = (instruction >> 16) & 15;
+  const int rd_lo = (instruction >> 12) & 15;
+  const std::uint32_t rs = regs_[(instruction >> 8) & 15];
+  const std::uint32_t rm = regs_[instruction & 15];
+
+  std::uint64_t result;
+  if ((instruction & (1 << 22)) != 0) {
+    result = static_cast<std::uint64_t>(
+        std::int64_t{static_cast<std::int32_t>(rm)} *
+        static_cast<std::int32_t>(rs));
+  } else {
+    result = std::uint64_t{rm} * rs;
+  }
+  if ((instruction & (1 << 21)) != 0)
+    result += (std::uint64_t{regs_[rd_hi]} << 32) | regs_[rd_lo];
+
+  if ((instruction & (1 << 20)) != 0) {
+    SetNZ(static_cast<std::uint32_t>(result >> 32));
+    if (result == 0) SetNZ(0);
+  }
+  WriteReg(rd_lo, static_cast<std::uint32_t>(result));
+  WriteReg(rd_hi, static_cast<std::uint32_t>(result >> 32));
+}
+
+void Arm7tdmi::ExecuteArmSingleTransfer(std::uint32_t instruction) {
+  const bool pre = (instruction & (1 << 24)) != 0;
+  const bool up = (instruction & (1 << 23)) != 0;
+  const bool byte = (instruction & (1 << 22)) != 0;
+  const bool writeback = (instruction & (1 << 21)) != 0;
+  const bool load = (instruction & (1 << 20)) != 0;
+  const int rn = (instruction >> 16) & 15;
+  const int rd = (instruction >> 12) & 15;
+
+  std::uint32_t offset = instruction & 0xfff;
+  if ((instruction & (1 << 25)) != 0) {
+    bool carry = flag_c();
+    offset = Shift((instruction >> 5) & 3, regs_[instruction & 15],
+                   (instruction >> 7) & 31, true, carry);
+  }
+
+  const std::uint32_t base = regs_[rn];
+  const std::uint32_t offset_address = up ? base + offset : base - offset;
+  const std::uint32_t address = pre ? offset_address : base;
+
+  std::uint32_t value = 0;
+  if (load) {
+    value = byte ? bus_.Read8(address) : ReadRotated32(address);
+  } else {
+    value = regs_[rd] + (rd == 15 ? 4 : 0);
+    if (byte) {
+      bus_.Write8(address, static_cast<std::uint8_t>(value));
+    } else {
+      bus_.Write32(address & ~3u, value);
+    }
+  }
+
+  if (!pre || writeback) WriteReg(rn, offset_address);
+  if (load) WriteReg(rd, value);
+}
+
+void Arm7tdmi::ExecuteArmHalfwordTransfer(std::uint32_t instruction) {
+  const bool pre = (instruction & (1 << 24)) != 0;
+  const bool up = (instruction & (1 << 23)) != 0;
+  const bool immediate = (instruction & (1 << 22)) != 0;
+  const bool writeback = (instruction & (1 << 21)) != 0;
+  const bool load = (instruction & (1 << 20)) != 0;
+  const int rn = (instruction >> 16) & 15;
+  const int rd = (instruction >> 12) & 15;
+  const int type = (instruction >> 5) & 3;
+
+  const std::uint32_t offset =
+      immediate ? ((instruction >> 4) & 0xf0) | (instruction & 0xf)
+                : regs_[instruction & 15];
+  const std::uint32_t base = regs_[rn];
+  const std::uint32_t offset_address = up ? base + offset : base - offset;
+  const std::uint32_t address = pre ? offset_address : base;
+
+  std::uint32_t value = 0;
+  if (load) {
+    switch (type) {
+      case 1:  // LDRH
+        value = rotate_right(bus_.Read16(address & ~1u), (address & 1) * 8);
+        break;
+      case 2:  // LDRSB
+        value = sign_extend(bus_.Read8(address), 8);
+        break;
+      default:  // LDRSH
+        value = (address & 1) != 0
+                    ? sign_extend(bus_.Read8(address), 8)
+                    : sign_extend(bus_.Read16(address), 16);
+        break;
+    }
+  } else {
+    if (type != 1) ThrowUndefined(instruction);
+    bus_.Write16(address & ~1u, static_cast<std::uint16_t>(
+                                    regs_[rd] + (rd == 15 ? 4 : 0)));
+  }
+
+  if (!pre || writeback) WriteReg(rn, offset_address);
+  if (load) WriteReg(rd, value);
+}
+
+void Arm7tdmi::ExecuteArmBlockTransfer(std::uint32_t instruction) {
+  const bool pre = (instruction & (1 << 24)) != 0;
+  const bool up = (instruction & (1 << 23)) != 0;
+  const bool psr = (instruction & (1 << 22)) != 0;
+  const bool writeback = (instruction & (1 << 21)) != 0;
+  const bool load = (instruction & (1 << 20)) != 0;
+  const int rn = (instruction >> 16) & 15;
+  const std::uint32_t list = instruction & 0xffff;
+  if (list == 0) ThrowUndefined(instruction);
+
+  const std::uint32_t base = regs_[rn];
+  const std::uint32_t size = count_registers(list) * 4;
+  const std::uint32_t final_address = up ? base + size : base - size;
+  std::uint32_t address = (up ? base : final_address) + (pre == up ? 4 : 0);
+
+  // The S bit without r15 in the list of LDM (or with STM) transfers the
+  // user mode registers.
+  const bool user_bank = psr && !(load && (list & 0x8000) != 0);
+  const std::uint32_t saved_cpsr = cpsr_;
+  if (user_bank) set_cpsr((cpsr_ & ~0x1fu) | kModeUser);
+
+  if (load) {
+    if (writeback) WriteReg(rn, final_address);
+    std::uint32_t pc_value = 0;
+    for (int i = 0; i < 16; i++) {
+      if ((list & (1 << i)) == 0) continue;
+      const std::uint32_t value = bus_.Read32(address & ~3u);
+      if (i == 15) {
+        pc_value = value;
+      } else {
+        regs_[i] = value;
+      }
+      address += 4;
+    }
+    if (user_bank) set_cpsr(saved_cpsr);
+    if ((list & 0x8000) != 0) {
+      if (psr) ReturnFromException();
+      next_pc_ = pc_value & (thumb() ? ~1u : ~3u);
+    }
+  } else {
+    for (int i = 0; i < 16; i++) {
+      if ((list & (1 << i)) == 0) continue;
+      bus_.Write32(address & ~3u, regs_[i] + (i == 15 ? 4 : 0));
+      address += 4;
+    }
+    if (user_bank) set_cpsr(saved_cpsr);
+    if (writeback) WriteReg(rn, final_address);
+  }
+}
+
+void Arm7tdmi::ExecuteArmStatusTransfer(std::uint32_t instruction) {
+  const bool use_spsr = (instruction & (1 << 22)) != 0;
+  const int bank = bank_of(mode());
+  if ((instruction & (1 << 21)) == 0) {  // MRS
+    WriteReg((instruction >> 12) & 15,
+             use_spsr && bank != 0 ? spsr_[bank] : cpsr_);
+    return;
+  }
+
+  // MSR
+  const std::uint32_t value =
+      (instruction & (1 << 25)) != 0
+          ? rotate_right(instruction & 0xff, ((instruction >> 8) & 15) * 2)
+          : regs_[instruction & 15];
+  std::uint32_t mask = 0;
+  if ((instruction & (1 << 19)) != 0) mask |= 0xff000000;
+  if ((instruction & (1 << 16)) != 0) mask |= 0x000000ff;
+  if (use_spsr) {
+    if (bank != 0) spsr_[bank] = (spsr_[bank] & ~mask) | (value & mask);
+  } else {
+    if (mode() == kModeUser) mask &= 0xff000000;
+    set_cpsr((cpsr_ & ~mask) | (value & mask));
+  }
+}
+
+void Arm7tdmi::ExecuteThumb(std::uint16_t instruction) {
+  switch (instruction >> 13) {
+    case 0: {
+      const int rd = instruction & 7;
+      const std::uint32_t rs = regs_[(instruction >> 3) & 7];
+      if (((instruction >> 11) & 3) == 3) {  // ADD, SUB
+        const std::uint32_t operand = (instruction & 0x400) != 0
+                                          ? (instruction >> 6) & 7
+                                          : regs_[(instruction >> 6) & 7];
+        regs_[rd] = (instruction & 0x200) != 0 ? Sub(rs, operand, true, true)
+                                               : Add(rs, operand, false, true);
+      } else {  // LSL, LSR, ASR
+        bool carry = flag_c();
+        regs_[rd] = Shift((instruction >> 11) & 3, rs, (instruction >> 6) & 31,
+                          true, carry);
+        SetNZ(regs_[rd]);
+        SetC(carry);
+      }
+      break;
+    }
+
+    case 1: {  // MOV, CMP, ADD, SUB with an immediate
+      const int rd = (instruction >> 8) & 7;
+      const std::uint32_t immediate = instruction & 0xff;
+      switch ((instruction >> 11) & 3) {
+        case 0:
+          regs_[rd] = immediate;
+          SetNZ(immediate);
+          break;
+        case 1:
+          Sub(regs_[rd], immediate, true, true);
+          break;
+        case 2:
+          regs_[rd] = Add(regs_[rd], immediate, false, true);
+          break;
+        default:
+          regs_[rd] = Sub(regs_[rd], immediate, true, true);
+          break;
+      }
+      break;
+    }
+
+    case 2:
+      if ((instruction & 0xfc00) == 0x4000) {
+        ExecuteThumbAlu(instruction);
+      } else if ((instruction & 0xfc00) == 0x4400) {
+        ExecuteThumbHighRegister(instruction);
+      } else if ((instruction & 0xf800) == 0x4800) {  // LDR Rd, [PC, #imm]
+        const std::uint32_t address =
+            (regs_[15] & ~3u) + (instruction & 0xff) * 4;
+        regs_[(instruction >> 8) & 7] = bus_.Read32(address);
+      } else {
+        ExecuteThumbTransfer(instruction);
+      }
+      break;
+
+    case 3:
+    case 4:
+      ExecuteThumbTransfer(instruction);
+      break;
+
+    case 5:
+      if ((instruction & 0xf000) == 0xa000) {  // ADD Rd, PC/SP, #imm
+        const std::uint32_t base =
+            (instruction & 0x800) != 0 ? regs_[13] : regs_[15] & ~3u;
+        regs_[(instruction >> 8) & 7] = base + (instruction & 0xff) * 4;
+      } else if ((instruction & 0xff00) == 0xb000) {  // ADD SP, #imm
+        const std::uint32_t immediate = (instruction & 0x7f) * 4;
+        regs_[13] += (instruction & 0x80) != 0 ? -immediate : immediate;
+      } else if ((instruction & 0xf600) == 0xb400) {
+        ExecuteThumbBlockTransfer(instruction);
+      } else {
+        ThrowUndefined(instruction);
+      }
+      break;
+
+    case 6:
+      if ((instruction & 0xf000) == 0xc000) {
+        ExecuteThumbBlockTransfer(instruction);
+      } else {
+        const std::uint32_t condition = (instruction >> 8) & 15;
+        if (condition == 15) {
+          CallSwi(instruction & 0xff);
+        } else if (condition == 14) {
+          ThrowUndefined(instruction);
+        } else if (CheckCondition(condition)) {
+          WriteReg(15, regs_[15] + sign_extend(instruction & 0xff, 8) * 2);
+        }
+      }
+      break;
+
+    default:
+      switch (instruction & 0xf800) {
+        case 0xe000:  // B
+          WriteReg(15, regs_[15] + sign_extend(instruction & 0x7ff, 11) * 2);
+          break;
+        case 0xf000:  // BL (high part)
+          regs_[14] = regs_[15] + (sign_extend(instruction & 0x7ff, 11) << 12);
+          break;
+        case 0xf800: {  // BL (low part)
+          const std::uint32_t target = regs_[14] + (instruction & 0x7ff) * 2;
+          regs_[14] = (current_pc_ + 2) | 1;
+          WriteReg(15, target);
+          break;
+        }
+        default:
+          ThrowUndefined(instruction);
+      }
+      break;
+  }
+}
+
+void Arm7tdmi::ExecuteThumbAlu(std::uint16_t instruction) {
+  const int rd = instruction & 7;
+  const std::uint32_t lhs = regs_[rd];
+  const std::uint32_t rhs = regs_[(instruction >> 3) & 7];
+  bool carry = flag_c();
+  std::uint32_t result;
+  switch ((instruction >> 6) & 15) {
+    case 0x0:  // AND
+      regs_[rd] = result = lhs & rhs;
+      SetNZ(result);
+      break;
+    case 0x1:  // EOR
+      regs_[rd] = result = lhs ^ rhs;
+      SetNZ(result);
+      break;
+    case 0x2:  // LSL
+    case 0x3:  // LSR
+    case 0x4:  // ASR
+    case 0x7:  // ROR
+    {
+      static constexpr int kTypes[8] = {0, 0, 0, 1, 2, 0, 0, 3};
+      regs_[rd] = result = Shift(kTypes[(instruction >> 6) & 7], lhs,
+                                 rhs & 0xff, false, carry);
+      SetNZ(result);
+      SetC(carry);
+      break;
+    }
+    case 0x5:  // ADC
+      regs_[rd] = Add(lhs, rhs, flag_c(), true);
+      break;
+    case 0x6:  // SBC
+      regs_[rd] = Sub(lhs, rhs, flag_c(), true);
+      break;
+    case 0x8:  // TST
+      SetNZ(lhs & rhs);
+      break;
+    case 0x9:  // NEG
+      regs_[rd] = Sub(0, rhs, true, true);
+      break;
+    case 0xa:  // CMP
+      Sub(lhs, rhs, true, true);
+      break;
+    case 0xb:  // CMN
+      Add(lhs, rhs, false, true);
+      break;
+    case 0xc:  // ORR
+      regs_[rd] = result = lhs | rhs;
+      SetNZ(result);
+      break;
+    case 0xd:  // MUL
+      regs_[rd] = result = lhs * rhs;
+      SetNZ(result);
+      break;
+    case 0xe:  // BIC
+      regs_[rd] = result = lhs & ~rhs;
+      SetNZ(result);
+      break;
+    default:  // MVN
+      regs_[rd] = result = ~rhs;
+      SetNZ(result);
+      break;
+  }
+}
+
+void Arm7tdmi::ExecuteThumbHighRegister(std::uint16_t instruction) {
+  const int rd = (instruction & 7) | ((instruction >> 4) & 8);
+  const std::uint32_t rs = regs_[(instruction >> 3) & 15];
+  switch ((instruction >> 8) & 3) {
+    case 0:  // ADD
+      WriteReg(rd, regs_[rd] + rs);
+      break;
+    case 1:  // CMP
+      Sub(regs_[rd], rs, true, true);
+      break;
+    case 2:  // MOV
+      WriteReg(rd, rs);
+      break;
+    default:  // BX
+      if ((rs & 1) != 0) {
+        next_pc_ = rs & ~1u;
+      } else {
+        cpsr_ &= ~kFlagThumb;
+        next_pc_ = rs & ~3u;
+      }
+      break;
+  }
+}
+
+void Arm7tdmi::ExecuteThumbTransfer(std::uint16_t instruction) {
+  const int rd = instruction & 7;
+  const std::uint32_t rb = regs_[(instruction >> 3) & 7];
+
+  if ((instruction & 0xf000) == 0x5000) {  // register offset
+    const std::uint32_t address = rb + regs_[(instruction >> 6) & 7];
+    switch ((instruction >> 9) & 7) {
+      case 0:  // STR
+        bus_.Write32(address & ~3u, regs_[rd]);
+        break;
+      case 1:  // STRH
+        bus_.Write16(address & ~1u, static_cast<std::uint16_t>(regs_[rd]));
+        break;
+      case 2:  // STRB
+        bus_.Write8(address, static_cast<std::uint8_t>(regs_[rd]));
+        break;
+      case 3:  // LDSB
+        regs_[rd] = sign_extend(bus_.Read8(address), 8);
+        break;
+      case 4:  // LDR
+        regs_[rd] = ReadRotated32(address);
+        break;
+      case 5:  // LDRH
+        regs_[rd] =
+            rotate_right(bus_.Read16(address & ~1u), (address & 1) * 8);
+        break;
+      case 6:  // LDRB
+        regs_[rd] = bus_.Read8(address);
+        break;
+      default:  // LDSH
+        regs_[rd] = (address & 1) != 0 ? sign_extend(bus_.Read8(address), 8)
+                                       : sign_extend(bus_.Read16(address), 16);
+        break;
+    }
+    return;
+  }
+
+  const bool load = (instruction & 0x800) != 0;
+  const std::uint32_t offset = (instruction >> 6) & 31;
+  if ((instruction & 0xe000) == 0x6000) {  // word or byte, immediate offset
+    if ((instruction & 0x1000) != 0) {
+      const std::uint32_t address = rb + offset;
+      if (load) {
+        regs_[rd] = bus_.Read8(address);
+      } else {
+        bus_.Write8(address, static_cast<std::uint8_t>(regs_[rd]));
+      }
+    } else {
+      const std::uint32_t address = rb + offset * 4;
+      if (load) {
+        regs_[rd] = ReadRotated32(address);
+      } else {
+        bus_.Write32(address & ~3u, regs_[rd]);
+      }
+    }
+  } else if ((instruction & 0xf000) == 0x8000) {  // halfword
+    const std::uint32_t address = rb + offset * 2;
+    if (load) {
+      regs_[rd] = rotate_right(bus_.Read16(address & ~1u), (address & 1) * 8);
+    } else {
+      bus_.Write16(address & ~1u, static_cast<std::uint16_t>(regs_[rd]));
+    }
+  } else {  // SP-relative
+    const int sp_rd = (instruction >> 8) & 7;
+    const std::uint32_t address = regs_[13] + (instruction & 0xff) * 4;
+    if (load) {
+      regs_[sp_rd] = ReadRotated32(address);
+    } else {
+      bus_.Write32(address & ~3u, regs_[sp_rd]);
+    }
+  }
+}
+
+void Arm7tdmi::ExecuteThumbBlockTransfer(std::uint16_t instruction) {
+  const bool load = (instruction & 0x800) != 0;
+  std::uint32_t list = instruction & 0xff;
+
+  if ((instruction & 0xf000) == 0xb000) {  // PUSH, POP
+    const bool extra = (instruction & 0x100) != 0;  // LR or PC
+    if (load) {
+      std::uint32_t address = regs_[13];
+      for (int i = 0; i < 8; i++) {
+        if ((list & (1 << i)) == 0) continue;
+        regs_[i] = bus_.Read32(address & ~3u);
+        address += 4;
+      }
+      if (extra) {
+        // ARMv4T stays in the Thumb state.
+        WriteReg(15, bus_.Read32(address & ~3u));
+        address += 4;
+      }
+      regs_[13] = address;
+    } else {
+      const std::uint32_t count = count_registers(list) + (extra ? 1 : 0);
+      std::uint32_t address = regs_[13] - count * 4;
+      regs_[13] = address;
+      for (int i = 0; i < 8; i++) {
+        if ((list & (1 << i)) == 0) continue;
+        bus_.Write32(address & ~3u, regs_[i]);
+        address += 4;
+      }
+      if (extra) bus_.Write32(address & ~3u, regs_[14]);
+    }
+    return;
+  }
+
+  // LDMIA, STMIA
+  const int rb = (instruction >> 8) & 7;
+  if (list == 0) ThrowUndefined(instruction);
+  std::uint32_t address = regs_[rb];
+  const std::uint32_t final_address = address + count_registers(list) * 4;
+  if (load) {
+    regs_[rb] = final_address;
+    for (int i = 0; i < 8; i++) {
+      if ((list & (1 << i)) == 0) continue;
+      regs_[i] = bus_.Read32(address & ~3u);
+      address += 4;
+    }
+  } else {
+    for (int i = 0; i < 8; i++) {
+      if ((list & (1 << i)) == 0) continue;
+      bus_.Write32(address & ~3u, regs_[i]);
+      address += 4;
+    }
+    regs_[rb] = final_address;
+  }
+}
+
+}  // namespace saptapper
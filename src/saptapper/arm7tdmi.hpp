@@ -0,0 +1,155 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_ARM7TDMI_HPP_
+#define SAPTAPPER_ARM7TDMI_HPP_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace saptapper {
+
+/// Minimal ARM7TDMI (ARMv4T) interpreter, for running short code paths
+/// without an emulator.
+///
+/// It executes the ARM and Thumb instruction sets one instruction at a time,
+/// without pipeline or cycle timing. Software interrupts are passed to the
+/// handler instead of a BIOS, and undefined instructions throw
+/// std::runtime_error.
+class Arm7tdmi {
+ public:
+  /// The memory seen by the processor.
+  class Bus {
+   public:
+    virtual ~Bus() = default;
+    virtual std::uint8_t Read8(std::uint32_t address) = 0;
+    virtual std::uint16_t Read16(std::uint32_t address) = 0;
+    virtual std::uint32_t Read32(std::uint32_t address) = 0;
+    virtual void Write8(std::uint32_t address, std::uint8_t value) = 0;
+    virtual void Write16(std::uint32_t address, std::uint16_t value) = 0;
+    virtual void Write32(std::uint32_t address, std::uint32_t value) = 0;
+  };
+
+  /// The handler of SWI instructions, which receives the BIOS function
+  /// number (the comment field in Thumb, its bits 16-23 in ARM).
+  using SwiHandler = std::function<void(std::uint32_t number)>;
+
+  static constexpr std::uint32_t kModeUser = 0x10;
+  static constexpr std::uint32_t kModeFiq = 0x11;
+  static constexpr std::uint32_t kModeIrq = 0x12;
+  static constexpr std::uint32_t kModeSupervisor = 0x13;
+  static constexpr std::uint32_t kModeAbort = 0x17;
+  static constexpr std::uint32_t kModeUndefined = 0x1b;
+  static constexpr std::uint32_t kModeSystem = 0x1f;
+
+  static constexpr std::uint32_t kFlagThumb = 1 << 5;
+  static constexpr std::uint32_t kFlagIrqDisabled = 1 << 7;
+
+  explicit Arm7tdmi(Bus& bus) : bus_{bus} {}
+
+  void set_swi_handler(SwiHandler handler) {
+    swi_handler_ = std::move(handler);
+  }
+
+  /// Returns the address of the next instruction.
+  std::uint32_t pc() const noexcept { return regs_[15]; }
+
+  /// Jumps to the address. Bit 0 selects the Thumb state.
+  void Jump(std::uint32_t address);
+
+  bool thumb() const noexcept { return (cpsr_ & kFlagThumb) != 0; }
+
+  std::uint32_t reg(int index) const noexcept { return regs_[index]; }
+
+  void set_reg(int index, std::uint32_t value) noexcept {
+    regs_[index] = value;
+  }
+
+  std::uint32_t cpsr() const noexcept { return cpsr_; }
+
+  /// Sets the CPSR, switching the banked registers if the mode changes.
+  void set_cpsr(std::uint32_t value);
+
+  /// Returns the stack pointer of the mode, which may not be the current one.
+  std::uint32_t banked_sp(std::uint32_t mode) const;
+
+  void set_banked_sp(std::uint32_t mode, std::uint32_t value);
+
+  /// Executes an instruction.
+  void Step();
+
+  /// Takes the IRQ exception (at the vector 0x18) between instructions,
+  /// unless IRQs are disabled. Returns whether the exception was taken.
+  bool InterruptRequest();
+
+ private:
+  static constexpr int kBankCount = 6;
+
+  Bus& bus_;
+  SwiHandler swi_handler_;
+
+  std::array<std::uint32_t, 16> regs_{};
+  std::uint32_t cpsr_ = kModeSystem;
+  std::array<std::uint32_t, kBankCount> banked_r13_{};
+  std::array<std::uint32_t, kBankCount> banked_r14_{};
+  std::array<std::uint32_t, kBankCount> spsr_{};
+  std::array<std::uint32_t, 5> user_r8_r12_{};
+  std::array<std::uint32_t, 5> fiq_r8_r12_{};
+
+  // The address of the instruction being executed, and the one to follow.
+  std::uint32_t current_pc_ = 0;
+  std::uint32_t next_pc_ = 0;
+
+  static int bank_of(std::uint32_t mode);
+
+  std::uint32_t mode() const noexcept { return cpsr_ & 0x1f; }
+
+  bool flag_n() const noexcept { return (cpsr_ & 0x80000000) != 0; }
+  bool flag_z() const noexcept { return (cpsr_ & 0x40000000) != 0; }
+  bool flag_c() const noexcept { return (cpsr_ & 0x20000000) != 0; }
+  bool flag_v() const noexcept { return (cpsr_ & 0x10000000) != 0; }
+
+  void SetNZ(std::uint32_t result) noexcept;
+  void SetC(bool carry) noexcept;
+  void SetV(bool overflow) noexcept;
+
+  std::uint32_t Add(std::uint32_t lhs, std::uint32_t rhs, bool carry_in,
+                    bool set_flags) noexcept;
+  std::uint32_t Sub(std::uint32_t lhs, std::uint32_t rhs, bool carry_in,
+                    bool set_flags) noexcept {
+    return Add(lhs, ~rhs, carry_in, set_flags);
+  }
+
+  std::uint32_t Shift(int type, std::uint32_t value, std::uint32_t amount,
+                      bool immediate, bool& carry) const noexcept;
+
+  bool CheckCondition(std::uint32_t condition) const noexcept;
+
+  std::uint32_t ReadRotated32(std::uint32_t address);
+
+  void WriteReg(int index, std::uint32_t value);
+  void SwitchMode(std::uint32_t new_mode);
+  void ReturnFromException();
+  void CallSwi(std::uint32_t number);
+  [[noreturn]] void ThrowUndefined(std::uint32_t instruction) const;
+
+  void ExecuteArm(std::uint32_t instruction);
+  void ExecuteArmDataProcessing(std::uint32_t instruction);
+  void ExecuteArmMultiply(std::uint32_t instruction);
+  void ExecuteArmMultiplyLong(std::uint32_t instruction);
+  void ExecuteArmSingleTransfer(std::uint32_t instruction);
+  void ExecuteArmHalfwordTransfer(std::uint32_t instruction);
+  void ExecuteArmBlockTransfer(std::uint32_t instruction);
+  void ExecuteArmStatusTransfer(std::uint32_t instruction);
+
+  void ExecuteThumb(std::uint16_t instruction);
+  void ExecuteThumbAlu(std::uint16_t instruction);
+  void ExecuteThumbHighRegister(std::uint16_t instruction);
+  void ExecuteThumbTransfer(std::uint16_t instruction);
+  void ExecuteThumbBlockTransfer(std::uint16_t instruction);
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,227 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace saptapper {
+
+// Buffers of this size or more are rounded up to the whole megabytes, and
+// smaller ones to this granularity.
+static constexpr std::size_t kSmallGranularity = std::size_t{64} << 10;
+static constexpr std::size_t kLargeGranularity = std::size_t{1} << 20;
+
+// An idle buffer is not taken for a request smaller than this fraction of it.
+static constexpr std::size_t kMaxWasteRatio = 4;
+
+PooledBuffer::~PooledBuffer() { Release(); }
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool_{std::exchange(other.pool_, nullptr)},
+      data_{std::exchange(other.data_, nullptr)},
+      size_{std::exchange(other.size_, 0)},
+      capacity_{std::exchange(other.capacity_, 0)} {}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = std::exchange(other.pool_, nullptr);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, 0);
+  }
+  return *this;
+}
+
+void PooledBuffer::resize(std::size_t size) {
+  if (size <= capacity_) {
+    size_ = size;
+    return;
+  }
+
+  BufferPool& pool = pool_ != nullptr ? *pool_ : BufferPool::Default();
+  PooledBuffer grown = pool.Acquire(size);
+  if (size_ != 0) std::memcpy(grown.data_, data_, size_);
+  *this = std::move(grown);
+}
+
+void PooledBuffer::Release() noexcept {
+  if (data_ != nullptr) pool_->Release(data_, capacity_);
+  pool_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+}
+
+BufferPool::~BufferPool() { Trim(); }
+
+BufferPool& BufferPool::Default() {
+  // Never destroyed, since cartridges may outlive the static objects.
+  static BufferPool* const pool = new BufferPool;
+  return *pool;
+}
+
+PooledBuffer BufferPool::Acquire(std::size_t size) {
+  if (size == 0) return PooledBuffer{};
+
+  bool huge_pages;
+  {
+    std::lock_guard lock{mutex_};
+    huge_pages = huge_pages_;
+
+    // Takes the smallest idle buffer which fits.
+    auto best = idle_.end();
+    for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+      if (it->capacity >= size && it->capacity / kMaxWasteRatio <= size &&
+          (best == idle_.end() || it->capacity < best->capacity))
+        best = it;
+    }
+    if (best != idle_.end()) {
+      const Block block = *best;
+      idle_.erase(best);
+      idle_bytes_ -= block.capacity;
+      used_bytes_ += block.capacity;
+      return PooledBuffer{this, block.data, size, block.capacity};
+    }
+  }
+
+  const std::size_t capacity = RoundUp(size, huge_pages);
+  char* data = Allocate(capacity, huge_pages);
+  std::vector<char*> freed;
+  {
+    std::lock_guard lock{mutex_};
+    used_bytes_ += capacity;
+    Evict(0, freed);
+  }
+  for (char* block : freed) Free(block);
+  return PooledBuffer{this, data, size, capacity};
+}
+
+std::size_t BufferPool::limit() const {
+  std::lock_guard lock{mutex_};
+  return limit_;
+}
+
+void BufferPool::set_limit(std::size_t limit) {
+  std::vector<char*> freed;
+  {
+    std::lock_guard lock{mutex_};
+    limit_ = limit;
+    Evict(0, freed);
+  }
+  for (char* block : freed) Free(block);
+}
+
+bool BufferPool::huge_pages() const {
+  std::lock_guard lock{mutex_};
+  return huge_pages_;
+}
+
+void BufferPool::set_huge_pages(bool huge_pages) {
+  std::lock_guard lock{mutex_};
+  huge_pages_ = huge_pages;
+}
+
+std::size_t BufferPool::idle_bytes() const {
+  std::lock_guard lock{mutex_};
+  return idle_bytes_;
+}
+
+std::size_t BufferPool::used_bytes() const {
+  std::lock_guard lock{mutex_};
+  return used_bytes_;
+}
+
+void BufferPool::Trim() {
+  std::vector<Block> idle;
+  {
+    std::lock_guard lock{mutex_};
+    idle.swap(idle_);
+    idle_bytes_ = 0;
+  }
+  for (const Block& block : idle) Free(block.data);
+}
+
+void BufferPool::Release(char* data, std::size_t capacity) noexcept {
+  std::vector<char*> freed;
+  {
+    std::lock_guard lock{mutex_};
+    used_bytes_ -= capacity;
+    if (used_bytes_ + capacity > limit_) {
+      freed.push_back(data);
+    } else {
+      // Makes room by freeing the oldest idle buffers.
+      Evict(capacity, freed);
+      try {
+        idle_.push_back(Block{data, capacity});
+        idle_bytes_ += capacity;
+      } catch (...) {
+        freed.push_back(data);
+      }
+    }
+  }
+  for (char* block : freed) Free(block);
+}
+
+void BufferPool::Evict(std::size_t reserved,
+                       std::vector<char*>& freed) noexcept {
+  std::size_t evicted = 0;
+  std::size_t evicted_bytes = 0;
+  while (evicted < idle_.size() &&
+         used_bytes_ + idle_bytes_ - evicted_bytes + reserved > limit_) {
+    freed.push_back(idle_[evicted].data);
+    evicted_bytes += idle_[evicted].capacity;
+    evicted++;
+  }
+  idle_.erase(idle_.begin(), idle_.begin() + evicted);
+  idle_bytes_ -= evicted_bytes;
+}
+
+std::size_t BufferPool::RoundUp(std::size_t size, bool huge_pages) noexcept {
+  std::size_t granularity = kSmallGranularity;
+  if (huge_pages && size >= kHugePageSize) {
+    granularity = kHugePageSize;
+  } else if (size >= kLargeGranularity) {
+    granularity = kLargeGranularity;
+  }
+  return (size + granularity - 1) / granularity * granularity;
+}
+
+char* BufferPool::Allocate(std::size_t capacity, bool huge_pages) {
+  const bool huge = huge_pages && capacity >= kHugePageSize;
+  const std::size_t alignment = huge ? kHugePageSize : kAlignment;
+#ifdef _WIN32
+  void* data = _aligned_malloc(capacity, alignment);
+#else
+  void* data = std::aligned_alloc(alignment, capacity);
+#endif
+  if (data == nullptr) throw std::bad_alloc();
+
+#ifdef __linux__
+  // Only a hint; the kernel may ignore it.
+  if (huge) madvise(data, capacity, MADV_HUGEPAGE);
+#endif
+  return static_cast<char*>(data);
+}
+
+void BufferPool::Free(char* data) noexcept {
+#ifdef _WIN32
+  _aligned_free(data);
+#else
+  std::free(data);
+#endif
+}
+
+}  // namespace saptapper
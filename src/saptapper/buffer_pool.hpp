@@ -0,0 +1,144 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_BUFFER_POOL_HPP_
+#define SAPTAPPER_BUFFER_POOL_HPP_
+
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace saptapper {
+
+class BufferPool;
+
+/// Byte buffer which goes back to its BufferPool when destroyed.
+///
+/// Unlike std::string, the bytes are never filled on allocation or growth, so
+/// a recycled buffer costs neither page faults nor zeroing.
+class PooledBuffer {
+ public:
+  PooledBuffer() = default;
+  ~PooledBuffer();
+
+  PooledBuffer(PooledBuffer&& other) noexcept;
+  PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+  char* data() noexcept { return data_; }
+  const char* data() const noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+  std::size_t capacity() const noexcept { return capacity_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  char& operator[](std::size_t pos) noexcept { return data_[pos]; }
+  const char& operator[](std::size_t pos) const noexcept { return data_[pos]; }
+
+  operator std::string_view() const noexcept { return {data_, size_}; }
+
+  /// Changes the size, keeping the contents. The added bytes are not
+  /// initialized. A buffer without a pool grows from BufferPool::Default.
+  void resize(std::size_t size);
+
+ private:
+  friend class BufferPool;
+
+  BufferPool* pool_ = nullptr;
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+
+  PooledBuffer(BufferPool* pool, char* data, std::size_t size,
+               std::size_t capacity) noexcept
+      : pool_{pool}, data_{data}, size_{size}, capacity_{capacity} {}
+
+  void Release() noexcept;
+};
+
+/// Recycles large buffers (ROM images and compressed outputs) across the
+/// files of a batch.
+///
+/// The capacities are rounded up, so that buffers of similar sizes can be
+/// reused for one another. Idle buffers are kept as long as the pooled and
+/// the used buffers fit in the limit; beyond it, the oldest idle buffers are
+/// freed on each acquisition and release. Buffers in use are never refused,
+/// so they alone may exceed the limit.
+class BufferPool {
+ public:
+  static constexpr std::size_t kDefaultLimit = std::size_t{256} << 20;
+
+  /// The alignment of the buffers (a cache line).
+  static constexpr std::size_t kAlignment = 64;
+
+  /// The size of transparent huge pages on x86-64 and AArch64 Linux.
+  static constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+  explicit BufferPool(std::size_t limit = kDefaultLimit,
+                      bool huge_pages = false) noexcept
+      : limit_{limit}, huge_pages_{huge_pages} {}
+
+  /// Frees the idle buffers. The buffers in use must be released before.
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  /// Returns the pool shared by the whole process.
+  static BufferPool& Default();
+
+  /// Takes a buffer of the size. The contents are unspecified.
+  PooledBuffer Acquire(std::size_t size);
+
+  std::size_t limit() const;
+
+  /// Sets the maximum of the pooled and the used bytes, beyond which idle
+  /// buffers are freed.
+  void set_limit(std::size_t limit);
+
+  bool huge_pages() const;
+
+  /// Backs the new buffers of 2 MiB or more by transparent huge pages, where
+  /// the platform supports them.
+  void set_huge_pages(bool huge_pages);
+
+  /// Returns the bytes of the idle buffers.
+  std::size_t idle_bytes() const;
+
+  /// Returns the bytes of the buffers in use.
+  std::size_t used_bytes() const;
+
+  /// Frees all idle buffers.
+  void Trim();
+
+ private:
+  friend class PooledBuffer;
+
+  struct Block {
+    char* data;
+    std::size_t capacity;
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<Block> idle_;
+  std::size_t idle_bytes_ = 0;
+  std::size_t used_bytes_ = 0;
+  std::size_t limit_;
+  bool huge_pages_;
+
+  void Release(char* data, std::size_t capacity) noexcept;
+
+  // Frees the oldest idle buffers until they fit in the limit with the used
+  // and the reserved bytes. The caller holds the lock, and frees the returned
+  // blocks after releasing it.
+  void Evict(std::size_t reserved, std::vector<char*>& freed) noexcept;
+
+  static std::size_t RoundUp(std::size_t size, bool huge_pages) noexcept;
+  static char* Allocate(std::size_t capacity, bool huge_pages);
+  static void Free(char* data) noexcept;
+};
+
+}  // namespace saptapper
+
+#endif
@@ -6,9 +6,13 @@
 #ifndef SAPTAPPER_BYTE_PATTERN_
 #define SAPTAPPER_BYTE_PATTERN_
 
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include "bytes.hpp"
 
 namespace saptapper {
 
@@ -46,6 +50,69 @@ private:
   std::string mask_;
 };
 
+/// Byte pattern whose mask is folded at compile time.
+///
+/// The pattern is compiled into 64-bit compare-and-mask words, so that Match
+/// takes a few word comparisons per position instead of a loop over the mask.
+///
+/// Example:
+///   static constexpr StaticBytePattern pattern{"\x00\xb5\x18\x48", "xx?x"};
+template <std::size_t N>
+class StaticBytePattern
+{
+public:
+  using size_type = std::string::size_type;
+
+  constexpr StaticBytePattern(const char (&data)[N + 1],
+                              const char (&mask)[N + 1]) {
+    for (size_type offset = 0; offset < N; offset++) {
+      if (mask[offset] != 'x' && mask[offset] != '?') {
+        throw std::invalid_argument(
+            "StaticBytePattern: mask must consist of 'x' and '?'");
+      }
+      if (mask[offset] == '?') continue;
+
+      const auto shift = 8 * (offset % 8);
+      values_[offset / 8] |=
+          static_cast<std::uint64_t>(static_cast<std::uint8_t>(data[offset]))
+          << shift;
+      masks_[offset / 8] |= static_cast<std::uint64_t>(0xff) << shift;
+    }
+  }
+
+  constexpr size_type size() const noexcept { return N; }
+
+  bool Match(std::string_view data, size_type pos = 0) const {
+    if (pos > data.size() || data.size() - pos < N) return false;
+
+    const char* p = data.data() + pos;
+    for (size_type i = 0; i < kFullWords; i++) {
+      if ((ReadInt64L(p + 8 * i) & masks_[i]) != values_[i]) return false;
+    }
+    if constexpr (kTailSize != 0) {
+      char tail[8]{};
+      std::memcpy(tail, p + 8 * kFullWords, kTailSize);
+      if ((ReadInt64L(tail) & masks_[kFullWords]) != values_[kFullWords])
+        return false;
+    }
+    return true;
+  }
+
+private:
+  static constexpr size_type kFullWords = N / 8;
+  static constexpr size_type kTailSize = N % 8;
+
+  /// The checked bytes of the pattern in little-endian 64-bit words.
+  std::array<std::uint64_t, (N + 7) / 8> values_{};
+
+  /// The masks of the checked bytes, 0xff for 'x' and 0x00 for '?'.
+  std::array<std::uint64_t, (N + 7) / 8> masks_{};
+};
+
+template <std::size_t M>
+StaticBytePattern(const char (&)[M], const char (&)[M])
+    -> StaticBytePattern<M - 1>;
+
 } // namespace saptapper
 
 #endif
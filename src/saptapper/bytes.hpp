@@ -4,10 +4,45 @@
 #ifndef SAPTAPPER_BYTE_IO_HPP_
 #define SAPTAPPER_BYTE_IO_HPP_
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SAPTAPPER_BIG_ENDIAN
+#endif
 
 namespace saptapper {
 
+/// Reverses the byte order of a 16-bit integer.
+constexpr std::uint16_t ByteSwap16(std::uint16_t value) {
+  return static_cast<std::uint16_t>((value >> 8) | (value << 8));
+}
+
+/// Reverses the byte order of a 32-bit integer.
+constexpr std::uint32_t ByteSwap32(std::uint32_t value) {
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) |
+         (value << 24);
+}
+
+/// Reverses the byte order of a 64-bit integer.
+constexpr std::uint64_t ByteSwap64(std::uint64_t value) {
+  const auto low = static_cast<std::uint32_t>(value);
+  const auto high = static_cast<std::uint32_t>(value >> 32);
+  return (static_cast<std::uint64_t>(ByteSwap32(low)) << 32) |
+         ByteSwap32(high);
+}
+
+/// Tells whether the pointer type addresses a contiguous byte buffer.
+/// Such buffers are read and written with memcpy instead of byte-by-byte.
+template <typename T>
+inline constexpr bool is_byte_buffer_v =
+    sizeof(T) == 1 && std::is_trivially_copyable_v<T>;
+
 /// Writes an 8-bit integer.
 /// @param out the output iterator.
 /// @param value the number to be written.
@@ -108,6 +143,97 @@ constexpr std::uint32_t ReadInt32L(InputIterator in) {
   return v1 | (v2 << 8) | (v3 << 16) | (v4 << 24);
 }
 
+/// Writes a 16-bit integer in little-endian order to a contiguous buffer.
+/// @param out the pointer to the buffer, which does not need to be aligned.
+/// @param value the number to be written.
+/// @return the pointer to the next element of the written data.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline T* WriteInt16L(T* out, std::uint16_t value) {
+#ifdef SAPTAPPER_BIG_ENDIAN
+  value = ByteSwap16(value);
+#endif
+  std::memcpy(out, &value, sizeof(value));
+  return out + sizeof(value);
+}
+
+/// Writes a 32-bit integer in little-endian order to a contiguous buffer.
+/// @param out the pointer to the buffer, which does not need to be aligned.
+/// @param value the number to be written.
+/// @return the pointer to the next element of the written data.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline T* WriteInt32L(T* out, std::uint32_t value) {
+#ifdef SAPTAPPER_BIG_ENDIAN
+  value = ByteSwap32(value);
+#endif
+  std::memcpy(out, &value, sizeof(value));
+  return out + sizeof(value);
+}
+
+/// Reads a 16-bit integer in little-endian order from a contiguous buffer.
+/// @param in the pointer to the buffer, which does not need to be aligned.
+/// @return the number to be read.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline std::uint16_t ReadInt16L(T* in) {
+  std::uint16_t value;
+  std::memcpy(&value, in, sizeof(value));
+#ifdef SAPTAPPER_BIG_ENDIAN
+  value = ByteSwap16(value);
+#endif
+  return value;
+}
+
+/// Reads a 32-bit integer in little-endian order from a contiguous buffer.
+/// @param in the pointer to the buffer, which does not need to be aligned.
+/// @return the number to be read.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline std::uint32_t ReadInt32L(T* in) {
+  std::uint32_t value;
+  std::memcpy(&value, in, sizeof(value));
+#ifdef SAPTAPPER_BIG_ENDIAN
+  value = ByteSwap32(value);
+#endif
+  return value;
+}
+
+/// Reads a 64-bit integer in little-endian order from a contiguous buffer.
+/// @param in the pointer to the buffer, which does not need to be aligned.
+/// @return the number to be read.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline std::uint64_t ReadInt64L(T* in) {
+  std::uint64_t value;
+  std::memcpy(&value, in, sizeof(value));
+#ifdef SAPTAPPER_BIG_ENDIAN
+  value = ByteSwap64(value);
+#endif
+  return value;
+}
+
+/// Reads consecutive 32-bit integers in little-endian order.
+/// @param in the pointer to the buffer, which does not need to be aligned.
+/// @param out the array to store the numbers.
+/// @param count the number of integers to be read.
+/// @return the pointer to the next element of the read data.
+template <typename T, std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline T* ReadInt32LArray(T* in, std::uint32_t* out, std::size_t count) {
+  std::memcpy(out, in, count * sizeof(std::uint32_t));
+#ifdef SAPTAPPER_BIG_ENDIAN
+  for (std::size_t i = 0; i < count; i++) out[i] = ByteSwap32(out[i]);
+#endif
+  return in + count * sizeof(std::uint32_t);
+}
+
+/// Reads a fixed number of consecutive 32-bit integers in little-endian order.
+/// @param in the pointer to the buffer, which does not need to be aligned.
+/// @return the array of numbers.
+/// @tparam N the number of integers to be read.
+template <std::size_t N, typename T,
+          std::enable_if_t<is_byte_buffer_v<T>, int> = 0>
+inline std::array<std::uint32_t, N> ReadInt32LArray(T* in) {
+  std::array<std::uint32_t, N> values;
+  ReadInt32LArray(in, values.data(), N);
+  return values;
+}
+
 }  // namespace saptapper
 
 #endif
@@ -2,15 +2,21 @@
 
 #include "cartridge.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
+#include "buffer_pool.hpp"
+#include "rom_hashes.hpp"
 
 namespace saptapper {
 
-Cartridge Cartridge::LoadFromFile(const std::filesystem::path& path) {
+Cartridge Cartridge::LoadFromFile(const std::filesystem::path& path,
+                                  unsigned int hash_types) {
   Cartridge cartridge;
 
   const auto size = file_size(path);
@@ -19,15 +25,47 @@ Cartridge Cartridge::LoadFromFile(const std::filesystem::path& path) {
   std::ifstream stream(path, std::ios::in | std::ios::binary);
   stream.exceptions(std::ios::badbit | std::ios::eofbit | std::ios::failbit);
 
-  const auto aligned_size = (size + 3) & ~3;
-  std::string rom(aligned_size, 0);
-  stream.read(rom.data(), size);
+  PooledBuffer rom = BufferPool::Default().Acquire(size);
+  if (hash_types == RomHashes::kNone) {
+    stream.read(rom.data(), size);
+  } else {
+    // Hashes each chunk right after it is read, instead of reading the ROM
+    // again from memory.
+    RomHasher hasher{hash_types};
+    for (std::size_t pos = 0; pos < size; pos += RomHasher::kChunkSize) {
+      const std::size_t chunk_size =
+          std::min<std::size_t>(RomHasher::kChunkSize, size - pos);
+      stream.read(rom.data() + pos, chunk_size);
+      hasher.Update(std::string_view{rom.data() + pos, chunk_size});
+    }
+    cartridge.hashes_ = hasher.Finish();
+  }
   stream.close();
+  PadRom(rom);
+
+  cartridge.rom_ = std::move(rom);
+  return cartridge;
+}
+
+Cartridge Cartridge::LoadFromBuffer(PooledBuffer rom,
+                                    unsigned int hash_types) {
+  Cartridge cartridge;
+
+  ValidateSize(rom.size());
+  cartridge.hashes_ = RomHasher::Compute(rom, hash_types);
+  PadRom(rom);
 
   cartridge.rom_ = std::move(rom);
   return cartridge;
 }
 
+void Cartridge::PadRom(PooledBuffer& rom) {
+  const std::size_t size = rom.size();
+  const std::size_t aligned_size = (size + 3) & ~std::size_t{3};
+  rom.resize(aligned_size);
+  std::fill(rom.data() + size, rom.data() + aligned_size, 0);
+}
+
 void Cartridge::ValidateSize(std::uintmax_t size) {
   if (size < kHeaderSize) {
     throw std::range_error("The input data too small.");
@@ -6,6 +6,9 @@
 #include <cstdint>
 #include <filesystem>
 #include <string>
+#include <string_view>
+#include "buffer_pool.hpp"
+#include "rom_hashes.hpp"
 #include "types.hpp"
 
 namespace saptapper {
@@ -19,16 +22,32 @@ class Cartridge {
 
   Cartridge() = default;
 
-  std::string& rom() { return rom_; }
-  const std::string& rom() const { return rom_; }
+  std::string_view rom() const { return rom_; }
   size_type size() const { return static_cast<agbsize_t>(rom_.size()); }
-  std::string game_title() const { return rom_.substr(0xa0, 12); }
-  std::string game_code() const { return rom_.substr(0xac, 4); }
+  std::string game_title() const {
+    return std::string{rom().substr(0xa0, 12)};
+  }
+  std::string game_code() const { return std::string{rom().substr(0xac, 4)}; }
 
-  static Cartridge LoadFromFile(const std::filesystem::path& path);
+  /// The hashes requested on load.
+  const RomHashes& hashes() const noexcept { return hashes_; }
+
+  /// Loads the ROM into a buffer of BufferPool::Default. The hashes of the
+  /// given types (RomHashes::Type flags) are computed while the file is read,
+  /// chunk by chunk.
+  static Cartridge LoadFromFile(const std::filesystem::path& path,
+                                unsigned int hash_types = RomHashes::kNone);
+
+  static Cartridge LoadFromBuffer(PooledBuffer rom,
+                                  unsigned int hash_types = RomHashes::kNone);
 
  private:
-  std::string rom_;
+  // Goes back to the pool with the cartridge, for the next ROM of a batch.
+  PooledBuffer rom_;
+  RomHashes hashes_;
+
+  // Rounds the size up to a multiple of 4, with zeros.
+  static void PadRom(PooledBuffer& rom);
 
   static void ValidateSize(std::uintmax_t size);
 };
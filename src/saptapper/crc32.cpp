@@ -0,0 +1,152 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "crc32.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <zlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAPTAPPER_USE_PCLMUL
+#define SAPTAPPER_TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SAPTAPPER_USE_PCLMUL
+#define SAPTAPPER_TARGET_PCLMUL
+#include <emmintrin.h>
+#include <intrin.h>
+#include <wmmintrin.h>
+#endif
+
+namespace saptapper {
+
+static std::uint32_t UpdateTable(std::uint32_t crc, const unsigned char* data,
+                                 std::size_t size) noexcept {
+  while (size != 0) {
+    // The length of zlib's crc32 is 32-bit even on 64-bit platforms.
+    const auto chunk_size =
+        static_cast<uInt>(std::min<std::size_t>(size, 0x40000000));
+    crc = static_cast<std::uint32_t>(crc32(crc, data, chunk_size));
+    data += chunk_size;
+    size -= chunk_size;
+  }
+  return crc;
+}
+
+#ifdef SAPTAPPER_USE_PCLMUL
+
+static constexpr std::size_t kMinFoldSize = 64;
+
+static bool HasPclmul() noexcept {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  const auto ecx = static_cast<unsigned int>(info[2]);
+  const auto edx = static_cast<unsigned int>(info[3]);
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+  const bool sse2 = (edx & (1u << 26)) != 0;
+  const bool pclmul = (ecx & (1u << 1)) != 0;
+  return sse2 && pclmul;
+}
+
+SAPTAPPER_TARGET_PCLMUL
+static inline __m128i Fold(__m128i x, __m128i k, __m128i next) noexcept {
+  const __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+  const __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(high, low), next);
+}
+
+SAPTAPPER_TARGET_PCLMUL
+static inline __m128i Load(const unsigned char* data) noexcept {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+// Folds 16-byte blocks into the bit-reflected CRC with the constants from
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+// (Intel, 2009), and finishes it with the Barrett reduction. The size must be
+// a multiple of 16, at least 64. The CRC is passed and returned without the
+// final inversion.
+SAPTAPPER_TARGET_PCLMUL
+static std::uint32_t FoldPclmul(std::uint32_t crc, const unsigned char* data,
+                                std::size_t size) noexcept {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1 = _mm_xor_si128(Load(data), _mm_cvtsi32_si128(crc));
+  __m128i x2 = Load(data + 0x10);
+  __m128i x3 = Load(data + 0x20);
+  __m128i x4 = Load(data + 0x30);
+  data += 64;
+  size -= 64;
+
+  // Four independent lanes hide the latency of the multiplication.
+  while (size >= 64) {
+    x1 = Fold(x1, k1k2, Load(data));
+    x2 = Fold(x2, k1k2, Load(data + 0x10));
+    x3 = Fold(x3, k1k2, Load(data + 0x20));
+    x4 = Fold(x4, k1k2, Load(data + 0x30));
+    data += 64;
+    size -= 64;
+  }
+
+  x1 = Fold(x1, k3k4, x2);
+  x1 = Fold(x1, k3k4, x3);
+  x1 = Fold(x1, k3k4, x4);
+  while (size >= 16) {
+    x1 = Fold(x1, k3k4, Load(data));
+    data += 16;
+    size -= 16;
+  }
+
+  // 128 bits to 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+static const bool kHasPclmul = HasPclmul();
+
+#endif
+
+void Crc32::Update(const void* data, std::size_t size) noexcept {
+  auto bytes = static_cast<const unsigned char*>(data);
+#ifdef SAPTAPPER_USE_PCLMUL
+  if (kHasPclmul && size >= kMinFoldSize) {
+    const std::size_t fold_size = size & ~std::size_t{15};
+    crc_ = ~FoldPclmul(~crc_, bytes, fold_size);
+    bytes += fold_size;
+    size -= fold_size;
+  }
+#endif
+  crc_ = UpdateTable(crc_, bytes, size);
+}
+
+bool Crc32::accelerated() noexcept {
+#ifdef SAPTAPPER_USE_PCLMUL
+  return kHasPclmul;
+#else
+  return false;
+#endif
+}
+
+}  // namespace saptapper
@@ -0,0 +1,43 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_CRC32_HPP_
+#define SAPTAPPER_CRC32_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace saptapper {
+
+/// CRC-32 of zlib and PSF.
+///
+/// Long inputs are folded with the carry-less multiplication (PCLMULQDQ) when
+/// the CPU has it, and the rest goes to zlib.
+class Crc32 {
+ public:
+  void Reset() noexcept { crc_ = 0; }
+
+  void Update(const void* data, std::size_t size) noexcept;
+
+  void Update(std::string_view data) noexcept {
+    Update(data.data(), data.size());
+  }
+
+  std::uint32_t value() const noexcept { return crc_; }
+
+  static std::uint32_t Compute(std::string_view data) noexcept {
+    Crc32 crc;
+    crc.Update(data);
+    return crc.value();
+  }
+
+  /// Returns true if the carry-less multiplication is used.
+  static bool accelerated() noexcept;
+
+ private:
+  std::uint32_t crc_ = 0;
+};
+
+}  // namespace saptapper
+
+#endif
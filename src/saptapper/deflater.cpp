@@ -0,0 +1,247 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "deflater.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#include "buffer_pool.hpp"
+#include "optimal_deflater.hpp"
+
+namespace saptapper {
+
+static thread_local std::vector<std::unique_ptr<Deflater>> deflater_pool;
+
+CompressionProfile ParseCompressionProfile(std::string_view name) {
+  if (name == "fast") return CompressionProfile::kFast;
+  if (name == "balanced") return CompressionProfile::kBalanced;
+  if (name == "max") return CompressionProfile::kMax;
+  if (name == "optimal") return CompressionProfile::kOptimal;
+  throw std::invalid_argument("Unknown compression profile \"" +
+                              std::string(name) + "\".");
+}
+
+std::string to_string(CompressionProfile profile) {
+  switch (profile) {
+    case CompressionProfile::kFast:
+      return "fast";
+    case CompressionProfile::kBalanced:
+      return "balanced";
+    case CompressionProfile::kMax:
+      return "max";
+    case CompressionProfile::kOptimal:
+      return "optimal";
+  }
+  return "unknown";
+}
+
+Deflater::Deflater(int level, int window_bits, int mem_level, int strategy)
+    : level_{level},
+      window_bits_{window_bits},
+      mem_level_{mem_level},
+      strategy_{strategy} {
+  const int ret = deflateInit2(&stream_, level, Z_DEFLATED, window_bits,
+                               mem_level, strategy);
+  if (ret != Z_OK) throw std::runtime_error("deflateInit2 failed.");
+}
+
+Deflater::~Deflater() { deflateEnd(&stream_); }
+
+void Deflater::Begin(PooledBuffer& out) {
+  if (dirty_) {
+    if (deflateReset(&stream_) != Z_OK)
+      throw std::runtime_error("deflateReset failed.");
+  }
+  out_ = &out;
+  out_size_ = out.size();
+  output_crc_.Reset();
+  dirty_ = true;
+}
+
+void Deflater::Write(const char* data, std::size_t size) {
+  assert(out_ != nullptr);
+  while (size != 0) {
+    // avail_in is 32-bit even on 64-bit platforms.
+    const auto chunk_size = static_cast<uInt>(
+        std::min<std::size_t>(size, 0x40000000));
+    stream_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_.avail_in = chunk_size;
+    Deflate(Z_NO_FLUSH);
+    data += chunk_size;
+    size -= chunk_size;
+  }
+}
+
+void Deflater::Finish() {
+  assert(out_ != nullptr);
+  stream_.next_in = Z_NULL;
+  stream_.avail_in = 0;
+  Deflate(Z_FINISH);
+  out_->resize(out_size_);
+  out_ = nullptr;
+}
+
+void Deflater::Deflate(int flush) {
+  while (true) {
+    if (out_->size() - out_size_ < kMinOutputSpace)
+      out_->resize(out_size_ + std::max(kMinOutputSpace, out_size_ / 2));
+
+    stream_.next_out = reinterpret_cast<Bytef*>(&(*out_)[out_size_]);
+    stream_.avail_out = static_cast<uInt>(
+        std::min<std::size_t>(out_->size() - out_size_, 0x40000000));
+    const uInt avail_out = stream_.avail_out;
+    const int ret = deflate(&stream_, flush);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+      throw std::runtime_error("deflate failed.");
+
+    // The output is still in the cache, so the CRC costs no extra pass.
+    const std::size_t produced = avail_out - stream_.avail_out;
+    output_crc_.Update(&(*out_)[out_size_], produced);
+    out_size_ += produced;
+
+    if (ret == Z_STREAM_END) break;
+    if (flush != Z_FINISH && stream_.avail_in == 0 && stream_.avail_out != 0)
+      break;
+  }
+}
+
+Deflater::Handle Deflater::Acquire(int level, int window_bits, int mem_level,
+                                   int strategy) {
+  for (auto it = deflater_pool.begin(); it != deflater_pool.end(); ++it) {
+    const Deflater& pooled = **it;
+    if (pooled.level() == level && pooled.window_bits() == window_bits &&
+        pooled.mem_level() == mem_level && pooled.strategy() == strategy) {
+      Handle deflater{it->release()};
+      deflater_pool.erase(it);
+      return deflater;
+    }
+  }
+  return Handle{new Deflater(level, window_bits, mem_level, strategy)};
+}
+
+std::vector<Deflater::Handle> Deflater::Acquire(CompressionProfile profile,
+                                                int window_bits) {
+  std::vector<Handle> deflaters;
+  switch (profile) {
+    case CompressionProfile::kFast:
+      deflaters.push_back(Acquire(Z_BEST_SPEED, window_bits));
+      break;
+
+    case CompressionProfile::kBalanced:
+      deflaters.push_back(Acquire(Z_BEST_COMPRESSION, window_bits));
+      break;
+
+    case CompressionProfile::kMax:
+      // The balanced settings are included, so that the output is never
+      // larger than that of the balanced profile.
+      deflaters.push_back(Acquire(Z_BEST_COMPRESSION, window_bits));
+      deflaters.push_back(Acquire(Z_BEST_COMPRESSION, window_bits, 9));
+      deflaters.push_back(
+          Acquire(Z_BEST_COMPRESSION, window_bits, 9, Z_FILTERED));
+      deflaters.push_back(Acquire(Z_BEST_COMPRESSION, window_bits, 9, Z_RLE));
+      break;
+
+    case CompressionProfile::kOptimal:
+      // The optimal deflater splits the input into blocks, which can cost
+      // more than zlib on long runs; the smaller of both is kept.
+      deflaters.push_back(Acquire(Z_BEST_COMPRESSION, window_bits));
+      break;
+  }
+  return deflaters;
+}
+
+void Deflater::Releaser::operator()(Deflater* deflater) const noexcept {
+  std::unique_ptr<Deflater> owner{deflater};
+  try {
+    if (deflater_pool.size() >= kMaxPooledDeflaters)
+      deflater_pool.erase(deflater_pool.begin());
+    deflater_pool.push_back(std::move(owner));
+  } catch (...) {
+    // The deflater is simply destroyed if the pool cannot take it.
+  }
+}
+
+DeflateStreamBuf::DeflateStreamBuf(CompressionProfile profile,
+                                   int window_bits, unsigned int thread_count)
+    : profile_{profile},
+      thread_count_{thread_count},
+      deflaters_{Deflater::Acquire(profile, window_bits)},
+      outputs_(deflaters_.size() +
+               (profile == CompressionProfile::kOptimal ? 1 : 0)) {
+  for (std::size_t i = 0; i < deflaters_.size(); i++)
+    deflaters_[i]->Begin(outputs_[i]);
+  setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+void DeflateStreamBuf::Finish() {
+  if (finished_) return;
+  FlushBuffer();
+  for (std::size_t i = 0; i < deflaters_.size(); i++) {
+    deflaters_[i]->Finish();
+    if (outputs_[i].size() < outputs_[best_].size()) best_ = i;
+  }
+  output_crc_ = deflaters_[best_]->output_crc32();
+  if (profile_ == CompressionProfile::kOptimal) {
+    // The optimal deflater writes the blocks out of order, so the CRC is
+    // computed afterwards.
+    const std::string output = OptimalDeflater::Compress(input_, thread_count_);
+    input_ = std::string{};
+    if (output.size() < outputs_[best_].size()) {
+      best_ = outputs_.size() - 1;
+      outputs_[best_].resize(output.size());
+      std::copy(output.begin(), output.end(), outputs_[best_].data());
+      output_crc_ = Crc32::Compute(output);
+    }
+  }
+
+  // The other outputs go back to the pool at once.
+  for (std::size_t i = 0; i < outputs_.size(); i++) {
+    if (i != best_) outputs_[i] = PooledBuffer{};
+  }
+  finished_ = true;
+  setp(nullptr, nullptr);
+}
+
+DeflateStreamBuf::int_type DeflateStreamBuf::overflow(int_type c) {
+  if (finished_) return traits_type::eof();
+  FlushBuffer();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize DeflateStreamBuf::xsputn(const char* s, std::streamsize n) {
+  if (finished_) return 0;
+  if (n <= epptr() - pptr()) return std::streambuf::xsputn(s, n);
+
+  // Large writes (such as a whole ROM) go to the deflaters without copying.
+  FlushBuffer();
+  Write(s, static_cast<std::size_t>(n));
+  return n;
+}
+
+int DeflateStreamBuf::sync() {
+  if (!finished_) FlushBuffer();
+  return 0;
+}
+
+void DeflateStreamBuf::Write(const char* data, std::size_t size) {
+  if (profile_ == CompressionProfile::kOptimal) input_.append(data, size);
+  for (auto& deflater : deflaters_) deflater->Write(data, size);
+}
+
+void DeflateStreamBuf::FlushBuffer() {
+  const std::size_t size = pptr() - pbase();
+  if (size != 0) Write(pbase(), size);
+  setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+}  // namespace saptapper
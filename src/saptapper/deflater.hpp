@@ -0,0 +1,145 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_DEFLATER_HPP_
+#define SAPTAPPER_DEFLATER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#include "buffer_pool.hpp"
+#include "crc32.hpp"
+
+namespace saptapper {
+
+/// Trade-off between the compression speed and the output size.
+enum class CompressionProfile {
+  /// The fastest zlib level, for previews.
+  kFast,
+  /// The best zlib level with the default settings.
+  kBalanced,
+  /// Tries several zlib strategies and keeps the smallest output.
+  kMax,
+  /// Searches for the smallest deflate stream with OptimalDeflater, and keeps
+  /// the balanced output if that is smaller. Very slow, for archival.
+  kOptimal,
+};
+
+/// Parses the name of a profile ("fast", "balanced", "max" or "optimal").
+CompressionProfile ParseCompressionProfile(std::string_view name);
+
+std::string to_string(CompressionProfile profile);
+
+/// zlib deflate state which can be reused for many streams.
+///
+/// Setting up a deflate state allocates several hundred kilobytes, so the
+/// states are kept in a per-thread pool and reset between streams.
+class Deflater {
+ public:
+  struct Releaser {
+    void operator()(Deflater* deflater) const noexcept;
+  };
+
+  using Handle = std::unique_ptr<Deflater, Releaser>;
+
+  Deflater(int level, int window_bits, int mem_level = 8,
+           int strategy = Z_DEFAULT_STRATEGY);
+  ~Deflater();
+
+  Deflater(const Deflater&) = delete;
+  Deflater& operator=(const Deflater&) = delete;
+
+  int level() const noexcept { return level_; }
+  int window_bits() const noexcept { return window_bits_; }
+  int mem_level() const noexcept { return mem_level_; }
+  int strategy() const noexcept { return strategy_; }
+
+  /// Returns the CRC-32 of the output of the current stream, which is
+  /// computed as the compressed data is emitted.
+  std::uint32_t output_crc32() const noexcept { return output_crc_.value(); }
+
+  /// Starts a new zlib stream whose output is appended to the buffer.
+  void Begin(PooledBuffer& out);
+
+  /// Compresses the data into the current stream.
+  void Write(const char* data, std::size_t size);
+
+  /// Finishes the current stream.
+  void Finish();
+
+  /// Takes a deflater from the pool of the current thread.
+  static Handle Acquire(int level, int window_bits, int mem_level = 8,
+                        int strategy = Z_DEFAULT_STRATEGY);
+
+  /// Takes the deflaters to be tried for the profile. The optimal profile
+  /// does not use zlib and takes none.
+  static std::vector<Handle> Acquire(CompressionProfile profile,
+                                     int window_bits);
+
+ private:
+  static constexpr std::size_t kMinOutputSpace = 0x10000;
+  static constexpr std::size_t kMaxPooledDeflaters = 8;
+
+  z_stream stream_{};
+  int level_;
+  int window_bits_;
+  int mem_level_;
+  int strategy_;
+  PooledBuffer* out_ = nullptr;
+  std::size_t out_size_ = 0;
+  Crc32 output_crc_;
+  bool dirty_ = false;
+
+  void Deflate(int flush);
+};
+
+/// Stream buffer that compresses everything written to it.
+///
+/// When the profile has more than one deflater, the data is compressed by all
+/// of them in a single pass and the smallest output is kept. The optimal
+/// profile keeps the data and compresses it at once in Finish, on thread_count
+/// threads (0 for the number of hardware threads).
+class DeflateStreamBuf : public std::streambuf {
+ public:
+  DeflateStreamBuf(CompressionProfile profile, int window_bits,
+                   unsigned int thread_count = 0);
+
+  /// Flushes the buffered data and finishes the zlib streams.
+  void Finish();
+
+  bool finished() const noexcept { return finished_; }
+
+  /// Returns the compressed data. Available after Finish.
+  std::string_view output() const noexcept { return outputs_[best_]; }
+
+  /// Returns the CRC-32 of the compressed data. Available after Finish.
+  std::uint32_t output_crc32() const noexcept { return output_crc_; }
+
+ protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+  int sync() override;
+
+ private:
+  CompressionProfile profile_;
+  unsigned int thread_count_;
+  std::vector<Deflater::Handle> deflaters_;
+  std::vector<PooledBuffer> outputs_;
+  std::string input_;
+  std::size_t best_ = 0;
+  std::uint32_t output_crc_ = 0;
+  std::array<char, 0x10000> buffer_;
+  bool finished_ = false;
+
+  void Write(const char* data, std::size_t size);
+  void FlushBuffer();
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,438 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "driver_smoke_test.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arm7tdmi.hpp"
+#include "bytes.hpp"
+#include "minigsf_driver_param.hpp"
+#include "mp2k_driver_param.hpp"
+#include "rom_overlay.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+namespace {
+
+// The IRQ vector and handler of the BIOS, which call the handler at
+// 0x3007ffc (read through the mirror at 0x3fffffc).
+constexpr std::uint32_t kBiosIrqVector = 0xea000042;  // b 0x128
+constexpr std::array<std::uint32_t, 6> kBiosIrqHandler{
+    0xe92d500f,  // stmfd sp!, {r0-r3, r12, lr}
+    0xe3a00301,  // mov r0, #0x4000000
+    0xe28fe000,  // add lr, pc, #0
+    0xe510f004,  // ldr pc, [r0, #-4]
+    0xe8bd500f,  // ldmfd sp!, {r0-r3, r12, lr}
+    0xe25ef004,  // subs pc, lr, #4
+};
+
+constexpr std::uint32_t kRegDispStat = 0x004;
+constexpr std::uint32_t kRegVCount = 0x006;
+constexpr std::uint32_t kRegDma0 = 0x0b0;
+constexpr std::uint32_t kRegIe = 0x200;
+constexpr std::uint32_t kRegIf = 0x202;
+constexpr std::uint32_t kRegIme = 0x208;
+
+// The memory map of the Game Boy Advance, with the cartridge ROM read
+// through a page table so that the patched pages are the only copies.
+class GbaBus : public Arm7tdmi::Bus {
+ public:
+  GbaBus(std::string_view rom, const RomOverlay& gsf_driver,
+         const MinigsfDriverParam& minigsf, int song)
+      : rom_{reinterpret_cast<const std::uint8_t*>(rom.data())},
+        rom_size_{static_cast<std::uint32_t>(rom.size())},
+        rom_pages_((rom.size() + kPageSize - 1) / kPageSize),
+        bios_(0x4000),
+        ewram_(0x40000),
+        iwram_(0x8000),
+        io_(0x400),
+        sram_(0x10000) {
+    for (std::size_t page = 0; page < rom_pages_.size(); page++)
+      rom_pages_[page] = rom_ + page * kPageSize;
+    for (const RomOverlay::Patch& patch : gsf_driver.patches())
+      PatchRom(patch.offset, patch.data);
+
+    char song_data[4];
+    WriteInt32L(song_data, static_cast<std::uint32_t>(song));
+    PatchRom(to_offset(minigsf.address()),
+             std::string_view{song_data, minigsf.size()});
+
+    WriteInt32L(&bios_[0x18], kBiosIrqVector);
+    for (std::size_t i = 0; i < kBiosIrqHandler.size(); i++)
+      WriteInt32L(&bios_[0x128 + i * 4], kBiosIrqHandler[i]);
+  }
+
+  std::uint8_t Read8(std::uint32_t address) override {
+    if ((address >> 24) == 0x04) {
+      const std::uint16_t value = ReadIo16(address & 0x3fe);
+      return static_cast<std::uint8_t>(value >> ((address & 1) * 8));
+    }
+    const std::uint8_t* p = Map(address, 1, false);
+    return p != nullptr ? *p : 0;
+  }
+
+  std::uint16_t Read16(std::uint32_t address) override {
+    address &= ~1u;
+    if ((address >> 24) == 0x04) return ReadIo16(address & 0x3fe);
+    const std::uint8_t* p = Map(address, 2, false);
+    return p != nullptr ? ReadInt16L(p) : 0;
+  }
+
+  std::uint32_t Read32(std::uint32_t address) override {
+    address &= ~3u;
+    if ((address >> 24) == 0x04) {
+      return ReadIo16(address & 0x3fc) |
+             (std::uint32_t{ReadIo16((address & 0x3fc) + 2)} << 16);
+    }
+    const std::uint8_t* p = Map(address, 4, false);
+    return p != nullptr ? ReadInt32L(p) : 0;
+  }
+
+  void Write8(std::uint32_t address, std::uint8_t value) override {
+    if ((address >> 24) == 0x04) {
+      const std::uint32_t offset = address & 0x3fe;
+      const unsigned int shift = (address & 1) * 8;
+      if (offset == kRegIf) {
+        WriteIo16(offset, static_cast<std::uint16_t>(value << shift));
+      } else {
+        const std::uint16_t mask = static_cast<std::uint16_t>(0xff << shift);
+        WriteIo16(offset, (io16(offset) & ~mask) | (value << shift));
+      }
+      return;
+    }
+    if (std::uint8_t* p = Map(address, 1, true)) *p = value;
+  }
+
+  void Write16(std::uint32_t address, std::uint16_t value) override {
+    address &= ~1u;
+    if ((address >> 24) == 0x04) {
+      WriteIo16(address & 0x3fe, value);
+      return;
+    }
+    if (std::uint8_t* p = Map(address, 2, true)) WriteInt16L(p, value);
+  }
+
+  void Write32(std::uint32_t address, std::uint32_t value) override {
+    address &= ~3u;
+    if ((address >> 24) == 0x04) {
+      WriteIo16(address & 0x3fc, static_cast<std::uint16_t>(value));
+      WriteIo16((address & 0x3fc) + 2, static_cast<std::uint16_t>(value >> 16));
+      return;
+    }
+    if (std::uint8_t* p = Map(address, 4, true)) WriteInt32L(p, value);
+  }
+
+  /// Raises the V-blank interrupt request. Returns whether the processor
+  /// should take it.
+  bool RaiseVBlank() {
+    set_io16(kRegIf, io16(kRegIf) | 1);
+    return (io16(kRegIme) & 1) != 0 && (io16(kRegIe) & io16(kRegIf) & 1) != 0;
+  }
+
+  void EnableInterrupts() { set_io16(kRegIme, 1); }
+
+ private:
+  static constexpr std::uint32_t kPageSize = 0x1000;
+
+  const std::uint8_t* rom_;
+  std::uint32_t rom_size_;
+  std::vector<const std::uint8_t*> rom_pages_;
+  std::vector<std::unique_ptr<std::uint8_t[]>> patched_pages_;
+
+  std::vector<std::uint8_t> bios_;
+  std::vector<std::uint8_t> ewram_;
+  std::vector<std::uint8_t> iwram_;
+  std::vector<std::uint8_t> io_;
+  std::vector<std::uint8_t> sram_;
+  std::uint32_t vcount_ = 0;
+
+  std::uint16_t io16(std::uint32_t offset) const {
+    return ReadInt16L(&io_[offset]);
+  }
+
+  void set_io16(std::uint32_t offset, std::uint16_t value) {
+    WriteInt16L(&io_[offset], value);
+  }
+
+  void PatchRom(agbsize_t offset, std::string_view data) {
+    if (offset > rom_size_ || rom_size_ - offset < data.size())
+      throw std::out_of_range("The ROM patch is out of range.");
+
+    for (std::size_t i = 0; i < data.size(); i++) {
+      const std::uint32_t pos = static_cast<std::uint32_t>(offset + i);
+      const std::uint32_t page = pos / kPageSize;
+      if (rom_pages_[page] == rom_ + page * kPageSize) {
+        auto copy = std::make_unique<std::uint8_t[]>(kPageSize);
+        const std::uint32_t page_pos = page * kPageSize;
+        std::memcpy(copy.get(), rom_pages_[page],
+                    std::min(kPageSize, rom_size_ - page_pos));
+        rom_pages_[page] = copy.get();
+        patched_pages_.push_back(std::move(copy));
+      }
+      const_cast<std::uint8_t*>(rom_pages_[page])[pos % kPageSize] =
+          static_cast<std::uint8_t>(data[i]);
+    }
+  }
+
+  // Returns the pointer to an aligned access, or nullptr for the unmapped
+  // (or read-only) memory.
+  std::uint8_t* Map(std::uint32_t address, std::uint32_t size, bool write) {
+    switch (address >> 24) {
+      case 0x00:
+        if (write || address >= bios_.size()) return nullptr;
+        return &bios_[address];
+      case 0x02:
+        return &ewram_[address & 0x3ffff];
+      case 0x03:
+        return &iwram_[address & 0x7fff];
+      case 0x08:
+      case 0x09:
+      case 0x0a:
+      case 0x0b:
+      case 0x0c:
+      case 0x0d: {
+        const std::uint32_t offset = address & 0x1ffffff;
+        if (write || offset >= rom_size_ || rom_size_ - offset < size)
+          return nullptr;
+        return const_cast<std::uint8_t*>(rom_pages_[offset / kPageSize]) +
+               offset % kPageSize;
+      }
+      case 0x0e:
+      case 0x0f:
+        return &sram_[address & 0xffff];
+      default:
+        return nullptr;
+    }
+  }
+
+  std::uint16_t ReadIo16(std::uint32_t offset) {
+    switch (offset) {
+      case kRegVCount:
+        // Advances on every read, for the loops that wait for a scanline.
+        vcount_ = (vcount_ + 1) % 228;
+        return static_cast<std::uint16_t>(vcount_);
+      case kRegDispStat:
+        return (io16(offset) & ~7u) | (vcount_ >= 160 && vcount_ < 227 ? 1 : 0);
+      default:
+        return io16(offset);
+    }
+  }
+
+  void WriteIo16(std::uint32_t offset, std::uint16_t value) {
+    if (offset == kRegIf) {  // acknowledge
+      set_io16(offset, io16(offset) & ~value);
+      return;
+    }
+    set_io16(offset, value);
+
+    if (offset >= kRegDma0 && offset < kRegDma0 + 4 * 12 &&
+        (offset - kRegDma0) % 12 == 10) {
+      // Immediate transfers run at once; the others (sound FIFO and so on)
+      // never start.
+      if ((value & 0x8000) != 0 && (value & 0x3000) == 0)
+        RunDma((offset - kRegDma0) / 12);
+    }
+  }
+
+  void RunDma(std::uint32_t channel) {
+    const std::uint32_t base = kRegDma0 + channel * 12;
+    std::uint32_t source = ReadInt32L(&io_[base]);
+    std::uint32_t destination = ReadInt32L(&io_[base + 4]);
+    std::uint32_t count = io16(base + 8);
+    const std::uint16_t control = io16(base + 10);
+    if (count == 0) count = channel == 3 ? 0x10000 : 0x4000;
+
+    const bool word = (control & 0x400) != 0;
+    const std::uint32_t width = word ? 4 : 2;
+    const auto step = [width](std::uint32_t mode) -> std::uint32_t {
+      return mode == 0 || mode == 3 ? width : mode == 1 ? -width : 0;
+    };
+    const std::uint32_t destination_step = step((control >> 5) & 3);
+    const std::uint32_t source_step = step((control >> 7) & 3);
+    for (std::uint32_t i = 0; i < count; i++) {
+      if (word) {
+        Write32(destination, Read32(source));
+      } else {
+        Write16(destination, Read16(source));
+      }
+      source += source_step;
+      destination += destination_step;
+    }
+    set_io16(base + 10, control & 0x7fff);
+  }
+};
+
+// The BIOS functions, emulated at a high level.
+class Bios {
+ public:
+  Bios(Arm7tdmi& cpu, GbaBus& bus) : cpu_{cpu}, bus_{bus} {}
+
+  /// Returns whether the program waits for the V-blank, and clears it.
+  bool TakeWait() noexcept {
+    const bool waiting = waiting_;
+    waiting_ = false;
+    return waiting;
+  }
+
+  void Call(std::uint32_t number) {
+    switch (number) {
+      case 0x02:  // Halt
+      case 0x04:  // IntrWait
+      case 0x05:  // VBlankIntrWait
+        bus_.EnableInterrupts();
+        waiting_ = true;
+        break;
+
+      case 0x06:  // Div
+        Divide(cpu_.reg(0), cpu_.reg(1));
+        break;
+
+      case 0x07:  // DivArm
+        Divide(cpu_.reg(1), cpu_.reg(0));
+        break;
+
+      case 0x08:  // Sqrt
+        cpu_.set_reg(0, static_cast<std::uint32_t>(
+                            std::sqrt(static_cast<double>(cpu_.reg(0)))));
+        break;
+
+      case 0x0b:  // CpuSet
+        CpuSet(cpu_.reg(0), cpu_.reg(1), cpu_.reg(2) & 0x1fffff,
+               (cpu_.reg(2) & (1 << 24)) != 0, (cpu_.reg(2) & (1 << 26)) != 0);
+        break;
+
+      case 0x0c:  // CpuFastSet
+        CpuSet(cpu_.reg(0), cpu_.reg(1), (cpu_.reg(2) + 7) & 0x1ffff8,
+               (cpu_.reg(2) & (1 << 24)) != 0, true);
+        break;
+
+      case 0x0d:  // GetBiosChecksum
+        cpu_.set_reg(0, 0xbaae187f);
+        break;
+
+      default:  // resets, sound functions and so on
+        break;
+    }
+  }
+
+ private:
+  Arm7tdmi& cpu_;
+  GbaBus& bus_;
+  bool waiting_ = false;
+
+  void Divide(std::uint32_t numerator, std::uint32_t denominator) {
+    if (denominator == 0)
+      throw std::runtime_error("Division by zero in the BIOS.");
+    const auto n = static_cast<std::int32_t>(numerator);
+    const auto d = static_cast<std::int32_t>(denominator);
+    const std::int64_t quotient = std::int64_t{n} / d;
+    const std::int64_t remainder = std::int64_t{n} % d;
+    cpu_.set_reg(0, static_cast<std::uint32_t>(quotient));
+    cpu_.set_reg(1, static_cast<std::uint32_t>(remainder));
+    cpu_.set_reg(3, static_cast<std::uint32_t>(std::abs(quotient)));
+  }
+
+  void CpuSet(std::uint32_t source, std::uint32_t destination,
+              std::uint32_t count, bool fill, bool word) {
+    const std::uint32_t width = word ? 4 : 2;
+    const std::uint32_t value = word ? bus_.Read32(source) : bus_.Read16(source);
+    for (std::uint32_t i = 0; i < count; i++) {
+      if (word) {
+        bus_.Write32(destination, fill ? value : bus_.Read32(source));
+      } else {
+        bus_.Write16(destination, static_cast<std::uint16_t>(
+                                      fill ? value : bus_.Read16(source)));
+      }
+      if (!fill) source += width;
+      destination += width;
+    }
+  }
+};
+
+}  // namespace
+
+SmokeTestResult DriverSmokeTest::Run(std::string_view rom,
+                                     const RomOverlay& gsf_driver,
+                                     const Mp2kDriverParam& param,
+                                     const MinigsfDriverParam& minigsf,
+                                     int song) {
+  SmokeTestResult result;
+  try {
+    GbaBus bus{rom, gsf_driver, minigsf, song};
+    Arm7tdmi cpu{bus};
+    Bios bios{cpu, bus};
+    cpu.set_swi_handler([&bios](std::uint32_t number) { bios.Call(number); });
+
+    // The state after the boot sequence of the BIOS.
+    cpu.set_banked_sp(Arm7tdmi::kModeIrq, 0x3007fa0);
+    cpu.set_banked_sp(Arm7tdmi::kModeSupervisor, 0x3007fe0);
+    cpu.set_banked_sp(Arm7tdmi::kModeSystem, 0x3007f00);
+    cpu.Jump(0x8000000);
+
+    const std::uint32_t init_fn = param.init_fn() & ~1u;
+    const std::uint32_t select_song_fn = param.select_song_fn() & ~1u;
+    const std::uint32_t main_fn = param.main_fn() & ~1u;
+    const std::uint32_t vsync_fn = param.vsync_fn() & ~1u;
+    int frames_after_main = 0;
+    while (frames_after_main < kFrameCount) {
+      const std::uint32_t pc = cpu.pc();
+      if (pc == init_fn) {
+        result.init_reached = true;
+      } else if (pc == select_song_fn) {
+        if (!result.select_song_reached)
+          result.song = static_cast<int>(cpu.reg(0));
+        result.select_song_reached = true;
+      } else if (pc == main_fn) {
+        result.main_reached = true;
+      } else if (pc == vsync_fn) {
+        result.vsync_reached = true;
+      }
+
+      if (result.instructions >= kMaxInstructions) {
+        std::ostringstream message;
+        message << "The driver did not reach the frame loop within "
+                << kMaxInstructions << " instructions (stopped at "
+                << to_string(pc) << ").";
+        result.error = message.str();
+        return result;
+      }
+
+      cpu.Step();
+      result.instructions++;
+
+      if (bios.TakeWait()) {
+        result.frames++;
+        if (result.main_reached) frames_after_main++;
+        if (bus.RaiseVBlank()) cpu.InterruptRequest();
+      }
+    }
+  } catch (const std::exception& e) {
+    result.error = e.what();
+    return result;
+  }
+
+  if (!result.init_reached) {
+    result.error = "m4aSoundInit was not called.";
+  } else if (!result.select_song_reached) {
+    result.error = "m4aSongNumStart was not called.";
+  } else if (result.song != song) {
+    result.error = "m4aSongNumStart was called with the song " +
+                   std::to_string(result.song) + " instead of " +
+                   std::to_string(song) + ".";
+  }
+  return result;
+}
+
+}  // namespace saptapper
@@ -0,0 +1,60 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_DRIVER_SMOKE_TEST_HPP_
+#define SAPTAPPER_DRIVER_SMOKE_TEST_HPP_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "minigsf_driver_param.hpp"
+#include "mp2k_driver_param.hpp"
+#include "rom_overlay.hpp"
+
+namespace saptapper {
+
+/// The outcome of DriverSmokeTest::Run.
+struct SmokeTestResult {
+  bool init_reached = false;
+  bool select_song_reached = false;
+  bool main_reached = false;
+  bool vsync_reached = false;
+
+  /// The song number passed to m4aSongNumStart, or -1 if not reached.
+  int song = -1;
+
+  std::uint64_t instructions = 0;
+  int frames = 0;
+
+  /// The reason of the failure, or empty if the driver worked.
+  std::string error;
+
+  bool ok() const noexcept { return error.empty(); }
+};
+
+/// Runs a ripped GSF set on a built-in ARM7TDMI interpreter, to check that
+/// the installed gsf driver calls the sound driver as intended.
+///
+/// The cartridge is executed from its entry point, with the gsf driver patch
+/// and the song number of the minigsf applied. The BIOS functions are
+/// emulated at a high level, the I/O registers are stubs, and a V-blank
+/// interrupt is raised whenever the program waits for one. The run stops a
+/// few frames after m4aSoundMain is reached.
+class DriverSmokeTest {
+ public:
+  /// The maximum number of instructions of a run.
+  static constexpr std::uint64_t kMaxInstructions = 20'000'000;
+
+  /// The number of frames to run after m4aSoundMain is reached.
+  static constexpr int kFrameCount = 3;
+
+  /// Runs the song and verifies that m4aSoundInit, m4aSongNumStart (with the
+  /// song number) and m4aSoundMain are reached. Never throws for the errors
+  /// of the program; they are reported in the result.
+  static SmokeTestResult Run(std::string_view rom, const RomOverlay& gsf_driver,
+                             const Mp2kDriverParam& param,
+                             const MinigsfDriverParam& minigsf, int song);
+};
+
+}  // namespace saptapper
+
+#endif
@@ -13,6 +13,8 @@ class GsfHeader {
  public:
   using size_type = agbsize_t;
 
+  static constexpr size_type kSize = 12;
+
   GsfHeader() : entrypoint_{0}, load_offset_{0}, load_size_{0} {};
 
   GsfHeader(agbptr_t entrypoint, agbptr_t load_offset, agbsize_t load_size)
@@ -28,8 +30,6 @@ class GsfHeader {
   agbptr_t load_size() const noexcept { return load_size_; }
 
  private:
-  static constexpr size_type kSize = 12;
-
   std::string str_;
   agbptr_t entrypoint_;
   agbptr_t load_offset_;
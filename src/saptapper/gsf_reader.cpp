@@ -0,0 +1,58 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "gsf_reader.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "bytes.hpp"
+#include "gsf_header.hpp"
+#include "psf_reader.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+GsfHeader GsfReader::ParseHeader(std::string_view exe) {
+  if (exe.size() < GsfHeader::kSize)
+    throw std::runtime_error("The GSF program is too short for its header.");
+  return GsfHeader{ReadInt32L(&exe[0]), ReadInt32L(&exe[4]),
+                   ReadInt32L(&exe[8])};
+}
+
+GsfHeader GsfReader::ReadHeader(const PsfReader& psf) {
+  CheckVersion(psf);
+  return ParseHeader(psf.DecompressPrefix(GsfHeader::kSize));
+}
+
+GsfProgram GsfReader::ReadProgram(const PsfReader& psf) {
+  CheckVersion(psf);
+
+  GsfProgram program;
+  program.exe = psf.Decompress(GsfHeader::kSize + kMaxDataSize);
+  program.header = ParseHeader(program.exe);
+  CheckDataSize(program.header, program.exe.size() - GsfHeader::kSize);
+  return program;
+}
+
+void GsfReader::CheckDataSize(const GsfHeader& header,
+                              std::size_t data_size) {
+  if (header.load_size() != data_size) {
+    std::ostringstream message;
+    message << "The GSF header declares " << header.load_size()
+            << " bytes, but the program has " << data_size << " bytes.";
+    throw std::runtime_error(message.str());
+  }
+}
+
+void GsfReader::CheckVersion(const PsfReader& psf) {
+  if (psf.version() != kVersion) {
+    std::ostringstream message;
+    message << "Not a GSF file (PSF version 0x" << std::hex
+            << static_cast<unsigned int>(psf.version()) << ").";
+    throw std::runtime_error(message.str());
+  }
+}
+
+}  // namespace saptapper
@@ -0,0 +1,58 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_GSF_READER_HPP_
+#define SAPTAPPER_GSF_READER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "buffer_pool.hpp"
+#include "gsf_header.hpp"
+#include "psf_reader.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+/// The decompressed program of a GSF file.
+struct GsfProgram {
+  GsfHeader header;
+
+  /// The header followed by the data to be loaded.
+  PooledBuffer exe;
+
+  std::string_view data() const noexcept {
+    return std::string_view{exe}.substr(GsfHeader::kSize);
+  }
+};
+
+/// Reads the program of GSF files, the counterpart of GsfWriter.
+class GsfReader {
+ public:
+  static constexpr std::uint8_t kVersion = 0x22;
+
+  /// The largest program to be loaded: the whole cartridge space.
+  static constexpr agbsize_t kMaxDataSize = 0x2000000;
+
+  GsfReader() = delete;
+
+  /// Parses the header at the beginning of the program.
+  static GsfHeader ParseHeader(std::string_view exe);
+
+  /// Reads the header of the program, decompressing only its first bytes.
+  /// Throws std::runtime_error if the file is not a GSF file.
+  static GsfHeader ReadHeader(const PsfReader& psf);
+
+  /// Decompresses the program. Throws std::runtime_error if the file is not
+  /// a GSF file, or if the size in the header does not match the data.
+  static GsfProgram ReadProgram(const PsfReader& psf);
+
+  /// Throws std::runtime_error unless the header declares the data size.
+  static void CheckDataSize(const GsfHeader& header, std::size_t data_size);
+
+ private:
+  static void CheckVersion(const PsfReader& psf);
+};
+
+}  // namespace saptapper
+
+#endif
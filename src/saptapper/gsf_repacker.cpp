@@ -0,0 +1,380 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "gsf_repacker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "gsf_header.hpp"
+#include "gsf_reader.hpp"
+#include "gsf_writer.hpp"
+#include "psf_reader.hpp"
+#include "rom_overlay.hpp"
+#include "sha1.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+// Differences closer than this are saved as one range.
+static constexpr agbsize_t kMergeGap = 8;
+
+static constexpr agbsize_t kCompareBlockSize = 64;
+
+namespace {
+
+struct SourceFile {
+  std::filesystem::path path;
+  std::map<std::string, std::string> tags;
+  Sha1::digest_type digest;  // of the compressed program
+  GsfHeader header;
+};
+
+// The files whose compressed programs are identical.
+struct Body {
+  std::vector<std::size_t> files;
+  RomOverlay difference;  // from the first body of the set
+};
+
+struct SongSet {
+  GsfHeader header;
+  std::vector<Body> bodies;
+};
+
+}  // namespace
+
+template <typename T>
+static std::vector<T> GetAll(std::vector<std::future<T>>& futures) {
+  // The tasks refer to the locals of the caller, so all of them must end
+  // before an exception is rethrown.
+  for (auto& future : futures) future.wait();
+  std::vector<T> results;
+  results.reserve(futures.size());
+  for (auto& future : futures) results.push_back(future.get());
+  return results;
+}
+
+static void WaitAll(std::vector<std::future<void>>& futures) {
+  for (auto& future : futures) future.wait();
+  for (auto& future : futures) future.get();
+}
+
+static std::runtime_error FileError(const std::filesystem::path& path,
+                                    const std::exception& e) {
+  return std::runtime_error(path.string() + ": " + e.what());
+}
+
+static SourceFile LoadSource(const std::filesystem::path& path) {
+  try {
+    const PsfReader psf = PsfReader::LoadFromFile(path);
+    for (const auto& tag : psf.tags()) {
+      if (tag.first.compare(0, 4, "_lib") == 0)
+        throw std::runtime_error("The file already uses a gsflib.");
+    }
+    SourceFile source{path, psf.tags(), Sha1::Digest(psf.compressed_exe()),
+                      GsfReader::ReadHeader(psf)};
+    if (source.header.load_size() == 0)
+      throw std::runtime_error("The GSF file has no program.");
+    return source;
+  } catch (const std::exception& e) {
+    throw FileError(path, e);
+  }
+}
+
+static GsfProgram LoadProgram(const std::filesystem::path& path) {
+  try {
+    return GsfReader::ReadProgram(PsfReader::LoadFromFile(path));
+  } catch (const std::exception& e) {
+    throw FileError(path, e);
+  }
+}
+
+// Returns the ranges where the data differs from the reference, or nothing
+// if they exceed the size.
+static std::optional<RomOverlay> Diff(std::string_view reference,
+                                      std::string_view data,
+                                      agbsize_t max_size) {
+  RomOverlay difference;
+  agbsize_t total_size = 0;
+  agbsize_t run_start = 0;
+  agbsize_t run_end = 0;
+  const auto flush = [&] {
+    difference.Add(run_start,
+                   std::string{data.substr(run_start, run_end - run_start)});
+    total_size += run_end - run_start;
+  };
+
+  const agbsize_t size = static_cast<agbsize_t>(data.size());
+  for (agbsize_t block = 0; block < size; block += kCompareBlockSize) {
+    const agbsize_t block_end = std::min(block + kCompareBlockSize, size);
+    if (std::memcmp(&reference[block], &data[block], block_end - block) == 0)
+      continue;
+
+    for (agbsize_t pos = block; pos < block_end; pos++) {
+      if (reference[pos] == data[pos]) continue;
+      if (run_end != 0 && pos <= run_end + kMergeGap) {
+        run_end = pos + 1;
+        continue;
+      }
+      if (run_end != 0) flush();
+      if (total_size > max_size) return std::nullopt;
+      run_start = pos;
+      run_end = pos + 1;
+    }
+  }
+  if (run_end != 0) flush();
+  if (total_size > max_size) return std::nullopt;
+  return difference;
+}
+
+// Returns the byte of the body at the offset.
+static char ValueAt(std::string_view reference, const RomOverlay& difference,
+                    agbsize_t offset) {
+  const auto& patches = difference.patches();
+  auto it = std::upper_bound(
+      patches.begin(), patches.end(), offset,
+      [](agbsize_t offset, const RomOverlay::Patch& p) {
+        return offset < p.offset;
+      });
+  if (it != patches.begin() && std::prev(it)->end() > offset)
+    return std::prev(it)->data[offset - std::prev(it)->offset];
+  return reference[offset];
+}
+
+std::vector<std::filesystem::path> GsfRepacker::Repack(
+    const std::vector<std::filesystem::path>& paths,
+    const std::filesystem::path& basename,
+    const std::filesystem::path& outdir, const RepackOptions& options) {
+  if (paths.empty()) throw std::invalid_argument("No GSF files to repack.");
+
+  std::filesystem::path base_path{outdir};
+  base_path /= basename;
+  create_directories(base_path.parent_path());
+  const std::filesystem::path dir{base_path.parent_path()};
+
+  std::vector<std::filesystem::path> minigsf_paths;
+  std::set<std::filesystem::path> known_paths;
+  for (const auto& path : paths) {
+    std::filesystem::path minigsf_path{dir / path.stem()};
+    minigsf_path += ".minigsf";
+    if (!known_paths.insert(minigsf_path).second)
+      throw std::runtime_error("Two files would be saved as " +
+                               minigsf_path.string() + ".");
+    minigsf_paths.push_back(std::move(minigsf_path));
+  }
+
+  ThreadPool pool{options.thread_count};
+
+  // Only the beginning of each program is decompressed here, for the header.
+  std::vector<std::future<SourceFile>> loading;
+  for (const auto& path : paths)
+    loading.push_back(pool.Async([&path] { return LoadSource(path); }));
+  const std::vector<SourceFile> sources = GetAll(loading);
+
+  std::vector<SongSet> sets;
+  for (std::size_t i = 0; i < sources.size(); i++) {
+    const GsfHeader& header = sources[i].header;
+    auto set = std::find_if(sets.begin(), sets.end(), [&](const SongSet& s) {
+      return s.header.entrypoint() == header.entrypoint() &&
+             s.header.load_offset() == header.load_offset() &&
+             s.header.load_size() == header.load_size();
+    });
+    if (set == sets.end()) set = sets.insert(sets.end(), SongSet{header, {}});
+
+    auto body = std::find_if(
+        set->bodies.begin(), set->bodies.end(), [&](const Body& b) {
+          return sources[b.files.front()].digest == sources[i].digest;
+        });
+    if (body == set->bodies.end())
+      body = set->bodies.insert(set->bodies.end(), Body{});
+    body->files.push_back(i);
+  }
+
+  std::vector<std::filesystem::path> saved_paths;
+  for (std::size_t set_index = 0; set_index < sets.size(); set_index++) {
+    SongSet& set = sets[set_index];
+    const std::filesystem::path& reference_path =
+        sources[set.bodies.front().files.front()].path;
+    const GsfProgram reference_program = LoadProgram(reference_path);
+    const std::string_view reference = reference_program.data();
+
+    // Each distinct program is decompressed once, and only its differences
+    // are kept.
+    std::vector<std::future<RomOverlay>> comparing;
+    for (std::size_t i = 1; i < set.bodies.size(); i++) {
+      const std::filesystem::path& path =
+          sources[set.bodies[i].files.front()].path;
+      comparing.push_back(pool.Async([&path, &reference_path, reference] {
+        const GsfProgram program = LoadProgram(path);
+        std::optional<RomOverlay> difference =
+            Diff(reference, program.data(), kMaxDifference);
+        if (!difference) {
+          throw std::runtime_error(
+              path.string() + ": The file differs from " +
+              reference_path.string() + " in more than " +
+              std::to_string(kMaxDifference) +
+              " bytes. It is not a song of the same ROM.");
+        }
+        return std::move(*difference);
+      }));
+    }
+    std::vector<RomOverlay> differences = GetAll(comparing);
+    for (std::size_t i = 1; i < set.bodies.size(); i++)
+      set.bodies[i].difference = std::move(differences[i - 1]);
+
+    // Votes for the value of each byte which differs somewhere. The files
+    // without a difference at the offset vote for the reference.
+    std::map<agbsize_t, std::vector<std::pair<char, std::size_t>>> votes;
+    for (const Body& body : set.bodies) {
+      for (const auto& patch : body.difference.patches()) {
+        for (agbsize_t i = 0; i < patch.data.size(); i++) {
+          auto& candidates = votes[patch.offset + i];
+          auto it = std::find_if(
+              candidates.begin(), candidates.end(),
+              [&](const auto& candidate) {
+                return candidate.first == patch.data[i];
+              });
+          if (it == candidates.end()) {
+            candidates.emplace_back(patch.data[i], body.files.size());
+          } else {
+            it->second += body.files.size();
+          }
+        }
+      }
+    }
+
+    std::size_t file_count = 0;
+    for (const Body& body : set.bodies) file_count += body.files.size();
+
+    // The reference wins the ties.
+    std::map<agbsize_t, char> image;
+    RomOverlay image_patch;
+    std::string run;
+    agbsize_t run_start = 0;
+    for (const auto& [offset, candidates] : votes) {
+      char best = reference[offset];
+      std::size_t best_count = file_count;
+      for (const auto& candidate : candidates) {
+        if (candidate.first != best) best_count -= candidate.second;
+      }
+      for (const auto& candidate : candidates) {
+        if (candidate.second > best_count) {
+          best = candidate.first;
+          best_count = candidate.second;
+        }
+      }
+      image[offset] = best;
+
+      if (!run.empty() && (best == reference[offset] ||
+                           offset != run_start + run.size())) {
+        image_patch.Add(run_start, std::move(run));
+        run.clear();
+      }
+      if (best != reference[offset]) {
+        if (run.empty()) run_start = offset;
+        run += best;
+      }
+    }
+    if (!run.empty()) image_patch.Add(run_start, std::move(run));
+
+    std::filesystem::path gsflib_path{base_path};
+    if (set_index != 0) gsflib_path += "-" + std::to_string(set_index + 1);
+    gsflib_path += ".gsflib";
+    const std::string lib{gsflib_path.filename().string()};
+
+    std::vector<std::future<void>> saving;
+    saving.push_back(pool.Async([&] {
+      GsfWriter::SaveToFile(gsflib_path, set.header, reference, image_patch,
+                            {}, options.compression, options.thread_count);
+    }));
+    saved_paths.push_back(gsflib_path);
+
+    // The minigsf of a body covers the range where it differs from the image.
+    std::vector<std::pair<agbsize_t, std::string>> songs(set.bodies.size());
+    for (std::size_t i = 0; i < set.bodies.size(); i++) {
+      const RomOverlay& difference = set.bodies[i].difference;
+      std::optional<agbsize_t> first;
+      agbsize_t last = 0;
+      for (const auto& [offset, value] : image) {
+        if (ValueAt(reference, difference, offset) == value) continue;
+        if (!first) first = offset;
+        last = offset;
+      }
+      if (!first) {
+        // Identical to the image; a byte of it is enough.
+        first = image.empty() ? 0 : image.begin()->first;
+        last = *first;
+      }
+
+      std::string data{reference.substr(*first, last - *first + 1)};
+      for (agbsize_t offset = *first; offset <= last; offset++)
+        data[offset - *first] = ValueAt(reference, difference, offset);
+      songs[i] = {*first, std::move(data)};
+    }
+
+    for (std::size_t i = 0; i < set.bodies.size(); i++) {
+      const agbsize_t offset = songs[i].first;
+      const std::string& data = songs[i].second;
+      const GsfHeader header{set.header.entrypoint(),
+                             set.header.load_offset() + offset,
+                             static_cast<agbsize_t>(data.size())};
+      for (const std::size_t file : set.bodies[i].files) {
+        saving.push_back(pool.Async([&sources, &minigsf_paths, &lib, &data,
+                                     &options, header, file] {
+          std::map<std::string, std::string> tags{sources[file].tags};
+          tags["_lib"] = lib;
+          GsfWriter::SaveToFile(minigsf_paths[file], header, data, tags,
+                                options.compression, options.thread_count);
+        }));
+        saved_paths.push_back(minigsf_paths[file]);
+      }
+    }
+    WaitAll(saving);
+  }
+  return saved_paths;
+}
+
+std::filesystem::path GsfRepacker::GuessBasename(
+    const std::vector<std::filesystem::path>& paths) {
+  std::string first_stem;
+  std::string prefix;
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    const std::string stem{paths[i].stem().string()};
+    if (i == 0) {
+      first_stem = stem;
+      prefix = stem;
+    } else {
+      const auto mismatch =
+          std::mismatch(prefix.begin(), prefix.end(), stem.begin(), stem.end());
+      prefix.erase(mismatch.first, prefix.end());
+    }
+  }
+
+  // Drop the leading digits of the song numbers, and their separator.
+  const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+  if (prefix.size() < first_stem.size() &&
+      is_digit(first_stem[prefix.size()])) {
+    while (!prefix.empty() && is_digit(prefix.back())) prefix.pop_back();
+  }
+  const auto end = prefix.find_last_not_of(" -_.([");
+  prefix.erase(end == std::string::npos ? 0 : end + 1);
+  if (!prefix.empty()) return prefix;
+
+  if (!paths.empty()) {
+    const std::filesystem::path dir{
+        std::filesystem::absolute(paths.front()).parent_path().filename()};
+    if (!dir.empty()) return dir;
+  }
+  return "repacked";
+}
+
+}  // namespace saptapper
@@ -0,0 +1,55 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_GSF_REPACKER_HPP_
+#define SAPTAPPER_GSF_REPACKER_HPP_
+
+#include <filesystem>
+#include <vector>
+#include "deflater.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+/// Options of GsfRepacker::Repack.
+struct RepackOptions {
+  /// The compression profile of the gsflibs.
+  CompressionProfile compression = CompressionProfile::kBalanced;
+
+  /// The number of worker threads, or 0 for the number of CPUs.
+  unsigned int thread_count = 0;
+};
+
+/// Rewrites monolithic GSF files, each of which has the whole ROM, as gsflibs
+/// and minigsfs.
+///
+/// The files which load the same size at the same address are taken as the
+/// songs of a ROM. The shared image is made of the most common value of each
+/// byte, and each song keeps the range where it differs from the image.
+class GsfRepacker {
+ public:
+  /// The maximum number of bytes in which a song may differ from the first
+  /// song of its set.
+  static constexpr agbsize_t kMaxDifference = 0x100000;
+
+  GsfRepacker() = delete;
+
+  /// Repacks the files and returns the paths of the saved files.
+  ///
+  /// A gsflib is saved for each set. The first one is named after the
+  /// basename, and the others are suffixed with "-2", "-3" and so on. Each
+  /// minigsf is named after its source file, with the same tags. The files
+  /// are read in parallel, and identical programs are decompressed once.
+  static std::vector<std::filesystem::path> Repack(
+      const std::vector<std::filesystem::path>& paths,
+      const std::filesystem::path& basename,
+      const std::filesystem::path& outdir = "",
+      const RepackOptions& options = {});
+
+  /// Returns the common prefix of the filenames, for the gsflib name.
+  static std::filesystem::path GuessBasename(
+      const std::vector<std::filesystem::path>& paths);
+};
+
+}  // namespace saptapper
+
+#endif
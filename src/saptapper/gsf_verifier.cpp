@@ -0,0 +1,180 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "gsf_verifier.hpp"
+
+#include <filesystem>
+#include <future>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "gsf_header.hpp"
+#include "gsf_reader.hpp"
+#include "psf_reader.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+// The memory areas which a GSF program can be loaded into.
+static constexpr agbptr_t kRomBegin = 0x8000000;
+static constexpr agbptr_t kRomEnd = 0xA000000;
+static constexpr agbptr_t kEwramBegin = 0x2000000;
+static constexpr agbptr_t kEwramEnd = 0x2040000;
+
+// Throws std::runtime_error unless the program is loaded into the memory
+// which contains the entry point.
+static void CheckLoadRange(const GsfHeader& header, agbptr_t entrypoint) {
+  agbptr_t begin;
+  agbptr_t end;
+  if (entrypoint >= kRomBegin && entrypoint < kRomEnd) {
+    begin = kRomBegin;
+    end = kRomEnd;
+  } else if (entrypoint >= kEwramBegin && entrypoint < kEwramEnd) {
+    begin = kEwramBegin;
+    end = kEwramEnd;
+  } else {
+    std::ostringstream message;
+    message << "The entry point 0x" << std::hex << entrypoint
+            << " is neither in ROM nor in EWRAM.";
+    throw std::runtime_error(message.str());
+  }
+
+  if (header.load_offset() < begin || header.load_offset() > end ||
+      header.load_size() > end - header.load_offset()) {
+    std::ostringstream message;
+    message << "The program at 0x" << std::hex << header.load_offset()
+            << std::dec << " (" << header.load_size()
+            << " bytes) is outside the memory of the entry point 0x"
+            << std::hex << entrypoint << ".";
+    throw std::runtime_error(message.str());
+  }
+}
+
+// Returns whether the tag names a library: _lib, or _lib2 to _lib9.
+static bool IsLibTag(const std::string& key) {
+  return key == "_lib" ||
+         (key.size() == 5 && key.compare(0, 4, "_lib") == 0 &&
+          key[4] >= '2' && key[4] <= '9');
+}
+
+static std::filesystem::path LibKey(const std::filesystem::path& path) {
+  std::error_code ec;
+  std::filesystem::path key = weakly_canonical(path, ec);
+  return ec ? path.lexically_normal() : key;
+}
+
+// Checks the libraries of the file recursively, and returns the entry point
+// of the root library.
+static agbptr_t CheckLibs(
+    const GsfVerification& file,
+    const std::map<std::filesystem::path, GsfVerification>& verified,
+    int depth) {
+  if (file.libs.empty()) return file.header.entrypoint();
+  if (depth >= GsfVerifier::kMaxLibDepth)
+    throw std::runtime_error("The _lib tags are nested too deeply.");
+
+  agbptr_t entrypoint = 0;
+  for (std::size_t i = 0; i < file.libs.size(); i++) {
+    const std::filesystem::path& lib = file.libs[i];
+    const auto it = verified.find(LibKey(lib));
+    if (it == verified.end() || !it->second.ok()) {
+      if (!exists(lib))
+        throw std::runtime_error("The library " + lib.string() +
+                                 " does not exist.");
+      throw std::runtime_error(
+          "The library " + lib.string() + " is broken: " +
+          (it == verified.end() ? "not verified" : it->second.error));
+    }
+
+    // The first library provides the entry point.
+    const agbptr_t lib_entrypoint = CheckLibs(it->second, verified, depth + 1);
+    if (i == 0) entrypoint = lib_entrypoint;
+  }
+  CheckLoadRange(file.header, entrypoint);
+  return entrypoint;
+}
+
+GsfVerification GsfVerifier::VerifyFile(const std::filesystem::path& path) {
+  GsfVerification result;
+  result.path = path;
+  try {
+    result.file_size = file_size(path);
+    const PsfReader psf = PsfReader::LoadFromFile(path);
+    if (!psf.VerifyCrc32())
+      throw std::runtime_error("The CRC-32 of the program does not match.");
+
+    result.header = GsfReader::ReadHeader(psf);
+    result.program_size =
+        psf.DecompressedSize(GsfHeader::kSize + GsfReader::kMaxDataSize);
+    GsfReader::CheckDataSize(result.header,
+                             result.program_size - GsfHeader::kSize);
+
+    for (const auto& [key, value] : psf.tags()) {
+      if (!IsLibTag(key)) continue;
+      if (value.empty())
+        throw std::runtime_error("The " + key + " tag is empty.");
+      result.libs.push_back(path.parent_path() / value);
+    }
+    if (result.libs.empty())
+      CheckLoadRange(result.header, result.header.entrypoint());
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+std::vector<GsfVerification> GsfVerifier::Verify(
+    const std::vector<std::filesystem::path>& paths,
+    unsigned int thread_count) {
+  ThreadPool pool{thread_count};
+  const auto verify_all = [&pool](const auto& files) {
+    std::vector<std::future<GsfVerification>> futures;
+    futures.reserve(files.size());
+    for (const auto& file : files)
+      futures.push_back(pool.Async([file] { return VerifyFile(file); }));
+
+    std::vector<GsfVerification> results;
+    results.reserve(files.size());
+    for (auto& future : futures) results.push_back(future.get());
+    return results;
+  };
+
+  std::vector<GsfVerification> results = verify_all(paths);
+
+  // Each library is verified once, however many files share it.
+  std::map<std::filesystem::path, GsfVerification> verified;
+  for (const auto& result : results)
+    verified.emplace(LibKey(result.path), result);
+  for (int depth = 0; depth < kMaxLibDepth; depth++) {
+    std::vector<std::filesystem::path> pending;
+    std::set<std::filesystem::path> pending_keys;
+    for (const auto& entry : verified) {
+      for (const auto& lib : entry.second.libs) {
+        const std::filesystem::path key = LibKey(lib);
+        if (verified.count(key) == 0 && pending_keys.insert(key).second)
+          pending.push_back(lib);
+      }
+    }
+    if (pending.empty()) break;
+
+    for (auto& result : verify_all(pending))
+      verified.emplace(LibKey(result.path), std::move(result));
+  }
+
+  for (auto& result : results) {
+    if (!result.ok() || result.libs.empty()) continue;
+    try {
+      CheckLibs(result, verified, 0);
+    } catch (const std::exception& e) {
+      result.error = e.what();
+    }
+  }
+  return results;
+}
+
+}  // namespace saptapper
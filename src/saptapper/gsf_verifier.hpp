@@ -0,0 +1,53 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_GSF_VERIFIER_HPP_
+#define SAPTAPPER_GSF_VERIFIER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "gsf_header.hpp"
+
+namespace saptapper {
+
+/// The result of verifying a GSF file.
+struct GsfVerification {
+  std::filesystem::path path;
+  std::uintmax_t file_size = 0;
+  std::size_t program_size = 0;  // decompressed, with the GSF header
+  GsfHeader header;
+
+  /// The files named by the _lib tags, relative to the working directory.
+  std::vector<std::filesystem::path> libs;
+
+  std::string error;
+
+  bool ok() const noexcept { return error.empty(); }
+};
+
+/// Reads back GSF files and checks that they can be played.
+class GsfVerifier {
+ public:
+  /// The maximum depth of nested _lib tags.
+  static constexpr int kMaxLibDepth = 10;
+
+  GsfVerifier() = delete;
+
+  /// Verifies a file without its libraries: the PSF header, the CRC-32, the
+  /// decompressed size and the GSF header. The program is inflated through a
+  /// small buffer, rather than kept in memory.
+  static GsfVerification VerifyFile(const std::filesystem::path& path);
+
+  /// Verifies the files and their libraries in parallel. A file fails if one
+  /// of its libraries is missing or broken, or if its program is outside the
+  /// memory of the entry point of the root library.
+  static std::vector<GsfVerification> Verify(
+      const std::vector<std::filesystem::path>& paths,
+      unsigned int thread_count = 0);
+};
+
+}  // namespace saptapper
+
+#endif
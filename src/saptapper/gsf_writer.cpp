@@ -4,7 +4,10 @@
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <system_error>
 #include <utility>
 #include "gsf_header.hpp"
 #include "psf_writer.hpp"
@@ -12,22 +15,57 @@
 
 namespace saptapper {
 
+std::string GsfWriter::recipe(CompressionProfile profile) {
+  std::ostringstream recipe;
+  recipe << "psf-version=" << static_cast<int>(kVersion) << ";"
+         << PsfWriter::recipe(profile);
+  return recipe.str();
+}
+
+void GsfWriter::SaveToFile(const std::filesystem::path& path,
+                           const GsfHeader& header, std::string_view rom,
+                           const std::map<std::string, std::string>& tags,
+                           CompressionProfile profile,
+                           unsigned int thread_count) {
+  SaveToFile(path, header, rom, RomOverlay{}, tags, profile, thread_count);
+}
+
+void GsfWriter::SaveToStream(std::ostream& out, const GsfHeader& header,
+                             std::string_view rom,
+                             const std::map<std::string, std::string>& tags,
+                             CompressionProfile profile,
+                             unsigned int thread_count) {
+  SaveToStream(out, header, rom, RomOverlay{}, tags, profile, thread_count);
+}
+
 void GsfWriter::SaveToFile(const std::filesystem::path& path,
                            const GsfHeader& header, std::string_view rom,
-                           const std::map<std::string, std::string>& tags) {
+                           const RomOverlay& overlay,
+                           const std::map<std::string, std::string>& tags,
+                           CompressionProfile profile,
+                           unsigned int thread_count) {
+  // The path may be a hard link into a gsflib store. Truncating it would
+  // overwrite the stored file, so the link is removed first.
+  std::error_code ec;
+  remove(path, ec);
+
   std::ofstream file(path, std::ios::out | std::ios::binary);
-  file.exceptions(std::ios::badbit);
-  SaveToStream(file, header, rom, tags);
+  file.exceptions(std::ios::badbit | std::ios::failbit);
+  SaveToStream(file, header, rom, overlay, tags, profile, thread_count);
   file.close();
 }
 
 void GsfWriter::SaveToStream(std::ostream& out, const GsfHeader& header,
-                             std::string_view rom,
-                             const std::map<std::string, std::string>& tags) {
-  PsfWriter psf{kVersion};
+                             std::string_view rom, const RomOverlay& overlay,
+                             const std::map<std::string, std::string>& tags,
+                             CompressionProfile profile,
+                             unsigned int thread_count) {
+  PsfWriter psf{kVersion, {}, profile, thread_count};
   auto& exe = psf.exe();
   exe.write(header.data(), header.size());
-  exe.write(rom.data(), rom.size());
+  overlay.ForEachPiece(rom, [&](std::string_view piece) {
+    exe.write(piece.data(), piece.size());
+  });
   psf.SaveToStream(out, tags);
 }
 
@@ -35,7 +73,7 @@ void GsfWriter::SaveMinigsfToFile(
     const std::filesystem::path& path, const MinigsfDriverParam& param,
     std::uint32_t song, const std::map<std::string, std::string>& tags) {
   std::ofstream file(path, std::ios::out | std::ios::binary);
-  file.exceptions(std::ios::badbit);
+  file.exceptions(std::ios::badbit | std::ios::failbit);
   SaveMinigsfToStream(file, param, song, tags);
   file.close();
 }
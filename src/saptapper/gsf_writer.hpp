@@ -8,20 +8,49 @@
 #include <map>
 #include <string>
 #include <string_view>
+#include "deflater.hpp"
 #include "gsf_header.hpp"
 #include "minigsf_driver_param.hpp"
+#include "rom_overlay.hpp"
 
 namespace saptapper {
 
 class GsfWriter {
  public:
-  static void SaveToFile(const std::filesystem::path& path,
-                         const GsfHeader& header, std::string_view rom,
-                         const std::map<std::string, std::string>& tags = {});
+  /// Describes the settings which affect the output of SaveToStream, other
+  /// than the header and the ROM.
+  static std::string recipe(
+      CompressionProfile profile = CompressionProfile::kBalanced);
 
-  static void SaveToStream(std::ostream& out, const GsfHeader& header,
-                           std::string_view rom,
-                           const std::map<std::string, std::string>& tags = {});
+  /// The optimal profile compresses on thread_count threads, or on the
+  /// hardware threads for 0.
+  static void SaveToFile(
+      const std::filesystem::path& path, const GsfHeader& header,
+      std::string_view rom, const std::map<std::string, std::string>& tags = {},
+      CompressionProfile profile = CompressionProfile::kBalanced,
+      unsigned int thread_count = 0);
+
+  static void SaveToStream(
+      std::ostream& out, const GsfHeader& header, std::string_view rom,
+      const std::map<std::string, std::string>& tags = {},
+      CompressionProfile profile = CompressionProfile::kBalanced,
+      unsigned int thread_count = 0);
+
+  /// Saves the ROM with the patches of the overlay applied on the fly. The
+  /// ROM itself is neither modified nor copied.
+  static void SaveToFile(
+      const std::filesystem::path& path, const GsfHeader& header,
+      std::string_view rom, const RomOverlay& overlay,
+      const std::map<std::string, std::string>& tags = {},
+      CompressionProfile profile = CompressionProfile::kBalanced,
+      unsigned int thread_count = 0);
+
+  static void SaveToStream(
+      std::ostream& out, const GsfHeader& header, std::string_view rom,
+      const RomOverlay& overlay,
+      const std::map<std::string, std::string>& tags = {},
+      CompressionProfile profile = CompressionProfile::kBalanced,
+      unsigned int thread_count = 0);
 
   static void SaveMinigsfToFile(
       const std::filesystem::path& path, const MinigsfDriverParam& param,
@@ -0,0 +1,83 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "gsflib_store.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include "gsf_header.hpp"
+#include "sha1.hpp"
+
+namespace saptapper {
+
+std::filesystem::path GsflibStore::PathOf(std::string_view key) const {
+  std::filesystem::path path{dir_};
+  path /= std::string(key.substr(0, 2));
+  path /= std::string(key);
+  path += ".gsflib";
+  return path;
+}
+
+bool GsflibStore::Install(std::string_view key,
+                          const std::filesystem::path& path,
+                          const WriteFunction& write) const {
+  const std::filesystem::path stored_path = PathOf(key);
+
+  bool reused = true;
+  if (!exists(stored_path)) {
+    reused = false;
+    create_directories(stored_path.parent_path());
+
+    // Write to a unique temporary name and rename it, so that concurrent
+    // writers of the same key never expose a partial file.
+    std::ostringstream suffix;
+    suffix << ".tmp-" << std::this_thread::get_id() << "-"
+           << std::chrono::steady_clock::now().time_since_epoch().count();
+    std::filesystem::path temp_path{stored_path};
+    temp_path += suffix.str();
+    try {
+      write(temp_path);
+      rename(temp_path, stored_path);
+    } catch (...) {
+      std::error_code ec;
+      remove(temp_path, ec);
+      throw;
+    }
+  }
+
+  std::error_code ec;
+  if (exists(path) && equivalent(path, stored_path, ec)) return reused;
+  Link(stored_path, path);
+  return reused;
+}
+
+std::string GsflibStore::MakeKey(std::string_view recipe,
+                                 const GsfHeader& header,
+                                 std::string_view rom,
+                                 const RomOverlay& overlay) {
+  Sha1 sha1;
+  sha1.Update(recipe);
+  sha1.Update("", 1);
+  sha1.Update(header.data(), header.size());
+  overlay.ForEachPiece(rom,
+                       [&](std::string_view piece) { sha1.Update(piece); });
+  return Sha1::ToHex(sha1.Finish());
+}
+
+void GsflibStore::Link(const std::filesystem::path& target,
+                       const std::filesystem::path& link) {
+  std::error_code ec;
+  remove(link, ec);
+  create_hard_link(target, link, ec);
+  if (ec) {
+    // The store may be on another file system; fall back to a copy.
+    copy_file(target, link, std::filesystem::copy_options::overwrite_existing);
+  }
+}
+
+}  // namespace saptapper
@@ -0,0 +1,57 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_GSFLIB_STORE_HPP_
+#define SAPTAPPER_GSFLIB_STORE_HPP_
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "gsf_header.hpp"
+#include "rom_overlay.hpp"
+
+namespace saptapper {
+
+/// Content-addressed store of gsflibs shared across sets and runs.
+///
+/// Regional variants of a game often produce identical gsflibs. The store
+/// keeps one file per distinct content at <dir>/<xx>/<key>.gsflib, where the
+/// key is the SHA-1 of everything that determines the file, and the output
+/// gsflibs are hard links to it.
+class GsflibStore {
+ public:
+  using WriteFunction = std::function<void(const std::filesystem::path&)>;
+
+  explicit GsflibStore(std::filesystem::path dir) : dir_{std::move(dir)} {}
+
+  const std::filesystem::path& dir() const noexcept { return dir_; }
+
+  std::filesystem::path PathOf(std::string_view key) const;
+
+  /// Places the gsflib of the key at the path.
+  /// @param key the key from MakeKey.
+  /// @param path the path of the gsflib to be placed.
+  /// @param write the function to write the gsflib to a given path, which is
+  /// called only if the store does not have it yet.
+  /// @return true if the stored gsflib was reused.
+  bool Install(std::string_view key, const std::filesystem::path& path,
+               const WriteFunction& write) const;
+
+  /// Computes the key of the gsflib made of the header and the ROM, with the
+  /// patches of the overlay.
+  /// @param recipe the description of the other inputs which affect the
+  /// contents, such as the compression settings.
+  static std::string MakeKey(std::string_view recipe, const GsfHeader& header,
+                             std::string_view rom,
+                             const RomOverlay& overlay = {});
+
+ private:
+  std::filesystem::path dir_;
+
+  static void Link(const std::filesystem::path& target,
+                   const std::filesystem::path& link);
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,312 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "inspection.hpp"
+
+#include <array>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mp2k_driver.hpp"
+#include "mp2k_driver_param.hpp"
+#include "rom_hashes.hpp"
+#include "saptapper.hpp"
+#include "tabulate.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+static void WriteJsonString(std::ostream& out, std::string_view str) {
+  out << '"';
+  for (const char c : str) {
+    const auto byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (byte < 0x20 || byte >= 0x7f) {
+      // Non-ASCII bytes of ROM headers are not UTF-8; take them as Latin-1.
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<unsigned int>(byte) << std::dec << std::setfill(' ');
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+static void WriteJsonAddress(std::ostream& out, agbptr_t addr) {
+  if (addr == agbnullptr) {
+    out << "null";
+  } else {
+    out << '"' << to_string(addr) << '"';
+  }
+}
+
+static void WriteCsvString(std::ostream& out, std::string_view str) {
+  if (str.find_first_of(",\"\r\n") == std::string_view::npos) {
+    out << str;
+    return;
+  }
+  out << '"';
+  for (const char c : str) {
+    if (c == '"') out << '"';
+    out << c;
+  }
+  out << '"';
+}
+
+static void WriteCsvAddress(std::ostream& out, agbptr_t addr) {
+  if (addr != agbnullptr) out << to_string(addr);
+}
+
+// Writes the computed hashes as members, each with a leading comma.
+static void WriteJsonHashes(std::ostream& out, const RomHashes& hashes) {
+  if (hashes.has(RomHashes::kCrc32))
+    out << ",\"crc32\":\"" << hashes.crc32_hex() << '"';
+  if (hashes.has(RomHashes::kSha1))
+    out << ",\"sha1\":\"" << hashes.sha1_hex() << '"';
+  if (hashes.has(RomHashes::kXxh64))
+    out << ",\"xxh64\":\"" << hashes.xxh64_hex() << '"';
+}
+
+static unsigned int filler_value(const FreeSpace& space) {
+  return static_cast<unsigned char>(space.filler);
+}
+
+static int score_of(const InspectionResult& result) {
+  return result.candidates.empty() ? 0 : result.candidates.front().score;
+}
+
+static void WriteJsonParam(std::ostream& out, const Mp2kDriverParam& param) {
+  out << "\"m4aSoundVSync\":";
+  WriteJsonAddress(out, param.vsync_fn());
+  out << ",\"m4aSoundInit\":";
+  WriteJsonAddress(out, param.init_fn());
+  out << ",\"m4aSoundMain\":";
+  WriteJsonAddress(out, param.main_fn());
+  out << ",\"m4aSongNumStart\":";
+  WriteJsonAddress(out, param.select_song_fn());
+  out << ",\"song_table\":";
+  WriteJsonAddress(out, param.song_table());
+  out << ",\"song_count\":" << param.song_count();
+}
+
+void InspectionWriter::Begin() {
+  count_ = 0;
+  switch (format_) {
+    case Format::kJson:
+      out_ << '[';
+      break;
+
+    case Format::kCsv:
+      out_ << "path,ok,error,game_title,game_code,m4aSoundVSync,"
+              "m4aSoundInit,m4aSoundMain,m4aSongNumStart,song_table,"
+              "song_count,minigsf_address,minigsf_size,gsf_driver_address,"
+              "free_space,score,alternatives,load_ms,inspect_ms,crc32,sha1,"
+              "xxh64\n";
+      break;
+
+    default:
+      break;
+  }
+}
+
+void InspectionWriter::Write(const InspectionResult& result) {
+  switch (format_) {
+    case Format::kTable:
+      WriteTable(result);
+      break;
+
+    case Format::kJson:
+      out_ << (count_ == 0 ? "\n" : ",\n");
+      WriteJson(result);
+      break;
+
+    case Format::kNdjson:
+      WriteJson(result);
+      out_ << '\n';
+      break;
+
+    case Format::kCsv:
+      WriteCsv(result);
+      break;
+  }
+  count_++;
+  out_.flush();
+}
+
+void InspectionWriter::End() {
+  if (format_ == Format::kJson) out_ << (count_ == 0 ? "]\n" : "\n]\n");
+  out_.flush();
+}
+
+InspectionWriter::Format InspectionWriter::ParseFormat(std::string_view name) {
+  if (name == "table") return Format::kTable;
+  if (name == "json") return Format::kJson;
+  if (name == "ndjson") return Format::kNdjson;
+  if (name == "csv") return Format::kCsv;
+  throw std::invalid_argument("Unknown output format \"" + std::string(name) +
+                              "\".");
+}
+
+void InspectionWriter::WriteTable(const InspectionResult& result) {
+  if (!result.error.empty()) {
+    out_ << result.path << ": " << result.error << std::endl;
+    return;
+  }
+
+  if (show_path_) {
+    if (count_ != 0) out_ << std::endl;
+    out_ << result.path << ":" << std::endl << std::endl;
+  }
+  const RomHashes& hashes = result.hashes;
+  if (hashes.has(RomHashes::kCrc32))
+    out_ << "CRC32: " << hashes.crc32_hex() << std::endl;
+  if (hashes.has(RomHashes::kSha1))
+    out_ << "SHA-1: " << hashes.sha1_hex() << std::endl;
+  if (hashes.has(RomHashes::kXxh64))
+    out_ << "XXH64: " << hashes.xxh64_hex() << std::endl;
+  if (hashes.types != RomHashes::kNone) out_ << std::endl;
+
+  Saptapper::PrintParam(result.param, result.minigsf, out_);
+
+  if (result.candidates.size() > 1) {
+    using row_t = std::array<std::string, 8>;
+    const row_t header{"Score",           "m4aSoundVSync", "m4aSoundInit",
+                       "m4aSoundMain",    "m4aSongNumStart", "song_table",
+                       "len(song_table)", "OK"};
+    std::vector<row_t> items;
+    for (const auto& candidate : result.candidates) {
+      const Mp2kDriverParam& param = candidate.param;
+      items.push_back(row_t{std::to_string(candidate.score),
+                            to_string(param.vsync_fn()),
+                            to_string(param.init_fn()),
+                            to_string(param.main_fn()),
+                            to_string(param.select_song_fn()),
+                            to_string(param.song_table()),
+                            std::to_string(param.song_count()),
+                            param.ok() ? "yes" : "no"});
+    }
+
+    out_ << std::endl
+         << "Candidates (the first one is chosen):" << std::endl
+         << std::endl;
+    tabulate(out_, header, items);
+  }
+}
+
+void InspectionWriter::WriteJson(const InspectionResult& result) {
+  const auto& param = result.param;
+  const auto& minigsf = result.minigsf;
+
+  out_ << "{\"path\":";
+  WriteJsonString(out_, result.path);
+  out_ << ",\"ok\":" << (result.error.empty() && param.ok() ? "true" : "false");
+  if (!result.error.empty()) {
+    out_ << ",\"error\":";
+    WriteJsonString(out_, result.error);
+    out_ << '}';
+    return;
+  }
+
+  out_ << ",\"game_title\":";
+  WriteJsonString(out_, result.game_title);
+  out_ << ",\"game_code\":";
+  WriteJsonString(out_, result.game_code);
+  WriteJsonHashes(out_, result.hashes);
+  out_ << ',';
+  WriteJsonParam(out_, param);
+  out_ << ",\"minigsf_address\":";
+  WriteJsonAddress(out_, minigsf.address());
+  out_ << ",\"minigsf_size\":" << minigsf.size();
+  out_ << ",\"gsf_driver_address\":";
+  WriteJsonAddress(out_, result.gsf_driver_addr);
+
+  out_ << ",\"free_space\":[";
+  for (std::size_t i = 0; i < result.free_spaces.size(); i++) {
+    const FreeSpace& space = result.free_spaces[i];
+    if (i != 0) out_ << ',';
+    out_ << "{\"address\":";
+    WriteJsonAddress(out_, space.address);
+    out_ << ",\"size\":" << space.size << ",\"filler\":" << filler_value(space)
+         << '}';
+  }
+  out_ << ']';
+
+  out_ << ",\"score\":" << score_of(result) << ",\"alternatives\":[";
+  for (std::size_t i = 1; i < result.candidates.size(); i++) {
+    const Mp2kDriverCandidate& candidate = result.candidates[i];
+    if (i != 1) out_ << ',';
+    out_ << "{\"score\":" << candidate.score
+         << ",\"ok\":" << (candidate.param.ok() ? "true" : "false") << ',';
+    WriteJsonParam(out_, candidate.param);
+    out_ << '}';
+  }
+  out_ << ']';
+
+  out_ << ",\"load_ms\":" << result.load_seconds * 1000
+       << ",\"inspect_ms\":" << result.inspect_seconds * 1000 << '}';
+}
+
+void InspectionWriter::WriteCsv(const InspectionResult& result) {
+  const auto& param = result.param;
+  const auto& minigsf = result.minigsf;
+
+  WriteCsvString(out_, result.path);
+  out_ << ',' << (result.error.empty() && param.ok() ? "true" : "false")
+       << ',';
+  WriteCsvString(out_, result.error);
+  if (!result.error.empty()) {
+    out_ << ",,,,,,,,,,,,,,,,,,,\n";
+    return;
+  }
+
+  out_ << ',';
+  WriteCsvString(out_, result.game_title);
+  out_ << ',';
+  WriteCsvString(out_, result.game_code);
+  for (const agbptr_t addr : {param.vsync_fn(), param.init_fn(),
+                              param.main_fn(), param.select_song_fn(),
+                              param.song_table()}) {
+    out_ << ',';
+    WriteCsvAddress(out_, addr);
+  }
+  out_ << ',' << param.song_count() << ',';
+  WriteCsvAddress(out_, minigsf.address());
+  out_ << ',' << minigsf.size() << ',';
+  WriteCsvAddress(out_, result.gsf_driver_addr);
+
+  // address/size/filler entries separated by semicolons
+  out_ << ',';
+  for (std::size_t i = 0; i < result.free_spaces.size(); i++) {
+    const FreeSpace& space = result.free_spaces[i];
+    if (i != 0) out_ << ';';
+    out_ << to_string(space.address) << '/' << space.size << '/'
+         << filler_value(space);
+  }
+
+  // m4aSongNumStart/score entries separated by semicolons
+  out_ << ',' << score_of(result) << ',';
+  for (std::size_t i = 1; i < result.candidates.size(); i++) {
+    const Mp2kDriverCandidate& candidate = result.candidates[i];
+    if (i != 1) out_ << ';';
+    out_ << to_string(candidate.param.select_song_fn()) << '/'
+         << candidate.score;
+  }
+
+  out_ << ',' << result.load_seconds * 1000 << ','
+       << result.inspect_seconds * 1000;
+
+  const RomHashes& hashes = result.hashes;
+  out_ << ',';
+  if (hashes.has(RomHashes::kCrc32)) out_ << hashes.crc32_hex();
+  out_ << ',';
+  if (hashes.has(RomHashes::kSha1)) out_ << hashes.sha1_hex();
+  out_ << ',';
+  if (hashes.has(RomHashes::kXxh64)) out_ << hashes.xxh64_hex();
+  out_ << '\n';
+}
+
+}  // namespace saptapper
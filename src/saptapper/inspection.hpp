@@ -0,0 +1,79 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_INSPECTION_HPP_
+#define SAPTAPPER_INSPECTION_HPP_
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "minigsf_driver_param.hpp"
+#include "mp2k_driver.hpp"
+#include "mp2k_driver_param.hpp"
+#include "rom_hashes.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+/// A block of filler bytes for the gsf driver block.
+struct FreeSpace {
+  agbptr_t address = agbnullptr;
+  agbsize_t size = 0;
+  char filler = 0;
+};
+
+/// Inspection result of a ROM file.
+struct InspectionResult {
+  std::string path;
+  std::string error;  // empty unless the ROM could not be inspected
+  std::string game_title;
+  std::string game_code;
+  RomHashes hashes;  // the ones requested on load
+  Mp2kDriverParam param;
+  MinigsfDriverParam minigsf;
+  agbptr_t gsf_driver_addr = agbnullptr;
+  std::vector<FreeSpace> free_spaces;
+  std::vector<Mp2kDriverCandidate> candidates;  // best first
+  double load_seconds = 0;
+  double inspect_seconds = 0;
+};
+
+/// Writes inspection results one by one, as soon as each ROM is inspected.
+class InspectionWriter {
+ public:
+  enum class Format { kTable, kJson, kNdjson, kCsv };
+
+  InspectionWriter(std::ostream& out, Format format)
+      : out_{out}, format_{format} {}
+
+  bool show_path() const noexcept { return show_path_; }
+
+  /// Sets whether the table format shows the path of each ROM.
+  void set_show_path(bool show_path) noexcept { show_path_ = show_path; }
+
+  /// Starts the output, such as the CSV header row.
+  void Begin();
+
+  /// Writes a record.
+  void Write(const InspectionResult& result);
+
+  /// Finishes the output, such as the closing bracket of a JSON array.
+  void End();
+
+  /// Parses the name of a format ("table", "json", "ndjson" or "csv").
+  static Format ParseFormat(std::string_view name);
+
+ private:
+  std::ostream& out_;
+  Format format_;
+  std::size_t count_ = 0;
+  bool show_path_ = false;
+
+  void WriteTable(const InspectionResult& result);
+  void WriteJson(const InspectionResult& result);
+  void WriteCsv(const InspectionResult& result);
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,82 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "manifest.hpp"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include "sha1.hpp"
+
+namespace saptapper {
+
+bool Manifest::IsUpToDate(const std::filesystem::path& dir,
+                          const std::string& filename) const {
+  const auto file = files_.find(filename);
+  if (file == files_.end()) return false;
+
+  const std::filesystem::path path{dir / filename};
+  std::error_code ec;
+  if (!is_regular_file(path, ec)) return false;
+  return HashFile(path) == file->second;
+}
+
+std::optional<Manifest> Manifest::LoadFromFile(
+    const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file) return std::nullopt;
+
+  Manifest manifest;
+  std::string line;
+  while (std::getline(file, line)) {
+    const auto separator = line.find('=');
+    if (separator == std::string::npos) return std::nullopt;
+    const std::string key = line.substr(0, separator);
+    const std::string value = line.substr(separator + 1);
+    if (key == "version") {
+      manifest.version_ = value;
+    } else if (key == "input") {
+      manifest.input_ = value;
+    } else if (key == "options") {
+      manifest.options_ = value;
+    } else if (key == "file") {
+      const auto space = value.find(' ');
+      if (space == std::string::npos) return std::nullopt;
+      manifest.files_[value.substr(space + 1)] = value.substr(0, space);
+    }
+  }
+  return manifest;
+}
+
+void Manifest::SaveToFile(const std::filesystem::path& path) const {
+  // Replace the manifest atomically, as it vouches for the other files.
+  std::filesystem::path temp_path{path};
+  temp_path += ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::out | std::ios::binary);
+    file.exceptions(std::ios::badbit | std::ios::failbit);
+    file << "version=" << version_ << '\n'
+         << "input=" << input_ << '\n'
+         << "options=" << options_ << '\n';
+    for (const auto& [filename, sha1] : files_)
+      file << "file=" << sha1 << ' ' << filename << '\n';
+  }
+  rename(temp_path, path);
+}
+
+std::string Manifest::HashFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  file.exceptions(std::ios::badbit);
+
+  Sha1 sha1;
+  std::array<char, 0x10000> buffer;
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    sha1.Update(buffer.data(), static_cast<std::size_t>(file.gcount()));
+  }
+  return Sha1::ToHex(sha1.Finish());
+}
+
+}  // namespace saptapper
@@ -0,0 +1,70 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_MANIFEST_HPP_
+#define SAPTAPPER_MANIFEST_HPP_
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace saptapper {
+
+/// Record of a converted GSF set for incremental re-runs.
+///
+/// The manifest is a text file of key=value lines:
+///
+///   version=<tool version>
+///   input=<SHA-1 of the input ROM>
+///   options=<options which affect the outputs>
+///   file=<SHA-1> <filename>
+class Manifest {
+ public:
+  Manifest() = default;
+
+  Manifest(std::string version, std::string input, std::string options)
+      : version_{std::move(version)},
+        input_{std::move(input)},
+        options_{std::move(options)} {}
+
+  const std::string& version() const noexcept { return version_; }
+  const std::string& input() const noexcept { return input_; }
+  const std::string& options() const noexcept { return options_; }
+
+  /// The SHA-1 of each file, keyed by the filename.
+  const std::map<std::string, std::string>& files() const noexcept {
+    return files_;
+  }
+
+  void set_file(const std::string& filename, const std::string& sha1) {
+    files_[filename] = sha1;
+  }
+
+  /// Tells whether both were made from the same input in the same way.
+  bool SameSourceAs(const Manifest& other) const noexcept {
+    return version_ == other.version_ && input_ == other.input_ &&
+           options_ == other.options_;
+  }
+
+  /// Tells whether the file in the directory is identical to the recorded one.
+  bool IsUpToDate(const std::filesystem::path& dir,
+                  const std::string& filename) const;
+
+  static std::optional<Manifest> LoadFromFile(
+      const std::filesystem::path& path);
+
+  void SaveToFile(const std::filesystem::path& path) const;
+
+  /// Computes the SHA-1 of a file in hexadecimal.
+  static std::string HashFile(const std::filesystem::path& path);
+
+ private:
+  std::string version_;
+  std::string input_;
+  std::string options_;
+  std::map<std::string, std::string> files_;
+};
+
+}  // namespace saptapper
+
+#endif
@@ -2,35 +2,211 @@
 
 #include "mp2k_driver.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <future>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include "algorithm.hpp"
 #include "arm.hpp"
 #include "byte_pattern.hpp"
 #include "bytes.hpp"
 #include "mp2k_driver_param.hpp"
+#include "thread_pool.hpp"
 #include "types.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAPTAPPER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace saptapper {
 
-Mp2kDriverParam Mp2kDriver::Inspect(std::string_view rom) {
-  Mp2kDriverParam param;
-  param.set_select_song_fn(FindSelectSongFn(rom));
+#ifdef SAPTAPPER_USE_SSE2
+static inline unsigned int count_trailing_zeros(std::uint32_t value) {
+  assert(value != 0);
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return static_cast<unsigned int>(index);
+#else
+  return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+}
+#endif
+
+// Scores of the evidence for a driver candidate. The match of
+// m4aSongNumStart scores the number of the bytes equal to the pattern.
+static constexpr int kFoundScore = 5;       // a function is found
+static constexpr int kSongTableScore = 10;  // the song table has a valid song
+static constexpr int kWorkAreaScore = 5;    // gMPlayTable refers to RAM
+static constexpr int kPrologueScore = 2;    // m4aSoundMain calls SoundMain
+static constexpr int kLiteralScore = 3;     // a literal has the known value
+
+static constexpr std::uint32_t kSoundInfoPtr = 0x03007ff0;
+static constexpr std::uint32_t kSoundIdent = 0x68736d53;  // "Smsh"
+
+// Returns the literal loaded by the Thumb instruction "LDR Rd, [PC, #imm]" at
+// the offset, or zero if the instruction is not one.
+static std::uint32_t ReadThumbLiteral(std::string_view rom, agbsize_t offset) {
+  if (offset + 2 > rom.size()) return 0;
+  const thumbins_t ins = ReadInt16L(&rom[offset]);
+  if ((ins & 0xf800) != 0x4800) return 0;
+
+  const agbsize_t literal_pos = ((offset + 4) & ~3) + (ins & 0xff) * 4;
+  if (literal_pos + 4 > rom.size()) return 0;
+  return ReadInt32L(&rom[literal_pos]);
+}
+
+static bool IsRamPointer(std::uint32_t value) {
+  const std::uint32_t region = value >> 24;
+  return region == 0x02 || region == 0x03;
+}
+
+Mp2kDriverParam Mp2kDriver::Inspect(std::string_view rom, bool validate_songs,
+                                    ThreadPool* pool) {
+  return ChooseBest(InspectCandidates(rom, validate_songs, pool));
+}
+
+std::vector<Mp2kDriverCandidate> Mp2kDriver::InspectCandidates(
+    std::string_view rom, bool validate_songs, ThreadPool* pool) {
+  // Large ROMs are scanned and inspected on the pool of the caller, which
+  // pays off even for a single ROM.
+  if (rom.size() < kParallelInspectionSize ||
+      (pool != nullptr && pool->size() < 2))
+    pool = nullptr;
+
+  const std::vector<ScoredAddress> select_song_fns =
+      FindSelectSongFns(rom, pool);
+  std::vector<Mp2kDriverCandidate> candidates(select_song_fns.size());
+  if (pool && select_song_fns.size() > 1) {
+    std::vector<std::future<Mp2kDriverCandidate>> results;
+    results.reserve(select_song_fns.size());
+    for (const ScoredAddress& select_song_fn : select_song_fns) {
+      results.push_back(pool->Async([rom, select_song_fn, validate_songs] {
+        return InspectInstance(rom, select_song_fn, validate_songs);
+      }));
+    }
+    for (std::size_t i = 0; i < results.size(); i++)
+      candidates[i] = results[i].get();
+  } else {
+    for (std::size_t i = 0; i < select_song_fns.size(); i++)
+      candidates[i] = InspectInstance(rom, select_song_fns[i], validate_songs);
+  }
+
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Mp2kDriverCandidate& lhs,
+                      const Mp2kDriverCandidate& rhs) {
+                     if (lhs.param.ok() != rhs.param.ok())
+                       return lhs.param.ok();
+                     return lhs.score > rhs.score;
+                   });
+  return candidates;
+}
+
+Mp2kDriverParam Mp2kDriver::ChooseBest(
+    const std::vector<Mp2kDriverCandidate>& candidates) {
+  return candidates.empty() ? Mp2kDriverParam{} : candidates.front().param;
+}
+
+std::vector<Mp2kDriverParam> Mp2kDriver::InspectAll(std::string_view rom,
+                                                    bool validate_songs,
+                                                    ThreadPool* pool) {
+  return SelectInstances(rom, InspectCandidates(rom, validate_songs, pool));
+}
+
+std::vector<Mp2kDriverParam> Mp2kDriver::SelectInstances(
+    std::string_view rom, const std::vector<Mp2kDriverCandidate>& candidates) {
+  std::vector<Mp2kDriverParam> params;
+  for (const auto& candidate : candidates) {
+    const Mp2kDriverParam& param = candidate.param;
+    if (!param.ok() || !HasValidSongTable(rom, param.song_table())) continue;
+
+    // A loose match next to the real function leads to the same table. The
+    // candidates are ranked, so the best one of them is kept.
+    const bool known = std::any_of(
+        params.begin(), params.end(), [&](const Mp2kDriverParam& other) {
+          return other.song_table() == param.song_table();
+        });
+    if (!known) params.push_back(param);
+  }
+
+  std::sort(params.begin(), params.end(),
+            [](const Mp2kDriverParam& lhs, const Mp2kDriverParam& rhs) {
+              return lhs.select_song_fn() < rhs.select_song_fn();
+            });
+  return params;
+}
+
+Mp2kDriverCandidate Mp2kDriver::InspectInstance(std::string_view rom,
+                                                ScoredAddress select_song_fn,
+                                                bool validate_songs) {
+  Mp2kDriverCandidate best;
+  Mp2kDriverParam& param = best.param;
+  param.set_select_song_fn(select_song_fn.address);
   param.set_song_table(FindSongTable(rom, param.select_song_fn()));
-  param.set_main_fn(FindMainFn(rom, param.select_song_fn()));
-  param.set_init_fn(FindInitFn(rom, param.main_fn()));
-  param.set_vsync_fn(FindVSyncFn(rom, param.init_fn()));
-  param.set_song_count(ReadSongCount(rom, param.song_table()));
-  return param;
+  param.set_song_count(
+      ReadSongCount(rom, param.song_table(), validate_songs));
+  const int base_score =
+      select_song_fn.score +
+      ScoreSongTable(rom, param.select_song_fn(), param.song_table());
+  best.score = base_score;
+
+  // Tries every combination of the found functions. A missing function is
+  // kept as null, so that incomplete results can still be reported. Equal
+  // scores keep the nearest matches, which the finders return first.
+  const auto or_null = [](std::vector<ScoredAddress> addresses) {
+    if (addresses.empty()) addresses.push_back({agbnullptr, 0});
+    return addresses;
+  };
+  bool best_complete = false;
+  bool has_best = false;
+  for (const auto& main_fn :
+       or_null(FindMainFns(rom, param.select_song_fn()))) {
+    for (const auto& init_fn : or_null(FindInitFns(rom, main_fn.address))) {
+      for (const auto& vsync_fn :
+           or_null(FindVSyncFns(rom, init_fn.address))) {
+        const bool complete = main_fn.address != agbnullptr &&
+                              init_fn.address != agbnullptr &&
+                              vsync_fn.address != agbnullptr;
+        const int score =
+            base_score + main_fn.score + init_fn.score + vsync_fn.score;
+        if (has_best && (complete < best_complete ||
+                         (complete == best_complete && score <= best.score)))
+          continue;
+
+        param.set_main_fn(main_fn.address);
+        param.set_init_fn(init_fn.address);
+        param.set_vsync_fn(vsync_fn.address);
+        best.score = score;
+        best_complete = complete;
+        has_best = true;
+      }
+    }
+  }
+  return best;
 }
 
 void Mp2kDriver::InstallGsfDriver(std::string& rom, agbptr_t address,
                                   const Mp2kDriverParam& param) {
+  MakeGsfDriverPatch(rom, address, param).Apply(rom);
+}
+
+RomOverlay Mp2kDriver::MakeGsfDriverPatch(std::string_view rom,
+                                          agbptr_t address,
+                                          const Mp2kDriverParam& param) {
   if (!is_romptr(address))
     throw std::invalid_argument("The gsf driver address is not valid.");
   if (!param.ok()) {
@@ -45,13 +221,20 @@ void Mp2kDriver::InstallGsfDriver(std::string& rom, agbptr_t address,
   if (offset + gsf_driver_size() > rom.size())
     throw std::out_of_range("The address of gsf driver block is out of range.");
 
-  std::memcpy(&rom[offset], gsf_driver_block, gsf_driver_size());
-  WriteInt32L(&rom[offset + kInitFnOffset], param.init_fn() | 1);
-  WriteInt32L(&rom[offset + kSelectSongFnOffset], param.select_song_fn() | 1);
-  WriteInt32L(&rom[offset + kMainFnOffset], param.main_fn() | 1);
-  WriteInt32L(&rom[offset + kVSyncFnOffset], param.vsync_fn() | 1);
+  std::string block(reinterpret_cast<const char*>(gsf_driver_block),
+                    gsf_driver_size());
+  WriteInt32L(&block[kInitFnOffset], param.init_fn() | 1);
+  WriteInt32L(&block[kSelectSongFnOffset], param.select_song_fn() | 1);
+  WriteInt32L(&block[kMainFnOffset], param.main_fn() | 1);
+  WriteInt32L(&block[kVSyncFnOffset], param.vsync_fn() | 1);
 
-  WriteInt32L(rom.data(), make_arm_b(0x8000000, address));
+  std::string branch(4, 0);
+  WriteInt32L(branch.data(), make_arm_b(0x8000000, address));
+
+  RomOverlay overlay;
+  overlay.Add(offset, std::move(block));
+  overlay.Add(0, std::move(branch));
+  return overlay;
 }
 
 int Mp2kDriver::FindIdenticalSong(std::string_view rom, agbptr_t song_table,
@@ -71,35 +254,195 @@ int Mp2kDriver::FindIdenticalSong(std::string_view rom, agbptr_t song_table,
   return kNoSong;
 }
 
-agbptr_t Mp2kDriver::FindInitFn(std::string_view rom, agbptr_t main_fn) {
-  if (main_fn == agbnullptr) return agbnullptr;
+bool Mp2kDriver::IsValidSongHeader(std::string_view rom, agbptr_t song_header) {
+  // struct SongHeader {
+  //   u8 trackCount; u8 blockCount; u8 priority; u8 reverb;
+  //   struct ToneData *tone;
+  //   u8 *part[trackCount];
+  // };
+  if (!is_romptr(song_header)) return false;
+
+  const agbsize_t header_pos = to_offset(song_header);
+  if (header_pos >= rom.size() || rom.size() - header_pos < 4) return false;
+
+  const int track_count = ReadInt8L(&rom[header_pos]);
+  if (track_count == 0) return true;  // empty songs are often used as dummies
+  if (track_count > kMaxTrackCount) return false;
+
+  const agbsize_t header_size = 8 + 4 * track_count;
+  if (rom.size() - header_pos < header_size) return false;
+
+  const agbptr_t tone = ReadInt32L(&rom[header_pos + 4]);
+  if (!is_romptr(tone) || to_offset(tone) >= rom.size()) return false;
+
+  std::array<agbptr_t, kMaxTrackCount> tracks;
+  ReadInt32LArray(&rom[header_pos + 8], tracks.data(), track_count);
+  for (int track = 0; track < track_count; track++) {
+    if (!is_romptr(tracks[track]) || to_offset(tracks[track]) >= rom.size())
+      return false;
+  }
+  return true;
+}
+
+// Returns whether the track may play a note. The events are followed as the
+// driver would, with the patterns and loops visited once. Anything the scan
+// cannot follow, such as MEMACC or a pointer outside the ROM, counts as a
+// note.
+static bool MayPlayNotes(std::string_view rom, agbsize_t pos) {
+  constexpr std::uint8_t kFine = 0xb1;
+  constexpr std::uint8_t kGoto = 0xb2;
+  constexpr std::uint8_t kPatt = 0xb3;
+  constexpr std::uint8_t kPend = 0xb4;
+  constexpr std::uint8_t kRept = 0xb5;
+  constexpr std::uint8_t kPrio = 0xba;
+  constexpr std::uint8_t kVoice = 0xbd;
+  constexpr std::uint8_t kModt = 0xc5;
+  constexpr std::uint8_t kTune = 0xc8;
+  constexpr std::uint8_t kEot = 0xce;
+  constexpr std::uint8_t kTie = 0xcf;
+  constexpr std::size_t kMaxPatternDepth = 3;
+  constexpr int kMaxEvents = 0x10000;
+
+  const auto read_pointer = [&rom](agbsize_t offset) -> agbsize_t {
+    if (offset > rom.size() || rom.size() - offset < 4) return rom.size();
+    const agbptr_t address = ReadInt32L(&rom[offset]);
+    return is_romptr(address) ? to_offset(address) : rom.size();
+  };
+
+  std::vector<agbsize_t> returns;
+  std::vector<agbsize_t> visited_gotos;
+  std::uint8_t running_status = 0;
+  for (int events = 0; events < kMaxEvents; events++) {
+    if (pos >= rom.size()) return true;
+
+    std::uint8_t command = ReadInt8L(&rom[pos]);
+    if (command < 0x80) {
+      // A running status repeats the last command, with this byte as the
+      // first argument.
+      if (running_status == 0) return true;
+      command = running_status;
+    } else {
+      pos++;
+      if (command >= kVoice) running_status = command;
+    }
+
+    if (command >= kTie) return true;
+    if (command < kFine) continue;  // wait
+
+    switch (command) {
+      case kFine:
+        return false;
+
+      case kGoto: {
+        if (std::find(visited_gotos.begin(), visited_gotos.end(), pos) !=
+            visited_gotos.end())
+          return false;
+        visited_gotos.push_back(pos);
+        pos = read_pointer(pos);
+        break;
+      }
+
+      case kPatt:
+      case kRept: {
+        if (command == kRept) pos++;
+        if (returns.size() >= kMaxPatternDepth) return true;
+        returns.push_back(pos + 4);
+        pos = read_pointer(pos);
+        break;
+      }
+
+      case kPend:
+        if (!returns.empty()) {
+          pos = returns.back();
+          returns.pop_back();
+        }
+        break;
+
+      case kEot:
+        // The key is optional.
+        if (pos < rom.size() && ReadInt8L(&rom[pos]) < 0x80) pos++;
+        break;
+
+      default:
+        if ((command >= kPrio && command <= kModt) || command == kTune) {
+          pos++;
+          break;
+        }
+        return true;
+    }
+  }
+  return true;
+}
+
+bool Mp2kDriver::IsSilentSong(std::string_view rom, agbptr_t song_header) {
+  if (!IsValidSongHeader(rom, song_header)) return false;
+
+  const agbsize_t header_pos = to_offset(song_header);
+  const int track_count = ReadInt8L(&rom[header_pos]);
+  for (int track = 0; track < track_count; track++) {
+    const agbptr_t track_ptr = ReadInt32L(&rom[header_pos + 8 + 4 * track]);
+    if (MayPlayNotes(rom, to_offset(track_ptr))) return false;
+  }
+  return true;
+}
+
+std::vector<Mp2kDriver::ScoredAddress> Mp2kDriver::FindInitFns(
+    std::string_view rom, agbptr_t main_fn) {
+  std::vector<ScoredAddress> candidates;
+  if (main_fn == agbnullptr) return candidates;
 
   using namespace std::literals::string_view_literals;
   std::array patterns = {
       "\x70\xb5\x14\x48"sv,  // push {r4-r6,lr}; ldr r0, =(SoundMainRAM+1)
       "\xf0\xb5\x47\x46"sv,  // push {r4-r7,lr}; mov r7, r8
   };
-  return find_backwards(rom, patterns, to_offset(main_fn), 0x100);
-}  // namespace saptapper
+  for (const agbptr_t address : find_backwards_all(
+           rom, patterns, to_offset(main_fn), 0x100, kMaxCandidates)) {
+    // SoundMainRAM is a Thumb function in ROM, copied to IWRAM.
+    const std::uint32_t sound_main_ram =
+        ReadThumbLiteral(rom, to_offset(address) + 2);
+    const bool is_thumb_fn = is_romptr(sound_main_ram & ~1u) &&
+                             (sound_main_ram & 1) != 0;
+    candidates.push_back(
+        {address, kFoundScore + (is_thumb_fn ? kLiteralScore : 0)});
+  }
+  return candidates;
+}
 
-agbptr_t Mp2kDriver::FindMainFn(std::string_view rom, agbptr_t select_song_fn) {
-  if (select_song_fn == agbnullptr) return agbnullptr;
+std::vector<Mp2kDriver::ScoredAddress> Mp2kDriver::FindMainFns(
+    std::string_view rom, agbptr_t select_song_fn) {
+  std::vector<ScoredAddress> candidates;
+  if (select_song_fn == agbnullptr) return candidates;
 
   using namespace std::literals::string_view_literals;
   std::array patterns{"\x00\xb5"sv};  // push lr
-  return find_backwards(rom, patterns, to_offset(select_song_fn), 0x20);
+  for (const agbptr_t address : find_backwards_all(
+           rom, patterns, to_offset(select_song_fn), 0x20, kMaxCandidates)) {
+    // m4aSoundMain calls SoundMain right after the push.
+    bool calls = false;
+    for (agbsize_t offset = to_offset(address) + 2;
+         offset < to_offset(address) + 8 && offset + 2 <= rom.size();
+         offset += 2) {
+      if ((ReadInt16L(&rom[offset]) & 0xf800) == 0xf000) calls = true;
+    }
+    candidates.push_back(
+        {address, kFoundScore + (calls ? kPrologueScore : 0)});
+  }
+  return candidates;
 }
 
-agbptr_t Mp2kDriver::FindVSyncFn(std::string_view rom, agbptr_t init_fn) {
-  if (init_fn == agbnullptr) return agbnullptr;
+std::vector<Mp2kDriver::ScoredAddress> Mp2kDriver::FindVSyncFns(
+    std::string_view rom, agbptr_t init_fn) {
+  std::vector<ScoredAddress> candidates;
+  if (init_fn == agbnullptr) return candidates;
 
-  using namespace std::literals::string_view_literals;
   // LDR     R0, =dword_3007FF0
   // LDR     R0, [R0]
   // LDR     R2, =0x68736D53
   // LDR     R3, [R0]
   // SUBS (later versions) or CMP (earlier versions, such as Momotarou Matsuri)
-  const BytePattern pattern{"\xa6\x48\x00\x68\xa6\x4a\x03\x68"sv, "?xxx?xxx"sv};
+  static constexpr StaticBytePattern pattern{
+      "\xa6\x48\x00\x68\xa6\x4a\x03\x68", "?xxx?xxx"};
 
   // Pattern for Puyo Pop Fever, Precure, etc.:
   //
@@ -108,25 +451,31 @@ agbptr_t Mp2kDriver::FindVSyncFn(std::string_view rom, agbptr_t init_fn) {
   // LDR     R2, [R0]
   // LDR     R0, [R2]
   // LDR     R1, =0x978C92AD
-  const BytePattern pattern2{"\x00\xb5\x18\x48\x02\x68\x10\x68\x17\x49"sv,
-                             "xx?xxxxx?x"sv};
+  static constexpr StaticBytePattern pattern2{
+      "\x00\xb5\x18\x48\x02\x68\x10\x68\x17\x49", "xx?xxxxx?x"};
 
   const agbsize_t init_fn_pos = to_offset(init_fn);
-  if (init_fn_pos >= rom.size()) return agbnullptr;
+  if (init_fn_pos >= rom.size()) return candidates;
 
   // The m4aSoundVSync function is far from m4aSoundInit.
   constexpr agbsize_t length =
       0x1800;  // 0x1000 might be good, but longer is safer anyway :)
   constexpr agbsize_t align = 4;
   assert(length % align == 0);
-  if (rom.size() < length) return agbnullptr;
+  if (rom.size() < length) return candidates;
+
+  const auto literal_score = [&](agbsize_t offset, std::uint32_t value) {
+    return ReadThumbLiteral(rom, offset) == value ? kLiteralScore : 0;
+  };
 
   // Regular version:
   //
   // Search backwards from m4aSoundInit function.
-  const agbsize_t max_pos = init_fn_pos - align;
-  const agbsize_t min_pos = init_fn_pos - std::min<agbsize_t>(length, init_fn_pos);
-  for (agbsize_t offset = max_pos; offset >= min_pos; offset -= align) {
+  const agbsize_t max_distance = std::min<agbsize_t>(length, init_fn_pos);
+  for (agbsize_t distance = align;
+       distance <= max_distance && candidates.size() < kMaxCandidates;
+       distance += align) {
+    const agbsize_t offset = init_fn_pos - distance;
     if (pattern.Match(rom, offset)) {
       // Momotarou Matsuri, Puyo Pop Fever:
       // check "BX LR" and avoid false-positive
@@ -135,7 +484,9 @@ agbptr_t Mp2kDriver::FindVSyncFn(std::string_view rom, agbptr_t init_fn) {
         continue;
       }
 
-      return to_romptr(offset);
+      candidates.push_back({to_romptr(offset),
+                            kFoundScore + literal_score(offset, kSoundInfoPtr) +
+                                literal_score(offset + 4, kSoundIdent)});
     }
   }
 
@@ -145,21 +496,43 @@ agbptr_t Mp2kDriver::FindVSyncFn(std::string_view rom, agbptr_t init_fn) {
   const agbsize_t min_pos2 = init_fn_pos + align;
   const agbsize_t max_pos2 = std::min<agbsize_t>(
       init_fn_pos + length, static_cast<agbsize_t>(rom.size()));
-  for (agbsize_t offset = min_pos2; offset < max_pos2; offset += align) {
-    if (pattern2.Match(rom, offset))
-      return to_romptr(offset);
+  for (agbsize_t offset = min_pos2;
+       offset < max_pos2 && candidates.size() < kMaxCandidates;
+       offset += align) {
+    if (pattern2.Match(rom, offset)) {
+      candidates.push_back(
+          {to_romptr(offset),
+           kFoundScore + literal_score(offset + 2, kSoundInfoPtr)});
+    }
   }
 
-  return agbnullptr;
+  return candidates;
 }
 
-agbptr_t Mp2kDriver::FindSelectSongFn(std::string_view rom) {
-  using namespace std::literals::string_view_literals;
-  const std::string_view pattern{
-      "\x00\xb5\x00\x04\x07\x4a\x08\x49\x40\x0b"sv
-      "\x40\x18\x83\x88\x59\x00\xc9\x18\x89\x00"sv
-      "\x89\x18\x0a\x68\x01\x68\x10\x1c\x00\xf0"sv};
-  return find_loose(rom, pattern, 8);
+// m4aSongNumStart
+static constexpr std::string_view kSelectSongFnPattern{
+    "\x00\xb5\x00\x04\x07\x4a\x08\x49\x40\x0b"
+    "\x40\x18\x83\x88\x59\x00\xc9\x18\x89\x00"
+    "\x89\x18\x0a\x68\x01\x68\x10\x1c\x00\xf0",
+    30};
+static constexpr unsigned int kSelectSongFnMaxDiff = 8;
+
+std::vector<Mp2kDriver::ScoredAddress> Mp2kDriver::FindSelectSongFns(
+    std::string_view rom, ThreadPool* pool) {
+  const std::vector<agbptr_t> matches =
+      pool != nullptr ? find_loose_all(rom, kSelectSongFnPattern,
+                                       kSelectSongFnMaxDiff, 0, *pool)
+                      : find_loose_all(rom, kSelectSongFnPattern,
+                                       kSelectSongFnMaxDiff);
+  std::vector<ScoredAddress> candidates;
+  for (const agbptr_t address : matches) {
+    const unsigned int diff =
+        count_mismatches(&rom[to_offset(address)], kSelectSongFnPattern.data(),
+                         kSelectSongFnPattern.size());
+    candidates.push_back(
+        {address, static_cast<int>(kSelectSongFnPattern.size() - diff)});
+  }
+  return candidates;
 }
 
 agbptr_t Mp2kDriver::FindSongTable(std::string_view rom,
@@ -176,21 +549,88 @@ agbptr_t Mp2kDriver::FindSongTable(std::string_view rom,
   return song_table;
 }
 
-int Mp2kDriver::ReadSongCount(std::string_view rom, agbptr_t song_table) {
+int Mp2kDriver::ScoreSongTable(std::string_view rom, agbptr_t select_song_fn,
+                               agbptr_t song_table) {
+  int score = 0;
+  if (HasValidSongTable(rom, song_table)) score += kSongTableScore;
+
+  // ldr r2, =gMPlayTable, whose entries start with a MusicPlayerInfo in RAM.
+  if (select_song_fn != agbnullptr) {
+    const std::uint32_t mplay_table =
+        ReadThumbLiteral(rom, to_offset(select_song_fn) + 4);
+    if (is_romptr(mplay_table) && to_offset(mplay_table) + 4 <= rom.size() &&
+        IsRamPointer(ReadInt32L(&rom[to_offset(mplay_table)])))
+      score += kWorkAreaScore;
+  }
+  return score;
+}
+
+bool Mp2kDriver::HasValidSongTable(std::string_view rom, agbptr_t song_table) {
+  if (song_table == agbnullptr) return false;
+
+  const agbsize_t song_table_pos = to_offset(song_table);
+  if (song_table_pos + kSongEntrySize > rom.size()) return false;
+  return IsValidSongHeader(rom, ReadInt32L(&rom[song_table_pos]));
+}
+
+int Mp2kDriver::ReadSongCount(std::string_view rom, agbptr_t song_table,
+                              bool validate_songs) {
   if (song_table == agbnullptr) return 0;
 
   const agbsize_t song_table_pos = to_offset(song_table);
-  if (rom.size() < 8) return 0;
-  if (song_table_pos > rom.size() - 8) return 0;
+  if (rom.size() < kSongEntrySize) return 0;
+  if (song_table_pos > rom.size() - kSongEntrySize) return 0;
+
+  const agbsize_t song_count = CountSongEntries(rom, song_table_pos);
+  if (!validate_songs) return static_cast<int>(song_count);
+
+  // Reject the entries that merely look like ROM pointers. A malformed table
+  // may otherwise run through unrelated data until the end of the ROM.
+  for (agbsize_t song = 0; song < song_count; song++) {
+    const agbsize_t offset = song_table_pos + song * kSongEntrySize;
+    if (!IsValidSongHeader(rom, ReadInt32L(&rom[offset])))
+      return static_cast<int>(song);
+  }
+  return static_cast<int>(song_count);
+}
+
+agbsize_t Mp2kDriver::CountSongEntries(std::string_view rom, agbsize_t pos) {
+  // Counts the run of song table entries whose first word is a ROM pointer.
+  // A word is a ROM pointer if and only if its high byte is 0x08 or 0x09.
+  const agbsize_t start_pos = pos;
+
+#ifdef SAPTAPPER_USE_SSE2
+  // Tests four entries (two per 16-byte load) at once. The high byte of each
+  // pointer is at lanes 3 and 11 of the loaded vector.
+  constexpr agbsize_t kBlockSize = 4 * kSongEntrySize;
+  constexpr std::uint32_t kPointerLanes = 0x08080808;
+  const __m128i high_mask = _mm_set1_epi8(static_cast<char>(0xfe));
+  const __m128i high_byte = _mm_set1_epi8(0x08);
+  while (rom.size() - pos >= kBlockSize) {
+    const __m128i v0 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(rom.data() + pos));
+    const __m128i v1 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(rom.data() + pos + 16));
+    const __m128i m0 = _mm_cmpeq_epi8(_mm_and_si128(v0, high_mask), high_byte);
+    const __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(v1, high_mask), high_byte);
+    const std::uint32_t matches =
+        static_cast<std::uint32_t>(_mm_movemask_epi8(m0)) |
+        (static_cast<std::uint32_t>(_mm_movemask_epi8(m1)) << 16);
+    const std::uint32_t failures = ~matches & kPointerLanes;
+    if (failures != 0) {
+      const agbsize_t lane = count_trailing_zeros(failures) / kSongEntrySize;
+      return (pos - start_pos) / kSongEntrySize + lane;
+    }
+    pos += kBlockSize;
+  }
+#endif
 
-  int song_count = 0;
-  for (agbsize_t offset = song_table_pos; offset <= rom.size() - 8;
-       offset += 8) {
-    const agbptr_t song = ReadInt32L(&rom[offset]);
+  while (rom.size() - pos >= kSongEntrySize) {
+    const agbptr_t song = ReadInt32L(&rom[pos]);
     if (!is_romptr(song)) break;
-    song_count++;
+    pos += kSongEntrySize;
   }
-  return song_count;
+  return (pos - start_pos) / kSongEntrySize;
 }
 
 }  // namespace saptapper
@@ -3,13 +3,23 @@
 #ifndef SAPTAPPER_MP2K_DRIVER_HPP_
 #define SAPTAPPER_MP2K_DRIVER_HPP_
 
+#include <cstddef>
 #include <string>
 #include <string_view>
+#include <vector>
 #include "mp2k_driver_param.hpp"
+#include "rom_overlay.hpp"
+#include "thread_pool.hpp"
 #include "types.hpp"
 
 namespace saptapper {
 
+/// A driver parameter set, scored by how well its parts agree with each other.
+struct Mp2kDriverCandidate {
+  Mp2kDriverParam param;
+  int score = 0;
+};
+
 class Mp2kDriver {
  public:
   Mp2kDriver() = delete;
@@ -28,14 +38,60 @@ class Mp2kDriver {
 
   static std::string name() { return "MusicPlayer2000"; }
 
-  static Mp2kDriverParam Inspect(std::string_view rom);
+  /// Returns the best candidate of InspectCandidates.
+  static Mp2kDriverParam Inspect(std::string_view rom,
+                                 bool validate_songs = false,
+                                 ThreadPool* pool = nullptr);
+
+  /// Returns the candidates for each m4aSongNumStart match, best first.
+  ///
+  /// Each finder collects several matches, which are scored by the pattern
+  /// distance, the prologues of the functions and the consistency of their
+  /// references to the song table and the work area. Each candidate holds the
+  /// best-scoring combination for its m4aSongNumStart. Complete candidates
+  /// are ranked before incomplete ones, and equal scores keep the ROM order.
+  ///
+  /// ROMs of kParallelInspectionSize or more are scanned on the pool, if one
+  /// is given. Callers which already run in parallel pass none.
+  static std::vector<Mp2kDriverCandidate> InspectCandidates(
+      std::string_view rom, bool validate_songs = false,
+      ThreadPool* pool = nullptr);
+
+  /// Returns the best complete candidate, or the best partial one for error
+  /// reports if none is complete.
+  static Mp2kDriverParam ChooseBest(
+      const std::vector<Mp2kDriverCandidate>& candidates);
+
+  /// Finds all driver instances of the ROM, such as the ones of compilation
+  /// cartridges, in one pass. Only the complete instances that refer to a
+  /// valid song table are returned, in the order of their m4aSongNumStart
+  /// functions.
+  static std::vector<Mp2kDriverParam> InspectAll(std::string_view rom,
+                                                 bool validate_songs = false,
+                                                 ThreadPool* pool = nullptr);
+
+  /// Returns the instances of InspectAll out of the candidates.
+  static std::vector<Mp2kDriverParam> SelectInstances(
+      std::string_view rom,
+      const std::vector<Mp2kDriverCandidate>& candidates);
 
   static void InstallGsfDriver(std::string& rom, agbptr_t address,
                                const Mp2kDriverParam& param);
 
+  /// Returns the patches of InstallGsfDriver, without modifying the ROM.
+  static RomOverlay MakeGsfDriverPatch(std::string_view rom, agbptr_t address,
+                                       const Mp2kDriverParam& param);
+
   static int FindIdenticalSong(std::string_view rom, agbptr_t song_table,
                                int song);
 
+  static bool IsValidSongHeader(std::string_view rom, agbptr_t song_header);
+
+  /// Returns true if the song plays no note for sure: it has no tracks, or
+  /// each track ends without a note. A song which cannot be followed to the
+  /// end is not silent.
+  static bool IsSilentSong(std::string_view rom, agbptr_t song_header);
+
  private:
   static constexpr agbsize_t kInitFnOffset = 0xd8;
   static constexpr agbsize_t kSelectSongFnOffset = 0xdc;
@@ -43,6 +99,20 @@ class Mp2kDriver {
   static constexpr agbsize_t kVSyncFnOffset = 0xe4;
   static constexpr agbsize_t kSongNumberOffset = 0xe8;
 
+  static constexpr agbsize_t kSongEntrySize = 8;
+  static constexpr int kMaxTrackCount = 16;
+
+  /// The number of matches kept for each function.
+  static constexpr std::size_t kMaxCandidates = 4;
+
+  /// The ROM size from which the candidates are evaluated in parallel.
+  static constexpr std::size_t kParallelInspectionSize = 0x800000;
+
+  struct ScoredAddress {
+    agbptr_t address;
+    int score;
+  };
+
   static constexpr unsigned char gsf_driver_block[244] = {
       0x01, 0x10, 0x8F, 0xE2, 0x11, 0xFF, 0x2F, 0xE1, 0x02, 0xA0, 0x01, 0x68,
       0x04, 0x30, 0x0A, 0x0E, 0xFB, 0xD1, 0x1F, 0xE0, 0x53, 0x61, 0x70, 0x70,
@@ -66,12 +136,25 @@ class Mp2kDriver {
       0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x2B, 0x00, 0xD0,
       0x18, 0x47, 0x70, 0x47};
 
-  static agbptr_t FindInitFn(std::string_view rom, agbptr_t main_fn);
-  static agbptr_t FindMainFn(std::string_view rom, agbptr_t select_song_fn);
-  static agbptr_t FindVSyncFn(std::string_view rom, agbptr_t init_fn);
-  static agbptr_t FindSelectSongFn(std::string_view rom);
+  static Mp2kDriverCandidate InspectInstance(std::string_view rom,
+                                             ScoredAddress select_song_fn,
+                                             bool validate_songs);
+
+  static std::vector<ScoredAddress> FindInitFns(std::string_view rom,
+                                                agbptr_t main_fn);
+  static std::vector<ScoredAddress> FindMainFns(std::string_view rom,
+                                                agbptr_t select_song_fn);
+  static std::vector<ScoredAddress> FindVSyncFns(std::string_view rom,
+                                                 agbptr_t init_fn);
+  static std::vector<ScoredAddress> FindSelectSongFns(
+      std::string_view rom, ThreadPool* pool = nullptr);
   static agbptr_t FindSongTable(std::string_view rom, agbptr_t select_song_fn);
-  static int ReadSongCount(std::string_view rom, agbptr_t song_table);
+  static int ScoreSongTable(std::string_view rom, agbptr_t select_song_fn,
+                            agbptr_t song_table);
+  static bool HasValidSongTable(std::string_view rom, agbptr_t song_table);
+  static int ReadSongCount(std::string_view rom, agbptr_t song_table,
+                           bool validate_songs = false);
+  static agbsize_t CountSongEntries(std::string_view rom, agbsize_t pos);
 };
 
 }  // namespace saptapper
@@ -0,0 +1,838 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "optimal_deflater.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#include "thread_pool.hpp"
+
+namespace saptapper {
+
+namespace {
+
+constexpr int kMinMatch = 3;
+constexpr int kMaxMatch = 258;
+constexpr std::size_t kWindowSize = 0x8000;
+constexpr int kMaxChainLength = 1024;
+constexpr int kHashBits = 15;
+constexpr std::uint32_t kNoPosition = std::numeric_limits<std::uint32_t>::max();
+constexpr std::size_t kMaxStoredSize = 0xffff;
+
+// Stop iterating when the parse has not improved for this many iterations.
+constexpr int kMaxStagnation = 3;
+
+constexpr int kEndOfBlock = 256;
+constexpr int kNumLitLenSymbols = 286;
+constexpr int kNumDistSymbols = 30;
+constexpr int kNumCodeLengthSymbols = 19;
+constexpr int kMaxBits = 15;
+constexpr int kMaxCodeLengthBits = 7;
+
+constexpr std::array<std::uint16_t, 29> kLengthBase{
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<std::uint8_t, 29> kLengthExtraBits{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<std::uint16_t, 30> kDistBase{
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<std::uint8_t, 30> kDistExtraBits{
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr std::array<std::uint8_t, kNumCodeLengthSymbols> kCodeLengthOrder{
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+constexpr std::array<std::uint8_t, 3> kRepeatExtraBits{2, 3, 7};
+
+// Length symbols, without the offset of 257.
+const std::array<std::uint8_t, kMaxMatch + 1> kLengthSymbols = [] {
+  std::array<std::uint8_t, kMaxMatch + 1> symbols{};
+  for (int symbol = 0; symbol < 29; symbol++) {
+    const int end = symbol + 1 < 29 ? kLengthBase[symbol + 1] : kMaxMatch + 1;
+    for (int length = kLengthBase[symbol]; length < end; length++)
+      symbols[length] = static_cast<std::uint8_t>(symbol);
+  }
+  return symbols;
+}();
+
+const std::array<std::uint8_t, kWindowSize + 1> kDistSymbols = [] {
+  std::array<std::uint8_t, kWindowSize + 1> symbols{};
+  for (int symbol = 0; symbol < kNumDistSymbols; symbol++) {
+    const int end = symbol + 1 < kNumDistSymbols ? kDistBase[symbol + 1]
+                                                 : kWindowSize + 1;
+    for (int distance = kDistBase[symbol]; distance < end; distance++)
+      symbols[distance] = static_cast<std::uint8_t>(symbol);
+  }
+  return symbols;
+}();
+
+// The lengths tried by the shortest path search. The cost of a length only
+// changes at the boundaries of the length symbols, so the long lengths in the
+// middle of a symbol range are skipped.
+const std::array<bool, kMaxMatch + 1> kLengthCandidates = [] {
+  std::array<bool, kMaxMatch + 1> candidates{};
+  for (int length = kMinMatch; length <= kMaxMatch; length++) {
+    const int symbol = kLengthSymbols[length];
+    const bool symbol_end =
+        length == kMaxMatch || kLengthSymbols[length + 1] != symbol;
+    candidates[length] = kLengthExtraBits[symbol] <= 2 ||
+                         length == kLengthBase[symbol] || symbol_end;
+  }
+  return candidates;
+}();
+
+struct Match {
+  std::uint16_t length;
+  std::uint16_t distance;
+};
+
+/// A literal (distance 0) or a match.
+struct Symbol {
+  std::uint16_t litlen;
+  std::uint16_t distance;
+
+  std::size_t size() const noexcept { return distance != 0 ? litlen : 1; }
+};
+
+struct SymbolStats {
+  std::array<std::uint32_t, kNumLitLenSymbols> litlen{};
+  std::array<std::uint32_t, kNumDistSymbols> dist{};
+
+  SymbolStats() = default;
+
+  explicit SymbolStats(const std::vector<Symbol>& symbols) {
+    for (const Symbol& symbol : symbols) {
+      if (symbol.distance == 0) {
+        litlen[symbol.litlen]++;
+      } else {
+        litlen[257 + kLengthSymbols[symbol.litlen]]++;
+        dist[kDistSymbols[symbol.distance]]++;
+      }
+    }
+    litlen[kEndOfBlock] = 1;
+  }
+
+  /// Adds the symbols of another block, which shares the end of block.
+  void Add(const SymbolStats& other) {
+    for (int symbol = 0; symbol < kNumLitLenSymbols; symbol++)
+      litlen[symbol] += other.litlen[symbol];
+    for (int symbol = 0; symbol < kNumDistSymbols; symbol++)
+      dist[symbol] += other.dist[symbol];
+    litlen[kEndOfBlock] = 1;
+  }
+};
+
+/// Estimated bit costs of the symbols, including the extra bits.
+struct CostModel {
+  std::array<float, 256> literal;
+  std::array<float, kMaxMatch + 1> length;
+  std::array<float, kNumDistSymbols> dist;
+
+  float distance(int distance) const noexcept {
+    return dist[kDistSymbols[distance]];
+  }
+
+  /// Takes the costs from the entropy of the statistics.
+  static CostModel FromStats(const SymbolStats& stats) {
+    const auto entropy = [](const auto& counts, int symbol) {
+      std::uint64_t total = 0;
+      for (const auto count : counts) total += count;
+      const double log2_total = std::log2(static_cast<double>(total));
+      return static_cast<float>(
+          counts[symbol] != 0 ? log2_total - std::log2(counts[symbol])
+                              : log2_total);
+    };
+
+    CostModel model;
+    for (int byte = 0; byte < 256; byte++)
+      model.literal[byte] = entropy(stats.litlen, byte);
+    std::array<float, 29> length_symbols;
+    for (int symbol = 0; symbol < 29; symbol++)
+      length_symbols[symbol] =
+          entropy(stats.litlen, 257 + symbol) + kLengthExtraBits[symbol];
+    for (int length = kMinMatch; length <= kMaxMatch; length++)
+      model.length[length] = length_symbols[kLengthSymbols[length]];
+    for (int symbol = 0; symbol < kNumDistSymbols; symbol++)
+      model.dist[symbol] = entropy(stats.dist, symbol) + kDistExtraBits[symbol];
+    return model;
+  }
+
+  /// Takes the costs from the fixed Huffman codes.
+  static CostModel Fixed() {
+    CostModel model;
+    for (int byte = 0; byte < 256; byte++)
+      model.literal[byte] = byte < 144 ? 8.0f : 9.0f;
+    for (int length = kMinMatch; length <= kMaxMatch; length++) {
+      const int symbol = kLengthSymbols[length];
+      model.length[length] =
+          (257 + symbol < 280 ? 7.0f : 8.0f) + kLengthExtraBits[symbol];
+    }
+    for (int symbol = 0; symbol < kNumDistSymbols; symbol++)
+      model.dist[symbol] = 5.0f + kDistExtraBits[symbol];
+    return model;
+  }
+};
+
+class BitWriter {
+ public:
+  const std::string& bytes() const noexcept { return bytes_; }
+  std::size_t bit_size() const noexcept { return bytes_.size() * 8 + count_; }
+
+  void Write(std::uint32_t bits, int count) {
+    buffer_ |= static_cast<std::uint64_t>(bits) << count_;
+    count_ += count;
+    while (count_ >= 8) {
+      bytes_.push_back(static_cast<char>(buffer_ & 0xff));
+      buffer_ >>= 8;
+      count_ -= 8;
+    }
+  }
+
+  void AlignToByte() {
+    if (count_ != 0) Write(0, 8 - count_);
+  }
+
+  void WriteBytes(std::string_view bytes) {
+    if (count_ == 0) {
+      bytes_.append(bytes);
+    } else {
+      for (const char c : bytes) Write(static_cast<std::uint8_t>(c), 8);
+    }
+  }
+
+
+ private:
+  std::string bytes_;
+  std::uint64_t buffer_ = 0;
+  int count_ = 0;
+};
+
+/// Returns the lengths of the Huffman codes, limited to max_bits.
+std::vector<std::uint8_t> BuildCodeLengths(const std::uint32_t* counts,
+                                           int symbol_count, int max_bits) {
+  std::vector<std::uint8_t> lengths(symbol_count, 0);
+  std::vector<int> symbols;
+  for (int symbol = 0; symbol < symbol_count; symbol++)
+    if (counts[symbol] != 0) symbols.push_back(symbol);
+  if (symbols.empty()) return lengths;
+  if (symbols.size() == 1) {
+    lengths[symbols[0]] = 1;
+    return lengths;
+  }
+
+  // The rarest symbols come first.
+  std::stable_sort(symbols.begin(), symbols.end(),
+                   [&](int a, int b) { return counts[a] < counts[b]; });
+
+  // Two-queue Huffman construction: the internal nodes are created in
+  // nondecreasing order of weight, after the leaves.
+  const std::size_t leaf_count = symbols.size();
+  const std::size_t node_count = leaf_count * 2 - 1;
+  std::vector<std::uint64_t> weights(node_count);
+  std::vector<std::size_t> parents(node_count);
+  for (std::size_t i = 0; i < leaf_count; i++) weights[i] = counts[symbols[i]];
+  std::size_t next_leaf = 0;
+  std::size_t next_node = leaf_count;
+  for (std::size_t node = leaf_count; node < node_count; node++) {
+    const auto take = [&] {
+      if (next_leaf < leaf_count &&
+          (next_node >= node || weights[next_leaf] <= weights[next_node]))
+        return next_leaf++;
+      return next_node++;
+    };
+    const std::size_t a = take();
+    const std::size_t b = take();
+    weights[node] = weights[a] + weights[b];
+    parents[a] = parents[b] = node;
+  }
+
+  std::vector<int> depths(node_count, 0);
+  for (std::size_t node = node_count - 1; node-- > 0;)
+    depths[node] = depths[parents[node]] + 1;
+
+  bool overflow = false;
+  for (std::size_t i = 0; i < leaf_count; i++) {
+    overflow |= depths[i] > max_bits;
+    lengths[symbols[i]] =
+        static_cast<std::uint8_t>(std::min(depths[i], max_bits));
+  }
+  if (!overflow) return lengths;
+
+  // Clamping made the code oversubscribed. Lengthen the codes of the rarest
+  // symbols until it fits, then shorten the codes of the most frequent
+  // symbols to make the code complete again.
+  const std::uint32_t capacity = 1u << max_bits;
+  std::uint32_t kraft = 0;
+  for (const int symbol : symbols) kraft += 1u << (max_bits - lengths[symbol]);
+  while (kraft > capacity) {
+    for (const int symbol : symbols) {
+      if (lengths[symbol] < max_bits) {
+        lengths[symbol]++;
+        kraft -= 1u << (max_bits - lengths[symbol]);
+        break;
+      }
+    }
+  }
+  while (kraft < capacity) {
+    for (auto it = symbols.rbegin(); it != symbols.rend(); ++it) {
+      const std::uint32_t increase = 1u << (max_bits - lengths[*it]);
+      if (lengths[*it] > 1 && increase <= capacity - kraft) {
+        lengths[*it]--;
+        kraft += increase;
+        break;
+      }
+    }
+  }
+  return lengths;
+}
+
+/// Returns the canonical codes of the lengths, bit-reversed for writing.
+std::vector<std::uint16_t> BuildCodes(
+    const std::vector<std::uint8_t>& lengths) {
+  std::array<std::uint16_t, kMaxBits + 1> length_counts{};
+  for (const auto length : lengths) length_counts[length]++;
+  length_counts[0] = 0;
+
+  std::array<std::uint16_t, kMaxBits + 1> next_code{};
+  std::uint16_t code = 0;
+  for (int bits = 1; bits <= kMaxBits; bits++) {
+    code = static_cast<std::uint16_t>((code + length_counts[bits - 1]) << 1);
+    next_code[bits] = code;
+  }
+
+  std::vector<std::uint16_t> codes(lengths.size(), 0);
+  for (std::size_t symbol = 0; symbol < lengths.size(); symbol++) {
+    const int length = lengths[symbol];
+    if (length == 0) continue;
+    const std::uint16_t value = next_code[length]++;
+    std::uint16_t reversed = 0;
+    for (int bit = 0; bit < length; bit++)
+      reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+    codes[symbol] = reversed;
+  }
+  return codes;
+}
+
+struct HuffmanTrees {
+  std::vector<std::uint8_t> litlen_lengths;
+  std::vector<std::uint16_t> litlen_codes;
+  std::vector<std::uint8_t> dist_lengths;
+  std::vector<std::uint16_t> dist_codes;
+
+  /// The bits of the symbols in the stats, including the end of block.
+  std::size_t DataBits(const SymbolStats& stats) const {
+    std::size_t bits = 0;
+    for (int symbol = 0; symbol < kNumLitLenSymbols; symbol++) {
+      const int extra = symbol > 256 ? kLengthExtraBits[symbol - 257] : 0;
+      bits += std::size_t{stats.litlen[symbol]} *
+              (litlen_lengths[symbol] + extra);
+    }
+    for (int symbol = 0; symbol < kNumDistSymbols; symbol++) {
+      bits += std::size_t{stats.dist[symbol]} *
+              (dist_lengths[symbol] + kDistExtraBits[symbol]);
+    }
+    return bits;
+  }
+
+  void WriteSymbols(BitWriter& out, const std::vector<Symbol>& symbols) const {
+    for (const Symbol& symbol : symbols) {
+      if (symbol.distance == 0) {
+        out.Write(litlen_codes[symbol.litlen], litlen_lengths[symbol.litlen]);
+        continue;
+      }
+
+      const int length_symbol = kLengthSymbols[symbol.litlen];
+      out.Write(litlen_codes[257 + length_symbol],
+                litlen_lengths[257 + length_symbol]);
+      out.Write(symbol.litlen - kLengthBase[length_symbol],
+                kLengthExtraBits[length_symbol]);
+
+      const int dist_symbol = kDistSymbols[symbol.distance];
+      out.Write(dist_codes[dist_symbol], dist_lengths[dist_symbol]);
+      out.Write(symbol.distance - kDistBase[dist_symbol],
+                kDistExtraBits[dist_symbol]);
+    }
+  }
+
+  void WriteEndOfBlock(BitWriter& out) const {
+    out.Write(litlen_codes[kEndOfBlock], litlen_lengths[kEndOfBlock]);
+  }
+
+  static HuffmanTrees Fixed() {
+    HuffmanTrees trees;
+    trees.litlen_lengths.resize(288);
+    for (int symbol = 0; symbol < 288; symbol++) {
+      trees.litlen_lengths[symbol] =
+          symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+    }
+    trees.dist_lengths.assign(kNumDistSymbols, 5);
+    trees.litlen_codes = BuildCodes(trees.litlen_lengths);
+    trees.dist_codes = BuildCodes(trees.dist_lengths);
+    return trees;
+  }
+};
+
+/// Huffman trees of a dynamic block and the encoding of their lengths.
+struct DynamicTrees : HuffmanTrees {
+  struct Token {
+    std::uint8_t symbol;
+    std::uint8_t extra;
+  };
+
+  int hlit = 0;
+  int hdist = 0;
+  int hclen = 0;
+  std::vector<Token> tokens;
+  std::vector<std::uint8_t> code_length_lengths;
+  std::vector<std::uint16_t> code_length_codes;
+
+  explicit DynamicTrees(const SymbolStats& stats) {
+    litlen_lengths =
+        BuildCodeLengths(stats.litlen.data(), kNumLitLenSymbols, kMaxBits);
+    dist_lengths =
+        BuildCodeLengths(stats.dist.data(), kNumDistSymbols, kMaxBits);
+
+    // Some decoders reject a distance tree with less than two codes.
+    const auto used_dists =
+        std::count_if(dist_lengths.begin(), dist_lengths.end(),
+                      [](std::uint8_t length) { return length != 0; });
+    if (used_dists == 0) {
+      dist_lengths[0] = dist_lengths[1] = 1;
+    } else if (used_dists == 1) {
+      dist_lengths[dist_lengths[0] != 0 ? 1 : 0] = 1;
+    }
+
+    litlen_codes = BuildCodes(litlen_lengths);
+    dist_codes = BuildCodes(dist_lengths);
+
+    hlit = kNumLitLenSymbols;
+    while (hlit > 257 && litlen_lengths[hlit - 1] == 0) hlit--;
+    hdist = kNumDistSymbols;
+    while (hdist > 1 && dist_lengths[hdist - 1] == 0) hdist--;
+
+    std::vector<std::uint8_t> lengths(litlen_lengths.begin(),
+                                      litlen_lengths.begin() + hlit);
+    lengths.insert(lengths.end(), dist_lengths.begin(),
+                   dist_lengths.begin() + hdist);
+    Tokenize(lengths);
+
+    std::array<std::uint32_t, kNumCodeLengthSymbols> token_counts{};
+    for (const Token& token : tokens) token_counts[token.symbol]++;
+    code_length_lengths = BuildCodeLengths(
+        token_counts.data(), kNumCodeLengthSymbols, kMaxCodeLengthBits);
+
+    // A single code length code would make an incomplete code, which zlib
+    // rejects.
+    const auto used_codes =
+        std::count_if(code_length_lengths.begin(), code_length_lengths.end(),
+                      [](std::uint8_t length) { return length != 0; });
+    if (used_codes == 1)
+      code_length_lengths[code_length_lengths[0] != 0 ? 1 : 0] = 1;
+    code_length_codes = BuildCodes(code_length_lengths);
+
+    hclen = kNumCodeLengthSymbols;
+    while (hclen > 4 && code_length_lengths[kCodeLengthOrder[hclen - 1]] == 0)
+      hclen--;
+  }
+
+  std::size_t HeaderBits() const {
+    std::size_t bits = 5 + 5 + 4 + 3 * hclen;
+    for (const Token& token : tokens) {
+      bits += code_length_lengths[token.symbol];
+      if (token.symbol >= 16) bits += kRepeatExtraBits[token.symbol - 16];
+    }
+    return bits;
+  }
+
+  void WriteHeader(BitWriter& out) const {
+    out.Write(hlit - 257, 5);
+    out.Write(hdist - 1, 5);
+    out.Write(hclen - 4, 4);
+    for (int i = 0; i < hclen; i++)
+      out.Write(code_length_lengths[kCodeLengthOrder[i]], 3);
+    for (const Token& token : tokens) {
+      out.Write(code_length_codes[token.symbol],
+                code_length_lengths[token.symbol]);
+      if (token.symbol >= 16)
+        out.Write(token.extra, kRepeatExtraBits[token.symbol - 16]);
+    }
+  }
+
+ private:
+  void Tokenize(const std::vector<std::uint8_t>& lengths) {
+    const auto emit = [&](int symbol, int extra) {
+      tokens.push_back(Token{static_cast<std::uint8_t>(symbol),
+                             static_cast<std::uint8_t>(extra)});
+    };
+
+    std::size_t pos = 0;
+    while (pos < lengths.size()) {
+      const std::uint8_t value = lengths[pos];
+      std::size_t run = 1;
+      while (pos + run < lengths.size() && lengths[pos + run] == value) run++;
+      pos += run;
+
+      if (value == 0) {
+        while (run >= 11) {
+          const std::size_t count = std::min<std::size_t>(run, 138);
+          emit(18, static_cast<int>(count - 11));
+          run -= count;
+        }
+        if (run >= 3) {
+          emit(17, static_cast<int>(run - 3));
+          run = 0;
+        }
+      } else {
+        emit(value, 0);
+        run--;
+        while (run >= 3) {
+          const std::size_t count = std::min<std::size_t>(run, 6);
+          emit(16, static_cast<int>(count - 3));
+          run -= count;
+        }
+      }
+      for (; run > 0; run--) emit(value, 0);
+    }
+  }
+};
+
+/// All matches at each position of a block, with increasing lengths.
+///
+/// For each length, the best distance is the one of the first match which is
+/// at least as long.
+class MatchCandidates {
+ public:
+  MatchCandidates(std::string_view data, std::size_t start, std::size_t end)
+      : offsets_(end - start + 1, 0) {
+    const std::size_t base = start - std::min(start, kWindowSize);
+    std::vector<std::uint32_t> head(std::size_t{1} << kHashBits, kNoPosition);
+    std::vector<std::uint32_t> prev(end - base, kNoPosition);
+    const auto insert = [&](std::size_t pos) {
+      if (pos + kMinMatch > data.size()) return;
+      const std::uint32_t hash = Hash(&data[pos]);
+      prev[pos - base] = head[hash];
+      head[hash] = static_cast<std::uint32_t>(pos);
+    };
+
+    for (std::size_t pos = base; pos < start; pos++) insert(pos);
+
+    for (std::size_t pos = start; pos < end; pos++) {
+      offsets_[pos - start] = static_cast<std::uint32_t>(matches_.size());
+      const int limit =
+          static_cast<int>(std::min<std::size_t>(kMaxMatch, end - pos));
+      if (limit >= kMinMatch) {
+        const char* current = &data[pos];
+        int best = kMinMatch - 1;
+        int chain = kMaxChainLength;
+        std::uint32_t candidate = head[Hash(current)];
+        while (candidate != kNoPosition && pos - candidate <= kWindowSize &&
+               chain-- > 0) {
+          const char* past = &data[candidate];
+          if (past[best] == current[best]) {
+            int length = 0;
+            while (length < limit && past[length] == current[length]) length++;
+            if (length > best) {
+              best = length;
+              matches_.push_back(
+                  Match{static_cast<std::uint16_t>(length),
+                        static_cast<std::uint16_t>(pos - candidate)});
+              if (length == limit) break;
+            }
+          }
+          candidate = prev[candidate - base];
+        }
+      }
+      insert(pos);
+    }
+    offsets_[end - start] = static_cast<std::uint32_t>(matches_.size());
+  }
+
+  const Match* begin(std::size_t index) const noexcept {
+    return matches_.data() + offsets_[index];
+  }
+
+  const Match* end(std::size_t index) const noexcept {
+    return matches_.data() + offsets_[index + 1];
+  }
+
+ private:
+  std::vector<std::uint32_t> offsets_;
+  std::vector<Match> matches_;
+
+  static std::uint32_t Hash(const char* data) noexcept {
+    const std::uint32_t value = static_cast<std::uint8_t>(data[0]) |
+                                (static_cast<std::uint8_t>(data[1]) << 8) |
+                                (static_cast<std::uint8_t>(data[2]) << 16);
+    return (value * 2654435761u) >> (32 - kHashBits);
+  }
+};
+
+std::vector<Symbol> ReverseSteps(const std::vector<Symbol>& steps) {
+  std::vector<Symbol> symbols;
+  for (std::size_t pos = steps.size() - 1; pos > 0; pos -= steps[pos].size())
+    symbols.push_back(steps[pos]);
+  std::reverse(symbols.begin(), symbols.end());
+  return symbols;
+}
+
+/// Takes the longest match at every position.
+std::vector<Symbol> GreedyParse(std::string_view block,
+                                const MatchCandidates& candidates) {
+  std::vector<Symbol> symbols;
+  std::size_t pos = 0;
+  while (pos < block.size()) {
+    if (candidates.begin(pos) != candidates.end(pos)) {
+      const Match& match = *(candidates.end(pos) - 1);
+      symbols.push_back(Symbol{match.length, match.distance});
+    } else {
+      symbols.push_back(Symbol{static_cast<std::uint8_t>(block[pos]), 0});
+    }
+    pos += symbols.back().size();
+  }
+  return symbols;
+}
+
+/// Finds the cheapest sequence of symbols under the cost model.
+std::vector<Symbol> ShortestPath(std::string_view block,
+                                 const MatchCandidates& candidates,
+                                 const CostModel& model) {
+  const std::size_t size = block.size();
+  std::vector<float> costs(size + 1, std::numeric_limits<float>::infinity());
+  std::vector<Symbol> steps(size + 1, Symbol{0, 0});
+  costs[0] = 0;
+  for (std::size_t pos = 0; pos < size; pos++) {
+    const float cost = costs[pos];
+    const std::uint8_t literal = static_cast<std::uint8_t>(block[pos]);
+    if (cost + model.literal[literal] < costs[pos + 1]) {
+      costs[pos + 1] = cost + model.literal[literal];
+      steps[pos + 1] = Symbol{literal, 0};
+    }
+
+    int min_length = kMinMatch;
+    for (auto match = candidates.begin(pos); match != candidates.end(pos);
+         ++match) {
+      const float match_cost = cost + model.distance(match->distance);
+      for (int length = min_length; length <= match->length; length++) {
+        if (!kLengthCandidates[length] && length != match->length) continue;
+        const float total = match_cost + model.length[length];
+        if (total < costs[pos + length]) {
+          costs[pos + length] = total;
+          steps[pos + length] = Symbol{static_cast<std::uint16_t>(length),
+                                       match->distance};
+        }
+      }
+      min_length = match->length + 1;
+    }
+  }
+  return ReverseSteps(steps);
+}
+
+std::size_t StoredBits(std::size_t size) {
+  const std::size_t count = std::max<std::size_t>(
+      1, (size + kMaxStoredSize - 1) / kMaxStoredSize);
+  return count * (3 + 7 + 32) + size * 8;
+}
+
+void WriteStoredBlocks(BitWriter& out, std::string_view data, bool final) {
+  do {
+    const std::size_t size = std::min(data.size(), kMaxStoredSize);
+    out.Write(final && size == data.size() ? 1 : 0, 1);
+    out.Write(0, 2);
+    out.AlignToByte();
+    out.Write(static_cast<std::uint32_t>(size), 16);
+    out.Write(static_cast<std::uint32_t>(~size & 0xffff), 16);
+    out.WriteBytes(data.substr(0, size));
+    data.remove_prefix(size);
+  } while (!data.empty());
+}
+
+/// The bits of a dynamic block, with its header.
+std::size_t DynamicBits(const SymbolStats& stats) {
+  const DynamicTrees trees{stats};
+  return 3 + trees.HeaderBits() + trees.DataBits(stats);
+}
+
+/// The smallest encoding of a block, and its dynamic parse for merging the
+/// block with its neighbors.
+struct EncodedBlock {
+  enum class Type { kStored, kFixed, kDynamic };
+
+  Type type = Type::kStored;
+  std::size_t bits = 0;
+
+  /// The dynamic parse, unless the block is stored.
+  std::vector<Symbol> dynamic;
+  SymbolStats dynamic_stats;
+
+  /// The fixed parse, if the block is fixed.
+  std::vector<Symbol> fixed;
+};
+
+EncodedBlock EncodeBlock(std::string_view data, std::size_t start,
+                         std::size_t end) {
+  const std::string_view block = data.substr(start, end - start);
+  const MatchCandidates candidates{data, start, end};
+
+  std::vector<Symbol> best = GreedyParse(block, candidates);
+  std::size_t best_bits = DynamicBits(SymbolStats{best});
+  std::vector<Symbol> current = best;
+  int stagnation = 0;
+  for (int i = 0; i < OptimalDeflater::kIterations; i++) {
+    const CostModel model = CostModel::FromStats(SymbolStats{current});
+    current = ShortestPath(block, candidates, model);
+    const std::size_t bits = DynamicBits(SymbolStats{current});
+    if (bits < best_bits) {
+      best = current;
+      best_bits = bits;
+      stagnation = 0;
+    } else if (++stagnation >= kMaxStagnation) {
+      break;
+    }
+  }
+
+  std::vector<Symbol> fixed =
+      ShortestPath(block, candidates, CostModel::Fixed());
+  const std::size_t fixed_bits =
+      3 + HuffmanTrees::Fixed().DataBits(SymbolStats{fixed});
+
+  EncodedBlock encoded;
+  const std::size_t stored_bits = StoredBits(block.size());
+  if (stored_bits < std::min(best_bits, fixed_bits)) {
+    encoded.type = EncodedBlock::Type::kStored;
+    encoded.bits = stored_bits;
+    return encoded;
+  }
+
+  if (fixed_bits < best_bits) {
+    encoded.type = EncodedBlock::Type::kFixed;
+    encoded.bits = fixed_bits;
+    encoded.fixed = std::move(fixed);
+  } else {
+    encoded.type = EncodedBlock::Type::kDynamic;
+    encoded.bits = best_bits;
+  }
+  encoded.dynamic_stats = SymbolStats{best};
+  encoded.dynamic = std::move(best);
+  return encoded;
+}
+
+/// A run of blocks which are written as one deflate block.
+struct BlockGroup {
+  std::size_t first;
+  std::size_t last;
+  std::size_t bits;
+  SymbolStats stats;
+};
+
+/// Merges adjacent blocks into one dynamic block while it saves bits, so
+/// that long runs of similar data share one set of Huffman trees.
+std::vector<BlockGroup> MergeBlocks(const std::vector<EncodedBlock>& blocks) {
+  std::vector<BlockGroup> groups;
+  for (std::size_t i = 0; i < blocks.size(); i++) {
+    const EncodedBlock& block = blocks[i];
+    if (!groups.empty() && block.type != EncodedBlock::Type::kStored &&
+        blocks[groups.back().first].type != EncodedBlock::Type::kStored) {
+      BlockGroup& group = groups.back();
+      SymbolStats stats = group.stats;
+      stats.Add(block.dynamic_stats);
+      const std::size_t bits = DynamicBits(stats);
+      if (bits <= group.bits + block.bits) {
+        group.last = i + 1;
+        group.bits = bits;
+        group.stats = stats;
+        continue;
+      }
+    }
+    groups.push_back(BlockGroup{i, i + 1, block.bits, block.dynamic_stats});
+  }
+  return groups;
+}
+
+}  // namespace
+
+std::string OptimalDeflater::Compress(std::string_view data,
+                                      unsigned int thread_count) {
+  const std::size_t block_count =
+      std::max<std::size_t>(1, (data.size() + kBlockSize - 1) / kBlockSize);
+  const auto block_range = [&](std::size_t index) {
+    const std::size_t start = index * kBlockSize;
+    return std::make_pair(std::min(start, data.size()),
+                          std::min(start + kBlockSize, data.size()));
+  };
+
+  std::vector<EncodedBlock> blocks;
+  {
+    std::vector<std::future<EncodedBlock>> futures;
+    ThreadPool pool{static_cast<unsigned int>(std::min<std::size_t>(
+        ThreadPool::ResolveThreadCount(thread_count), block_count))};
+    for (std::size_t i = 0; i < block_count; i++) {
+      const auto [start, end] = block_range(i);
+      futures.push_back(pool.Async([data, start = start, end = end] {
+        return EncodeBlock(data, start, end);
+      }));
+    }
+    for (auto& future : futures) blocks.push_back(future.get());
+  }
+
+  BitWriter out;
+  out.Write(0x78, 8);  // deflate, 32K window
+  out.Write(0xda, 8);  // maximum compression, no dictionary
+  const std::vector<BlockGroup> groups = MergeBlocks(blocks);
+  for (const BlockGroup& group : groups) {
+    const bool final = &group == &groups.back();
+    const EncodedBlock& first = blocks[group.first];
+    if (first.type == EncodedBlock::Type::kStored) {
+      const auto [start, end] = block_range(group.first);
+      WriteStoredBlocks(out, data.substr(start, end - start), final);
+    } else if (group.last - group.first == 1 &&
+               first.type == EncodedBlock::Type::kFixed) {
+      const HuffmanTrees trees = HuffmanTrees::Fixed();
+      out.Write(final ? 1 : 0, 1);
+      out.Write(1, 2);
+      trees.WriteSymbols(out, first.fixed);
+      trees.WriteEndOfBlock(out);
+    } else {
+      const DynamicTrees trees{group.stats};
+      out.Write(final ? 1 : 0, 1);
+      out.Write(2, 2);
+      trees.WriteHeader(out);
+      for (std::size_t i = group.first; i < group.last; i++)
+        trees.WriteSymbols(out, blocks[i].dynamic);
+      trees.WriteEndOfBlock(out);
+    }
+  }
+  out.AlignToByte();
+
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (std::size_t pos = 0; pos < data.size(); pos += 0x40000000) {
+    const std::size_t size =
+        std::min<std::size_t>(data.size() - pos, 0x40000000);
+    adler = adler32(adler, reinterpret_cast<const Bytef*>(&data[pos]),
+                    static_cast<uInt>(size));
+  }
+  out.Write((adler >> 24) & 0xff, 8);
+  out.Write((adler >> 16) & 0xff, 8);
+  out.Write((adler >> 8) & 0xff, 8);
+  out.Write(adler & 0xff, 8);
+  return out.bytes();
+}
+
+std::string OptimalDeflater::recipe() {
+  std::ostringstream recipe;
+  recipe << "deflate=optimal;iterations=" << kIterations
+         << ";block-size=" << kBlockSize << ";chain=" << kMaxChainLength
+         << ";merge-blocks";
+  return recipe.str();
+}
+
+}  // namespace saptapper
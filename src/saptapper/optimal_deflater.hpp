@@ -0,0 +1,41 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_OPTIMAL_DEFLATER_HPP_
+#define SAPTAPPER_OPTIMAL_DEFLATER_HPP_
+
+#include <string>
+#include <string_view>
+
+namespace saptapper {
+
+/// Slow deflate encoder which searches for the smallest encoding.
+///
+/// The input is split into blocks which are compressed in parallel. Each block
+/// is parsed by the shortest path over all matches, with the bit costs taken
+/// from the statistics of the previous parse, and the parse is iterated until
+/// it stops improving (as in zopfli). Matches can still refer to the data
+/// before the block, and adjacent blocks are merged into one deflate block
+/// when sharing the Huffman trees saves bits.
+///
+/// The output is a standard zlib stream.
+class OptimalDeflater {
+ public:
+  /// The number of parse iterations per block.
+  static constexpr int kIterations = 15;
+
+  /// The size of the independent blocks.
+  static constexpr std::size_t kBlockSize = 0x10000;
+
+  /// Compresses the data into a zlib stream.
+  /// @param thread_count the number of threads, or 0 for the number of
+  /// hardware threads.
+  static std::string Compress(std::string_view data,
+                              unsigned int thread_count = 0);
+
+  /// Describes the settings which affect the output.
+  static std::string recipe();
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,196 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "psf_reader.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <zlib.h>
+#include "buffer_pool.hpp"
+#include "bytes.hpp"
+#include "crc32.hpp"
+
+namespace saptapper {
+
+// Files larger than this are not PSF files of any console.
+static constexpr std::uintmax_t kMaxFileSize = 0x4000000;
+
+static constexpr std::size_t kMinInflateBuffer = 0x10000;
+
+static std::string_view TrimWhitespace(std::string_view str) {
+  // Every control character counts as whitespace in PSF tags.
+  const auto is_space = [](char c) {
+    return static_cast<unsigned char>(c) <= 0x20;
+  };
+  while (!str.empty() && is_space(str.front())) str.remove_prefix(1);
+  while (!str.empty() && is_space(str.back())) str.remove_suffix(1);
+  return str;
+}
+
+namespace {
+
+// Wraps a zlib inflate stream, which is ended with the object.
+class InflateStream {
+ public:
+  explicit InflateStream(std::string_view in) {
+    if (inflateInit(&stream_) != Z_OK)
+      throw std::runtime_error("inflateInit failed.");
+    stream_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream_.avail_in = static_cast<uInt>(in.size());
+  }
+
+  ~InflateStream() { inflateEnd(&stream_); }
+
+  InflateStream(const InflateStream&) = delete;
+  InflateStream& operator=(const InflateStream&) = delete;
+
+  /// Inflates into the buffer and returns the produced size. Sets end once
+  /// the stream is complete.
+  std::size_t Inflate(char* out, std::size_t size, bool& end) {
+    stream_.next_out = reinterpret_cast<Bytef*>(out);
+    stream_.avail_out = static_cast<uInt>(size);
+    const int ret = inflate(&stream_, Z_NO_FLUSH);
+    const std::size_t produced = size - stream_.avail_out;
+    end = ret == Z_STREAM_END;
+    if (ret == Z_BUF_ERROR && stream_.avail_in == 0 && produced == 0)
+      throw std::runtime_error("The compressed program is truncated.");
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+      throw std::runtime_error("The compressed program is corrupt.");
+    return produced;
+  }
+
+ private:
+  z_stream stream_{};
+};
+
+}  // namespace
+
+PsfReader PsfReader::LoadFromFile(const std::filesystem::path& path) {
+  const auto size = file_size(path);
+  if (size > kMaxFileSize)
+    throw std::runtime_error("The file is too large for a PSF file.");
+
+  std::ifstream stream(path, std::ios::in | std::ios::binary);
+  stream.exceptions(std::ios::badbit | std::ios::eofbit | std::ios::failbit);
+  PooledBuffer data = BufferPool::Default().Acquire(size);
+  stream.read(data.data(), size);
+  stream.close();
+  return LoadFromBuffer(std::move(data));
+}
+
+PsfReader PsfReader::LoadFromBuffer(PooledBuffer data) {
+  PsfReader psf;
+  psf.data_ = std::move(data);
+
+  const std::string_view file{psf.data_};
+  if (file.size() < kHeaderSize || file.substr(0, 3) != "PSF")
+    throw std::runtime_error("Not a PSF file.");
+
+  psf.version_ = ReadInt8L(&file[3]);
+  const std::size_t reserved_size = ReadInt32L(&file[4]);
+  const std::size_t exe_size = ReadInt32L(&file[8]);
+  psf.compressed_exe_crc32_ = ReadInt32L(&file[12]);
+  if (reserved_size > file.size() - kHeaderSize ||
+      exe_size > file.size() - kHeaderSize - reserved_size)
+    throw std::runtime_error("The PSF file is truncated.");
+
+  psf.reserved_ = file.substr(kHeaderSize, reserved_size);
+  psf.compressed_exe_ = file.substr(kHeaderSize + reserved_size, exe_size);
+
+  const std::string_view rest =
+      file.substr(kHeaderSize + reserved_size + exe_size);
+  if (rest.substr(0, 5) == "[TAG]") psf.ParseTags(rest.substr(5));
+  return psf;
+}
+
+bool PsfReader::VerifyCrc32() const noexcept {
+  return Crc32::Compute(compressed_exe_) == compressed_exe_crc32_;
+}
+
+PooledBuffer PsfReader::Decompress(std::size_t max_size) const {
+  PooledBuffer exe;
+  if (compressed_exe_.empty()) return exe;
+
+  // One byte over the limit tells whether the program exceeds it.
+  const std::size_t limit = max_size + 1;
+  exe.resize(std::min(limit, std::max(compressed_exe_.size() * 4,
+                                      kMinInflateBuffer)));
+
+  InflateStream stream{compressed_exe_};
+  std::size_t size = 0;
+  bool end = false;
+  while (!end) {
+    if (size == exe.size()) {
+      if (exe.size() >= limit)
+        throw std::runtime_error("The program is larger than " +
+                                 std::to_string(max_size) + " bytes.");
+      exe.resize(std::min(limit, exe.size() * 2));
+    }
+    size += stream.Inflate(&exe[size], exe.size() - size, end);
+  }
+  if (size > max_size)
+    throw std::runtime_error("The program is larger than " +
+                             std::to_string(max_size) + " bytes.");
+
+  exe.resize(size);
+  return exe;
+}
+
+std::size_t PsfReader::DecompressedSize(std::size_t max_size) const {
+  if (compressed_exe_.empty()) return 0;
+
+  std::string buffer(kMinInflateBuffer, 0);
+  InflateStream stream{compressed_exe_};
+  std::size_t size = 0;
+  bool end = false;
+  while (!end) {
+    size += stream.Inflate(buffer.data(), buffer.size(), end);
+    if (size > max_size)
+      throw std::runtime_error("The program is larger than " +
+                               std::to_string(max_size) + " bytes.");
+  }
+  return size;
+}
+
+std::string PsfReader::DecompressPrefix(std::size_t size) const {
+  std::string prefix(size, 0);
+  if (compressed_exe_.empty()) return {};
+
+  InflateStream stream{compressed_exe_};
+  std::size_t produced = 0;
+  bool end = false;
+  while (!end && produced < size)
+    produced += stream.Inflate(&prefix[produced], size - produced, end);
+  prefix.resize(produced);
+  return prefix;
+}
+
+void PsfReader::ParseTags(std::string_view text) {
+  while (!text.empty()) {
+    const auto line_end = text.find('\n');
+    const std::string_view line = text.substr(0, line_end);
+    text.remove_prefix(line_end == std::string_view::npos ? text.size()
+                                                          : line_end + 1);
+
+    const auto separator = line.find('=');
+    if (separator == std::string_view::npos) continue;
+    const std::string key{TrimWhitespace(line.substr(0, separator))};
+    const std::string_view value = TrimWhitespace(line.substr(separator + 1));
+    if (key.empty()) continue;
+
+    const auto [it, inserted] = tags_.try_emplace(key, value);
+    if (!inserted) {
+      it->second += '\n';
+      it->second += value;
+    }
+  }
+}
+
+}  // namespace saptapper
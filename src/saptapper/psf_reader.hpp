@@ -0,0 +1,73 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_PSF_READER_HPP_
+#define SAPTAPPER_PSF_READER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include "buffer_pool.hpp"
+
+namespace saptapper {
+
+/// Parsed PSF file, the counterpart of PsfWriter.
+///
+/// The file is kept in memory as is; the program is decompressed on request.
+class PsfReader {
+ public:
+  static constexpr std::size_t kHeaderSize = 16;
+
+  PsfReader() = default;
+
+  /// Parses the file. Throws std::runtime_error if it is not a PSF file.
+  static PsfReader LoadFromFile(const std::filesystem::path& path);
+
+  static PsfReader LoadFromBuffer(PooledBuffer data);
+
+  std::uint8_t version() const noexcept { return version_; }
+  std::string_view reserved() const noexcept { return reserved_; }
+  std::string_view compressed_exe() const noexcept { return compressed_exe_; }
+
+  /// Returns the CRC-32 recorded in the header.
+  std::uint32_t compressed_exe_crc32() const noexcept {
+    return compressed_exe_crc32_;
+  }
+
+  /// Returns the tags. Values of a key repeated on several lines are joined
+  /// with newlines.
+  const std::map<std::string, std::string>& tags() const noexcept {
+    return tags_;
+  }
+
+  /// Returns whether the CRC-32 of the compressed program matches the header.
+  bool VerifyCrc32() const noexcept;
+
+  /// Decompresses the program. Throws std::runtime_error if the data is
+  /// corrupt or inflates beyond max_size bytes.
+  PooledBuffer Decompress(std::size_t max_size) const;
+
+  /// Returns the size of the decompressed program, inflating it through a
+  /// small buffer. Throws std::runtime_error like Decompress.
+  std::size_t DecompressedSize(std::size_t max_size) const;
+
+  /// Decompresses the first bytes of the program, at most the size, without
+  /// inflating the rest.
+  std::string DecompressPrefix(std::size_t size) const;
+
+ private:
+  PooledBuffer data_;
+  std::uint8_t version_ = 0;
+  std::string_view reserved_;
+  std::string_view compressed_exe_;
+  std::uint32_t compressed_exe_crc32_ = 0;
+  std::map<std::string, std::string> tags_;
+
+  void ParseTags(std::string_view text);
+};
+
+}  // namespace saptapper
+
+#endif
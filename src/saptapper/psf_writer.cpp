@@ -5,14 +5,48 @@
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <zlib.h>
 #include "bytes.hpp"
+#include "deflater.hpp"
+#include "optimal_deflater.hpp"
 
 namespace saptapper {
 
-PsfWriter::PsfWriter(uint8_t version, std::map<std::string, std::string> tags)
+PsfWriter::PsfWriter(uint8_t version, std::map<std::string, std::string> tags,
+                     CompressionProfile profile, unsigned int thread_count)
     : version_{version},
-      exe_{compressed_exe_, zstr::default_buff_size, Z_BEST_COMPRESSION, 15},
-      tags_(std::move(tags)) {}
+      profile_{profile},
+      exe_buf_{profile, kWindowBits, thread_count},
+      exe_{&exe_buf_},
+      tags_(std::move(tags)) {
+  exe_.exceptions(std::ios::badbit);
+}
+
+std::string PsfWriter::recipe(CompressionProfile profile) {
+  std::ostringstream recipe;
+  switch (profile) {
+    case CompressionProfile::kFast:
+      recipe << "zlib-level=" << Z_BEST_SPEED;
+      break;
+    case CompressionProfile::kBalanced:
+      recipe << "zlib-level=" << Z_BEST_COMPRESSION;
+      break;
+    case CompressionProfile::kMax:
+      recipe << "zlib-profile=" << to_string(profile);
+      break;
+    case CompressionProfile::kOptimal:
+      // The optimal deflater always uses the 32 KiB window.
+      return OptimalDeflater::recipe() + ";fallback=zlib-level=" +
+             std::to_string(Z_BEST_COMPRESSION) +
+             ";zlib-window-bits=" + std::to_string(kWindowBits);
+  }
+  recipe << ";zlib-window-bits=" << kWindowBits;
+  return recipe.str();
+}
 
 void PsfWriter::SaveToFile(const std::filesystem::path& path,
                            const std::map<std::string, std::string>& tags) {
@@ -25,13 +59,12 @@ void PsfWriter::SaveToFile(const std::filesystem::path& path,
 void PsfWriter::SaveToStream(std::ostream& out,
                              const std::map<std::string, std::string>& tags) {
   exe_.flush();
+  exe_buf_.Finish();
   reserved_.flush();
 
-  const std::string compressed_exe = compressed_exe_.str();
+  const std::string_view compressed_exe = exe_buf_.output();
   const std::string reserved = reserved_.str();
-  const std::uint32_t compressed_exe_crc32 =
-      crc32(0L, reinterpret_cast<const Bytef*>(compressed_exe.data()),
-            static_cast<uInt>(compressed_exe.size()));
+  const std::uint32_t compressed_exe_crc32 = exe_buf_.output_crc32();
 
   const std::string header{
       NewHeader(compressed_exe, reserved, compressed_exe_crc32)};
@@ -9,15 +9,24 @@
 #include <sstream>
 #include <string>
 #include <string_view>
-#include "zstr.hpp"
+#include "deflater.hpp"
 
 namespace saptapper {
 
 class PsfWriter {
  public:
-  PsfWriter(uint8_t version, std::map<std::string, std::string> tags = {});
+  /// @param thread_count the threads of the optimal profile, or 0 for the
+  /// number of hardware threads.
+  PsfWriter(uint8_t version, std::map<std::string, std::string> tags = {},
+            CompressionProfile profile = CompressionProfile::kBalanced,
+            unsigned int thread_count = 0);
+
+  /// Describes the compression settings of the profile.
+  static std::string recipe(
+      CompressionProfile profile = CompressionProfile::kBalanced);
 
   uint8_t version() const noexcept { return version_; }
+  CompressionProfile profile() const noexcept { return profile_; }
   std::ostream& exe() noexcept { return exe_; }
   std::ostream& reserved() noexcept { return reserved_; }
   std::map<std::string, std::string>& tags() noexcept { return tags_; }
@@ -35,10 +44,13 @@ class PsfWriter {
                     const std::map<std::string, std::string>& tags);
 
  private:
+  static constexpr int kWindowBits = 15;
+
   uint8_t version_;
+  CompressionProfile profile_;
   std::ostringstream reserved_;
-  std::ostringstream compressed_exe_;
-  zstr::ostream exe_;
+  DeflateStreamBuf exe_buf_;
+  std::ostream exe_;
   std::map<std::string, std::string> tags_;
 
   std::string NewHeader(std::string_view compressed_exe,
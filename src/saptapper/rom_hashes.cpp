@@ -0,0 +1,72 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "rom_hashes.hpp"
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace saptapper {
+
+std::string RomHashes::crc32_hex() const {
+  std::ostringstream hex;
+  hex << std::hex << std::setfill('0') << std::setw(8) << crc32;
+  return hex.str();
+}
+
+std::string RomHashes::xxh64_hex() const {
+  std::ostringstream hex;
+  hex << std::hex << std::setfill('0') << std::setw(16) << xxh64;
+  return hex.str();
+}
+
+unsigned int RomHashes::ParseTypes(std::string_view names) {
+  unsigned int types = kNone;
+  while (!names.empty()) {
+    const std::size_t comma = names.find(',');
+    const std::string_view name = names.substr(0, comma);
+    if (name == "crc32") {
+      types |= kCrc32;
+    } else if (name == "sha1") {
+      types |= kSha1;
+    } else if (name == "xxh64") {
+      types |= kXxh64;
+    } else if (name == "all") {
+      types |= kAll;
+    } else if (name != "none") {
+      throw std::invalid_argument("Unknown hash \"" + std::string(name) +
+                                  "\".");
+    }
+    names.remove_prefix(comma == std::string_view::npos ? names.size()
+                                                        : comma + 1);
+  }
+  return types;
+}
+
+void RomHasher::Update(std::string_view data) noexcept {
+  if ((types_ & RomHashes::kCrc32) != 0) crc32_.Update(data);
+  if ((types_ & RomHashes::kSha1) != 0) sha1_.Update(data);
+  if ((types_ & RomHashes::kXxh64) != 0) xxh64_.Update(data);
+}
+
+RomHashes RomHasher::Finish() noexcept {
+  RomHashes hashes;
+  hashes.types = types_;
+  if (hashes.has(RomHashes::kCrc32)) hashes.crc32 = crc32_.value();
+  if (hashes.has(RomHashes::kSha1)) hashes.sha1 = sha1_.Finish();
+  if (hashes.has(RomHashes::kXxh64)) hashes.xxh64 = xxh64_.value();
+  return hashes;
+}
+
+RomHashes RomHasher::Compute(std::string_view data, unsigned int types) {
+  RomHasher hasher{types};
+  if (types != RomHashes::kNone) {
+    for (std::size_t pos = 0; pos < data.size(); pos += kChunkSize)
+      hasher.Update(data.substr(pos, kChunkSize));
+  }
+  return hasher.Finish();
+}
+
+}  // namespace saptapper
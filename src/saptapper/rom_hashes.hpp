@@ -0,0 +1,70 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_ROM_HASHES_HPP_
+#define SAPTAPPER_ROM_HASHES_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "crc32.hpp"
+#include "sha1.hpp"
+#include "xxh64.hpp"
+
+namespace saptapper {
+
+/// Hashes of a ROM file, for matching against dump databases and as cache
+/// keys. They cover the bytes of the file, before the ROM is padded.
+struct RomHashes {
+  /// Bit flags of the hash types.
+  enum Type : unsigned int {
+    kNone = 0,
+    kCrc32 = 1,
+    kSha1 = 2,
+    kXxh64 = 4,
+    kAll = kCrc32 | kSha1 | kXxh64,
+  };
+
+  /// The computed hashes.
+  unsigned int types = kNone;
+
+  std::uint32_t crc32 = 0;
+  Sha1::digest_type sha1{};
+  std::uint64_t xxh64 = 0;
+
+  bool has(Type type) const noexcept { return (types & type) != 0; }
+
+  std::string crc32_hex() const;
+  std::string sha1_hex() const { return Sha1::ToHex(sha1); }
+  std::string xxh64_hex() const;
+
+  /// Parses comma-separated hash names ("crc32", "sha1", "xxh64", "all" or
+  /// "none"). Throws std::invalid_argument if a name is unknown.
+  static unsigned int ParseTypes(std::string_view names);
+};
+
+/// Computes the hashes of a ROM in one pass. Each chunk goes through all of
+/// the hashes while it is in the cache, such as right after it is read.
+class RomHasher {
+ public:
+  /// The chunk size which keeps the data in the L2 cache.
+  static constexpr std::size_t kChunkSize = 0x40000;
+
+  explicit RomHasher(unsigned int types) noexcept : types_{types} {}
+
+  void Update(std::string_view data) noexcept;
+
+  RomHashes Finish() noexcept;
+
+  static RomHashes Compute(std::string_view data, unsigned int types);
+
+ private:
+  unsigned int types_;
+  Crc32 crc32_;
+  Sha1 sha1_;
+  Xxh64 xxh64_;
+};
+
+}  // namespace saptapper
+
+#endif
@@ -0,0 +1,74 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_ROM_OVERLAY_HPP_
+#define SAPTAPPER_ROM_OVERLAY_HPP_
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "types.hpp"
+
+namespace saptapper {
+
+/// Byte patches over a ROM, which are applied while the ROM is read instead
+/// of modifying (or copying) the ROM itself.
+class RomOverlay {
+ public:
+  struct Patch {
+    agbsize_t offset;
+    std::string data;
+
+    agbsize_t end() const noexcept {
+      return offset + static_cast<agbsize_t>(data.size());
+    }
+  };
+
+  const std::vector<Patch>& patches() const noexcept { return patches_; }
+  bool empty() const noexcept { return patches_.empty(); }
+
+  /// Adds a patch. Throws std::invalid_argument if it overlaps another one.
+  void Add(agbsize_t offset, std::string data) {
+    Patch patch{offset, std::move(data)};
+    const auto it = std::lower_bound(
+        patches_.begin(), patches_.end(), patch.offset,
+        [](const Patch& p, agbsize_t offset) { return p.offset < offset; });
+    if ((it != patches_.end() && it->offset < patch.end()) ||
+        (it != patches_.begin() && std::prev(it)->end() > patch.offset))
+      throw std::invalid_argument("The ROM patches overlap.");
+    patches_.insert(it, std::move(patch));
+  }
+
+  /// Calls the function with the consecutive pieces of the patched ROM, as
+  /// std::string_view. Throws std::out_of_range if a patch is beyond the ROM.
+  template <typename Function>
+  void ForEachPiece(std::string_view rom, Function&& function) const {
+    agbsize_t pos = 0;
+    for (const Patch& patch : patches_) {
+      if (patch.end() > rom.size())
+        throw std::out_of_range("The ROM patch is out of range.");
+      if (patch.offset > pos) function(rom.substr(pos, patch.offset - pos));
+      function(std::string_view{patch.data});
+      pos = patch.end();
+    }
+    if (pos < rom.size()) function(rom.substr(pos));
+  }
+
+  /// Writes the patches into the ROM.
+  void Apply(std::string& rom) const {
+    for (const Patch& patch : patches_) {
+      if (patch.end() > rom.size())
+        throw std::out_of_range("The ROM patch is out of range.");
+      rom.replace(patch.offset, patch.data.size(), patch.data);
+    }
+  }
+
+ private:
+  std::vector<Patch> patches_;
+};
+
+}  // namespace saptapper
+
+#endif
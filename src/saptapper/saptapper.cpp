@@ -2,63 +2,334 @@
 
 #include "saptapper.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include <iomanip>
+#include <iterator>
 #include <map>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
+#include "bytes.hpp"
 #include "cartridge.hpp"
+#include "driver_smoke_test.hpp"
 #include "gsf_header.hpp"
 #include "gsf_writer.hpp"
+#include "gsflib_store.hpp"
+#include "inspection.hpp"
+#include "manifest.hpp"
 #include "minigsf_driver_param.hpp"
 #include "mp2k_driver.hpp"
 #include "mp2k_driver_param.hpp"
+#include "rom_hashes.hpp"
+#include "rom_overlay.hpp"
+#include "sha1.hpp"
+#include "song_selection.hpp"
+#include "thread_pool.hpp"
 
 namespace saptapper {
 
-void Saptapper::ConvertToGsfSet(Cartridge& cartridge,
-                                const std::filesystem::path& basename,
-                                const std::filesystem::path& outdir,
-                                const std::string_view& gsfby,
-                                bool keep_duplicated) {
-  Mp2kDriverParam param;
-  MinigsfDriverParam minigsf;
-  agbptr_t gsf_driver_addr = agbnullptr;
-  Inspect(cartridge, param, minigsf, gsf_driver_addr, true);
+std::vector<std::filesystem::path> Saptapper::ConvertToGsfSet(
+    const Cartridge& cartridge, const std::filesystem::path& basename,
+    const std::filesystem::path& outdir, const ConvertOptions& options) {
+  using clock = std::chrono::steady_clock;
 
-  Mp2kDriver::InstallGsfDriver(cartridge.rom(), gsf_driver_addr, param);
+  const ConvertLimits& limits = options.limits;
+  const auto start = clock::now();
+  const auto check_time = [&] {
+    if (limits.max_seconds <= 0) return;
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+    if (elapsed.count() > limits.max_seconds) {
+      std::ostringstream message;
+      message << "The conversion took longer than the time limit ("
+              << limits.max_seconds << " seconds).";
+      throw std::runtime_error(message.str());
+    }
+  };
+  // Counted by the workers as each file is written, so that a ROM which
+  // writes too much stops early.
+  std::atomic<std::uintmax_t> output_size{0};
+  const auto count_output = [&](const std::filesystem::path& path,
+                                const std::filesystem::path& output_path) {
+    if (limits.max_output_size == 0) return;
+    if ((output_size += file_size(path)) > limits.max_output_size) {
+      std::ostringstream message;
+      message << "The output exceeds the size limit ("
+              << limits.max_output_size << " bytes) at "
+              << output_path.filename().string() << ".";
+      throw std::runtime_error(message.str());
+    }
+  };
 
   std::filesystem::path base_path{outdir};
   base_path /= basename;
   create_directories(base_path.parent_path());
+  const std::filesystem::path dir{base_path.parent_path()};
 
   std::filesystem::path gsflib_path{base_path};
   gsflib_path += ".gsflib";
 
+  std::filesystem::path manifest_path{base_path};
+  manifest_path += ".manifest";
+
+  // In the incremental mode, the files recorded in the manifest of the
+  // previous run are kept as long as the input and the options are the same.
+  Manifest manifest;
+  std::optional<Manifest> previous;
+  if (options.incremental) {
+    const RomHashes& hashes = cartridge.hashes();
+    const std::string rom_sha1{hashes.has(RomHashes::kSha1)
+                                   ? hashes.sha1_hex()
+                                   : Sha1::ToHex(Sha1::Digest(cartridge.rom()))};
+    manifest = Manifest{kVersion, rom_sha1, DescribeOptions(basename, options)};
+    previous = Manifest::LoadFromFile(manifest_path);
+    if (previous && !previous->SameSourceAs(manifest)) previous.reset();
+
+    if (previous && !previous->files().empty()) {
+      const auto& files = previous->files();
+      const bool up_to_date =
+          std::all_of(files.begin(), files.end(), [&](const auto& file) {
+            return previous->IsUpToDate(dir, file.first);
+          });
+      if (up_to_date) {
+        std::vector<std::filesystem::path> paths{gsflib_path};
+        for (const auto& file : files) {
+          const std::filesystem::path path{dir / file.first};
+          if (path != gsflib_path) paths.push_back(path);
+        }
+        return paths;
+      }
+    }
+  }
+  const auto is_up_to_date = [&](const std::filesystem::path& path) {
+    return previous && previous->IsUpToDate(dir, path.filename().string());
+  };
+  // Takes the result of is_up_to_date, so that each file is hashed once.
+  const auto record = [&](const std::filesystem::path& path, bool up_to_date) {
+    if (!options.incremental) return;
+    const std::string filename{path.filename().string()};
+    if (up_to_date) {
+      manifest.set_file(filename, previous->files().at(filename));
+    } else {
+      manifest.set_file(filename, Manifest::HashFile(path));
+    }
+  };
+
+  // Compilation cartridges have a driver instance per game. Each instance
+  // gets its own gsflib, with its own driver block.
+  ThreadPool pool{options.thread_count};
+  std::vector<Mp2kDriverParam> params =
+      Mp2kDriver::InspectAll(cartridge.rom(), limits.validate_songs, &pool);
+  if (params.empty()) {
+    // Reports what is missing in the first candidate.
+    Mp2kDriverParam param;
+    MinigsfDriverParam minigsf;
+    agbptr_t gsf_driver_addr = agbnullptr;
+    Inspect(cartridge, param, minigsf, gsf_driver_addr, true);
+    params.push_back(param);
+  }
+
+  // A table of pointer-like words may otherwise yield a minigsf for each
+  // word. The limit applies to the part of the table to be converted.
+  if (limits.max_song_count != 0) {
+    for (const Mp2kDriverParam& param : params) {
+      int song_count = param.song_count();
+      if (const auto last = options.songs.last())
+        song_count = std::min(song_count, *last + 1);
+      if (song_count > limits.max_song_count) {
+        std::ostringstream message;
+        message << "The song table at 0x" << std::hex << param.song_table()
+                << std::dec << " has " << song_count
+                << " entries, more than the limit of "
+                << limits.max_song_count << ". The ROM may be malformed.";
+        throw std::runtime_error(message.str());
+      }
+    }
+  }
+
+  const std::vector<agbptr_t> gsf_driver_addrs = AllocateFreeSpace(
+      cartridge.rom(), Mp2kDriver::gsf_driver_size(), params.size());
+  if (gsf_driver_addrs.size() < params.size()) {
+    std::ostringstream message;
+    message << "Unable to find the free space for gsf driver block ("
+            << Mp2kDriver::gsf_driver_size() << " bytes required";
+    if (params.size() > 1) message << " for each of " << params.size();
+    message << ").";
+    throw std::runtime_error(message.str());
+  }
+
   const agbptr_t entrypoint = 0x8000000;
   const GsfHeader gsf_header{entrypoint, entrypoint, cartridge.size()};
-  GsfWriter::SaveToFile(gsflib_path, gsf_header, cartridge.rom());
+  std::vector<std::filesystem::path> paths;
+  for (std::size_t instance = 0; instance < params.size(); instance++) {
+    check_time();
+    const Mp2kDriverParam& param = params[instance];
+    const agbptr_t gsf_driver_addr = gsf_driver_addrs[instance];
+
+    std::filesystem::path instance_base_path{base_path};
+    if (instance != 0) instance_base_path += "-" + std::to_string(instance + 1);
+    std::filesystem::path instance_gsflib_path{instance_base_path};
+    instance_gsflib_path += ".gsflib";
 
-  const std::string lib{gsflib_path.filename().string()};
-  std::map<std::string, std::string> minigsf_tags{{"_lib", lib}};
-  if (!gsfby.empty()) minigsf_tags["gsfby"] = gsfby;
+    MinigsfDriverParam minigsf;
+    minigsf.set_address(Mp2kDriver::minigsf_address(gsf_driver_addr));
+    minigsf.set_size(GetMinigsfSize(param.song_count()));
 
-  for (int song = 0; song < param.song_count(); song++) {
-    if (!keep_duplicated) {
-      int origin = Mp2kDriver::FindIdenticalSong(cartridge.rom(),
-                                                 param.song_table(), song);
-      if (origin != Mp2kDriver::kNoSong) continue;
+    const RomOverlay gsf_driver =
+        Mp2kDriver::MakeGsfDriverPatch(cartridge.rom(), gsf_driver_addr, param);
+
+    const std::string lib{instance_gsflib_path.filename().string()};
+    std::map<std::string, std::string> minigsf_tags{{"_lib", lib}};
+    if (!options.gsfby.empty()) minigsf_tags["gsfby"] = options.gsfby;
+
+    // The minigsfs only need the minigsf parameters, so they are written by
+    // the pool while the gsflib is compressed on this thread.
+    std::vector<std::filesystem::path> minigsf_paths;
+    // Each batch returns whether its minigsfs were up to date. A failed batch
+    // removes the minigsfs it has written.
+    std::vector<std::future<std::vector<bool>>> batches;
+    std::vector<std::size_t> batch_sizes;
+    std::vector<int> batch;
+    const auto submit_batch = [&] {
+      if (batch.empty()) return;
+      batch_sizes.push_back(batch.size());
+      batches.push_back(pool.Async([&, numbers = std::move(batch)] {
+        std::vector<bool> up_to_date;
+        std::vector<std::filesystem::path> written;
+        try {
+          for (const int song : numbers) {
+            check_time();
+            const std::filesystem::path minigsf_path{
+                GetMinigsfPath(instance_base_path, song)};
+            if (options.smoke_test) {
+              const SmokeTestResult result = DriverSmokeTest::Run(
+                  cartridge.rom(), gsf_driver, param, minigsf, song);
+              if (!result.ok()) {
+                throw std::runtime_error("Smoke test failed for " +
+                                         minigsf_path.filename().string() +
+                                         ": " + result.error);
+              }
+            }
+            up_to_date.push_back(is_up_to_date(minigsf_path));
+            if (!up_to_date.back()) {
+              written.push_back(minigsf_path);
+              SaveMinigsfFile(instance_base_path, minigsf, song, minigsf_tags);
+            }
+            count_output(minigsf_path, minigsf_path);
+          }
+        } catch (...) {
+          for (const auto& path : written) {
+            std::error_code ec;
+            remove(path, ec);
+          }
+          throw;
+        }
+        return up_to_date;
+      }));
+      batch.clear();
+    };
+    SongEnumerator songs{cartridge.rom(), param, options.songs,
+                         !options.keep_duplicated, !options.keep_silent};
+    while (const auto song_descriptor = songs.Next()) {
+      batch.push_back(song_descriptor->number);
+      minigsf_paths.push_back(
+          GetMinigsfPath(instance_base_path, song_descriptor->number));
+      if (batch.size() >= kSongBatchSize) submit_batch();
+    }
+    submit_batch();
+
+    // The gsflib is written under a temporary name and renamed after the
+    // minigsfs, so that a complete gsflib implies a complete set.
+    std::filesystem::path temp_gsflib_path{instance_gsflib_path};
+    temp_gsflib_path += ".tmp";
+    const bool gsflib_up_to_date = is_up_to_date(instance_gsflib_path);
+    std::exception_ptr error;
+    try {
+      if (gsflib_up_to_date) {
+        // keep the existing gsflib
+      } else if (options.store_dir.empty()) {
+        GsfWriter::SaveToFile(temp_gsflib_path, gsf_header, cartridge.rom(),
+                              gsf_driver, {}, options.compression,
+                              options.thread_count);
+      } else {
+        const GsflibStore store{options.store_dir};
+        const std::string key =
+            GsflibStore::MakeKey(GsfWriter::recipe(options.compression),
+                                 gsf_header, cartridge.rom(), gsf_driver);
+        store.Install(key, temp_gsflib_path,
+                      [&](const std::filesystem::path& path) {
+                        GsfWriter::SaveToFile(path, gsf_header,
+                                              cartridge.rom(), gsf_driver, {},
+                                              options.compression,
+                                              options.thread_count);
+                      });
+      }
+      count_output(gsflib_up_to_date ? instance_gsflib_path : temp_gsflib_path,
+                   instance_gsflib_path);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    // Every batch is waited for, since the tasks refer to the locals. The
+    // minigsfs of a failed batch count as up to date, as it removed its own.
+    std::vector<bool> minigsf_up_to_date;
+    for (std::size_t i = 0; i < batches.size(); i++) {
+      try {
+        const std::vector<bool> up_to_date = batches[i].get();
+        minigsf_up_to_date.insert(minigsf_up_to_date.end(),
+                                  up_to_date.begin(), up_to_date.end());
+      } catch (...) {
+        if (!error) error = std::current_exception();
+        minigsf_up_to_date.resize(minigsf_up_to_date.size() + batch_sizes[i],
+                                  true);
+      }
+    }
+
+    // A failed instance leaves none of the files it has written.
+    if (error) {
+      std::error_code ec;
+      remove(temp_gsflib_path, ec);
+      for (std::size_t i = 0; i < minigsf_paths.size(); i++) {
+        if (!minigsf_up_to_date[i]) remove(minigsf_paths[i], ec);
+      }
+      std::rethrow_exception(error);
     }
+    if (!gsflib_up_to_date) rename(temp_gsflib_path, instance_gsflib_path);
 
-    SaveMinigsfFile(base_path, minigsf, song, minigsf_tags);
+    check_time();
+    record(instance_gsflib_path, gsflib_up_to_date);
+    paths.push_back(instance_gsflib_path);
+    for (std::size_t i = 0; i < minigsf_paths.size(); i++) {
+      const std::filesystem::path& minigsf_path = minigsf_paths[i];
+      record(minigsf_path, minigsf_up_to_date[i]);
+      paths.push_back(minigsf_path);
+    }
   }
+
+  if (options.incremental) manifest.SaveToFile(manifest_path);
+  return paths;
 }
 
-void Saptapper::SaveMinigsfFile(
+std::filesystem::path Saptapper::SaveMinigsfFile(
     const std::filesystem::path& base_path, const MinigsfDriverParam& minigsf,
     int song, const std::map<std::string, std::string>& tags) {
+  const std::filesystem::path minigsf_path{GetMinigsfPath(base_path, song)};
+  GsfWriter::SaveMinigsfToFile(minigsf_path, minigsf, song, tags);
+  return minigsf_path;
+}
+
+std::filesystem::path Saptapper::GetMinigsfPath(
+    const std::filesystem::path& base_path, int song) {
   std::ostringstream songid;
   songid << std::setfill('0') << std::setw(4) << song;
 
@@ -66,8 +337,25 @@ void Saptapper::SaveMinigsfFile(
   minigsf_path += "-";
   minigsf_path += songid.str();
   minigsf_path += ".minigsf";
+  return minigsf_path;
+}
 
-  GsfWriter::SaveMinigsfToFile(minigsf_path, minigsf, song, tags);
+std::string Saptapper::DescribeOptions(const std::filesystem::path& basename,
+                                       const ConvertOptions& options) {
+  std::ostringstream description;
+  description << "basename=" << basename.string()
+              << ";keep_duplicated=" << options.keep_duplicated
+              << ";keep_silent=" << options.keep_silent
+              << ";gsfby=" << options.gsfby
+              << ";validate_songs=" << options.limits.validate_songs << ";"
+              << GsfWriter::recipe(options.compression);
+  if (!options.songs.all())
+    description << ";songs=" << options.songs.ToString();
+
+  // The description is stored in a line of the manifest.
+  std::string str = description.str();
+  std::replace(str.begin(), str.end(), '\n', ' ');
+  return str;
 }
 
 void Saptapper::Inspect(const Cartridge& cartridge, Mp2kDriverParam& param,
@@ -77,6 +365,14 @@ void Saptapper::Inspect(const Cartridge& cartridge, Mp2kDriverParam& param,
     throw std::invalid_argument("The gsf driver address is not valid.");
 
   param = Mp2kDriver::Inspect(cartridge.rom());
+  PlaceGsfDriver(cartridge, param, minigsf, gsf_driver_addr, throw_if_missing);
+}
+
+void Saptapper::PlaceGsfDriver(const Cartridge& cartridge,
+                               const Mp2kDriverParam& param,
+                               MinigsfDriverParam& minigsf,
+                               agbptr_t& gsf_driver_addr,
+                               bool throw_if_missing) {
   if (throw_if_missing && !param.ok()) {
     std::ostringstream message;
     message << "Identification of MusicPlayer2000 driver is incomplete."
@@ -101,49 +397,150 @@ void Saptapper::Inspect(const Cartridge& cartridge, Mp2kDriverParam& param,
   minigsf.set_size(GetMinigsfSize(param.song_count()));
 }
 
+InspectionResult Saptapper::InspectCartridge(const Cartridge& cartridge,
+                                             const ConvertLimits& limits,
+                                             ThreadPool* pool) {
+  InspectionResult result;
+  result.game_title = cartridge.game_title();
+  result.game_code = cartridge.game_code();
+  result.hashes = cartridge.hashes();
+  result.candidates = Mp2kDriver::InspectCandidates(
+      cartridge.rom(), limits.validate_songs, pool);
+  result.param = Mp2kDriver::ChooseBest(result.candidates);
+  PlaceGsfDriver(cartridge, result.param, result.minigsf,
+                 result.gsf_driver_addr);
+  // The blocks of the instances which ConvertToGsfSet converts.
+  const std::size_t instance_count = std::max<std::size_t>(
+      Mp2kDriver::SelectInstances(cartridge.rom(), result.candidates).size(),
+      1);
+  result.free_spaces = FindFreeSpaceCandidates(
+      cartridge.rom(), Mp2kDriver::gsf_driver_size(), instance_count);
+  return result;
+}
+
+InspectionResult Saptapper::InspectFile(const std::filesystem::path& path,
+                                        unsigned int hash_types,
+                                        const ConvertLimits& limits,
+                                        ThreadPool* pool) {
+  using clock = std::chrono::steady_clock;
+
+  InspectionResult result;
+  try {
+    const auto load_start = clock::now();
+    const Cartridge cartridge = Cartridge::LoadFromFile(path, hash_types);
+    const auto inspect_start = clock::now();
+    result = InspectCartridge(cartridge, limits, pool);
+    const auto inspect_end = clock::now();
+
+    result.load_seconds =
+        std::chrono::duration<double>(inspect_start - load_start).count();
+    result.inspect_seconds =
+        std::chrono::duration<double>(inspect_end - inspect_start).count();
+  } catch (std::exception& e) {
+    result.error = e.what();
+  }
+  result.path = path.string();
+  return result;
+}
+
 void Saptapper::PrintParam(const Mp2kDriverParam& param,
-                           const MinigsfDriverParam& minigsf) {
-  std::cout << "Status: " << (param.ok() ? "OK" : "FAILED") << std::endl
-            << std::endl;
+                           const MinigsfDriverParam& minigsf,
+                           std::ostream& out) {
+  out << "Status: " << (param.ok() ? "OK" : "FAILED") << std::endl
+      << std::endl;
+
+  (void)param.WriteAsTable(out);
+  out << std::endl;
 
-  (void)param.WriteAsTable(std::cout);
-  std::cout << std::endl;
+  out << "minigsf information:" << std::endl << std::endl;
+  (void)minigsf.WriteAsTable(out);
+}
 
-  std::cout << "minigsf information:" << std::endl << std::endl;
-  (void)minigsf.WriteAsTable(std::cout);
+agbptr_t Saptapper::FindFreeSpace(std::string_view rom, agbsize_t size) {
+  const std::vector<agbptr_t> addresses = AllocateFreeSpace(rom, size, 1);
+  return addresses.empty() ? agbnullptr : addresses.front();
 }
 
-agbptr_t Saptapper::FindFreeSpace(std::string_view rom, agbsize_t size,
-                                  char filler, bool largest) {
-  agbptr_t space = agbnullptr;
-  agbsize_t space_size = 0;
-  for (agbsize_t offset = 0; offset < rom.size(); offset += 4) {
-    if (rom[offset] == filler) {
+std::vector<agbptr_t> Saptapper::AllocateFreeSpace(std::string_view rom,
+                                                   agbsize_t size,
+                                                   std::size_t count) {
+  // A block in the middle of a run splits it into two matches for the
+  // compressor, so blocks are taken from the tail of the runs. The run up to
+  // the end of the ROM is usually the padding of the dump, which nothing
+  // uses; the other runs follow from the largest, 0xff before 0x00.
+  std::vector<FreeSpace> runs;
+  for (const char filler : {'\xff', '\0'}) {
+    for (agbsize_t offset = 0; offset < rom.size(); offset += 4) {
+      if (rom[offset] != filler) continue;
+
       agbsize_t end_pos = offset + 1;
       while (end_pos < rom.size() && rom[end_pos] == filler) end_pos++;
+      if (end_pos - offset >= size)
+        runs.push_back(FreeSpace{to_romptr(offset), end_pos - offset, filler});
 
-      const agbsize_t candidate_size = end_pos - offset;
-      if (candidate_size >= size) {
-        if (candidate_size > space_size) {
-          space = to_romptr(offset);
-          space_size = candidate_size;
-          if (!largest) return space;
-        }
+      offset = (end_pos + 3) & ~3;
+    }
+  }
+  const auto rom_size = static_cast<agbsize_t>(rom.size());
+  const auto is_trailing = [&](const FreeSpace& run) {
+    return to_offset(run.address) + run.size == rom_size;
+  };
+  std::stable_sort(runs.begin(), runs.end(),
+                   [&](const FreeSpace& lhs, const FreeSpace& rhs) {
+                     if (is_trailing(lhs) != is_trailing(rhs))
+                       return is_trailing(lhs);
+                     if (lhs.filler != rhs.filler) return lhs.filler != 0;
+                     return lhs.size > rhs.size;
+                   });
+
+  const std::vector<agbsize_t> references = FindFillerReferences(rom);
+  std::vector<agbptr_t> addresses;
+  for (const FreeSpace& run : runs) {
+    const agbsize_t start = to_offset(run.address);
+    agbsize_t end = start + run.size;
+    while (addresses.size() < count && end - start >= size) {
+      const agbsize_t pos = (end - size) & ~3;
+      if (pos < start) break;
+
+      // Something refers to the filler, such as a zero-filled table. The
+      // block has to end before the last reference into it.
+      const auto reference =
+          std::lower_bound(references.begin(), references.end(), pos + size);
+      if (reference != references.begin() && *std::prev(reference) >= pos) {
+        end = *std::prev(reference);
+        continue;
       }
 
-      offset = (end_pos + 3) & ~3;
+      addresses.push_back(to_romptr(pos));
+      end = pos;
     }
   }
-  return space;
+  return addresses;
 }
 
-agbptr_t Saptapper::FindFreeSpace(std::string_view rom, agbsize_t size) {
-  constexpr bool largest = false;
-  agbptr_t addr = FindFreeSpace(rom, size, '\xff', largest);
-  if (addr == agbnullptr) {
-    addr = FindFreeSpace(rom, size, 0, largest);
+std::vector<agbsize_t> Saptapper::FindFillerReferences(std::string_view rom) {
+  std::vector<agbsize_t> references;
+  for (agbsize_t offset = 0; offset + 4 <= rom.size(); offset += 4) {
+    const agbptr_t pointer = ReadInt32L(&rom[offset]);
+    if (!is_romptr(pointer)) continue;
+
+    const agbsize_t target = to_offset(pointer);
+    if (target < rom.size() && (rom[target] == '\xff' || rom[target] == '\0'))
+      references.push_back(target);
   }
-  return addr;
+  std::sort(references.begin(), references.end());
+  references.erase(std::unique(references.begin(), references.end()),
+                   references.end());
+  return references;
+}
+
+std::vector<FreeSpace> Saptapper::FindFreeSpaceCandidates(std::string_view rom,
+                                                          agbsize_t size,
+                                                          std::size_t count) {
+  std::vector<FreeSpace> candidates;
+  for (const agbptr_t address : AllocateFreeSpace(rom, size, count))
+    candidates.push_back(FreeSpace{address, size, rom[to_offset(address)]});
+  return candidates;
 }
 
 }  // namespace saptapper
@@ -3,26 +3,100 @@
 #ifndef SAPTAPPER_SAPTAPPER_HPP_
 #define SAPTAPPER_SAPTAPPER_HPP_
 
+#include <cstdint>
 #include <filesystem>
+#include <iostream>
 #include <map>
 #include <string>
 #include <string_view>
+#include <vector>
 #include "cartridge.hpp"
+#include "deflater.hpp"
+#include "inspection.hpp"
 #include "minigsf_driver_param.hpp"
 #include "mp2k_driver_param.hpp"
+#include "rom_hashes.hpp"
+#include "song_selection.hpp"
+#include "thread_pool.hpp"
 #include "types.hpp"
 
 namespace saptapper {
 
+/// Hard limits of the work on a ROM, so that a malformed ROM fails fast
+/// rather than stalling the batch. Zero disables a limit.
+struct ConvertLimits {
+  /// The maximum number of song table entries to be converted.
+  int max_song_count = 8192;
+
+  /// The maximum time of the conversion, in seconds.
+  double max_seconds = 0;
+
+  /// The maximum total size of the files of the ROM, in bytes.
+  std::uintmax_t max_output_size = 0;
+
+  /// End the song table at the first entry which does not point to a valid
+  /// song header, rather than at the first entry which is not a ROM pointer.
+  bool validate_songs = true;
+};
+
+/// Options of Saptapper::ConvertToGsfSet.
+struct ConvertOptions {
+  /// The creator name to be tagged to minigsfs.
+  std::string gsfby;
+
+  /// Save all songs including duplicated ones.
+  bool keep_duplicated = false;
+
+  /// Save the songs which play no note, such as the dummy entries of the
+  /// song table.
+  bool keep_silent = false;
+
+  /// The songs to be saved. The limit counts the songs after skipping the
+  /// duplicated and silent ones.
+  SongSelection songs;
+
+  /// The directory of the content-addressed gsflib store, or empty to write
+  /// gsflibs directly.
+  std::filesystem::path store_dir;
+
+  /// The compression profile of the gsflib.
+  CompressionProfile compression = CompressionProfile::kBalanced;
+
+  /// Skip the files which are identical to the previous run, by using the
+  /// manifest saved next to the outputs.
+  bool incremental = false;
+
+  /// Run each song on the built-in interpreter before saving it, and fail
+  /// unless the sound driver is called as intended.
+  bool smoke_test = false;
+
+  /// The number of threads which write the minigsfs while the gsflib is
+  /// compressed, or 0 for the number of CPUs.
+  unsigned int thread_count = 0;
+
+  ConvertLimits limits;
+};
+
 class Saptapper {
  public:
-  static void ConvertToGsfSet(Cartridge& cartridge,
-                              const std::filesystem::path& basename,
-                              const std::filesystem::path& outdir = "",
-                              const std::string_view& gsfby = "",
-                              bool keep_duplicated = false);
+  static constexpr const char* kVersion = "2.0";
 
-  static void SaveMinigsfFile(
+  /// Saves the gsflib and the minigsfs of the cartridge.
+  ///
+  /// A set is saved for each driver instance of the cartridge. The first set
+  /// is named after the basename, and the others are suffixed with "-2",
+  /// "-3" and so on.
+  ///
+  /// The cartridge is not modified: the gsf driver is applied as an overlay
+  /// while the gsflib is compressed. The minigsfs are written in parallel
+  /// with the compression, and the gsflib is renamed into place after them.
+  /// Concurrent calls are safe as long as they write to different files.
+  static std::vector<std::filesystem::path> ConvertToGsfSet(
+      const Cartridge& cartridge, const std::filesystem::path& basename,
+      const std::filesystem::path& outdir = "",
+      const ConvertOptions& options = {});
+
+  static std::filesystem::path SaveMinigsfFile(
       const std::filesystem::path& base_path, const MinigsfDriverParam& minigsf,
       int song, const std::map<std::string, std::string>& tags = {});
 
@@ -30,13 +104,67 @@ class Saptapper {
                       MinigsfDriverParam& minigsf, agbptr_t& gsf_driver_addr,
                       bool throw_if_missing = false);
 
+  /// Inspects the cartridge, including the alternative driver candidates.
+  /// The song tables are validated as ConvertToGsfSet does with the limits.
+  /// Large ROMs are scanned on the pool, if one is given.
+  static InspectionResult InspectCartridge(const Cartridge& cartridge,
+                                           const ConvertLimits& limits = {},
+                                           ThreadPool* pool = nullptr);
+
+  /// Inspects the file, with the hashes of the given types.
+  static InspectionResult InspectFile(
+      const std::filesystem::path& path,
+      unsigned int hash_types = RomHashes::kNone,
+      const ConvertLimits& limits = {}, ThreadPool* pool = nullptr);
+
+  /// Returns the hashes which ConvertToGsfSet uses with the options, to be
+  /// computed while the cartridge is loaded.
+  static unsigned int hash_types(const ConvertOptions& options) noexcept {
+    return options.incremental ? RomHashes::kSha1 : RomHashes::kNone;
+  }
+
+  /// Allocates non-overlapping blocks from the free space of the ROM, one
+  /// for each driver instance. Fewer blocks are returned if the space runs
+  /// out.
+  ///
+  /// The blocks are taken from the tail of the runs of 0xff or 0x00, the run
+  /// at the end of the ROM first, so that the runs stay in one piece. Blocks
+  /// which a ROM pointer refers into are not used.
+  static std::vector<agbptr_t> AllocateFreeSpace(std::string_view rom,
+                                                 agbsize_t size,
+                                                 std::size_t count);
+
+  /// Returns the blocks which AllocateFreeSpace takes for the count
+  /// instances, in that order, with their fillers.
+  static std::vector<FreeSpace> FindFreeSpaceCandidates(std::string_view rom,
+                                                        agbsize_t size,
+                                                        std::size_t count);
+
   static void PrintParam(const Mp2kDriverParam& param,
-                         const MinigsfDriverParam& minigsf);
+                         const MinigsfDriverParam& minigsf,
+                         std::ostream& out = std::cout);
 
  private:
+  /// The number of minigsfs written by a task of ConvertToGsfSet.
+  static constexpr std::size_t kSongBatchSize = 64;
+
+  static std::filesystem::path GetMinigsfPath(
+      const std::filesystem::path& base_path, int song);
+
+  static std::string DescribeOptions(const std::filesystem::path& basename,
+                                     const ConvertOptions& options);
+
+  static void PlaceGsfDriver(const Cartridge& cartridge,
+                             const Mp2kDriverParam& param,
+                             MinigsfDriverParam& minigsf,
+                             agbptr_t& gsf_driver_addr,
+                             bool throw_if_missing = false);
+
   static agbptr_t FindFreeSpace(std::string_view rom, agbsize_t size);
-  static agbptr_t FindFreeSpace(std::string_view rom, agbsize_t size,
-                                char filler, bool largest);
+
+  /// Returns the offsets of the filler bytes which a word of the ROM points
+  /// to, in ascending order.
+  static std::vector<agbsize_t> FindFillerReferences(std::string_view rom);
 
   static constexpr agbsize_t GetMinigsfSize(int song_count) {
     if (song_count <= 0) return 0;
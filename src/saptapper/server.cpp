@@ -0,0 +1,187 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "buffer_pool.hpp"
+#include "cartridge.hpp"
+#include "inspection.hpp"
+#include "saptapper.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+static std::vector<std::string> SplitFields(std::string_view line) {
+  std::vector<std::string> fields;
+  std::string_view::size_type start = 0;
+  while (true) {
+    const auto end = line.find('\t', start);
+    fields.emplace_back(line.substr(start, end - start));
+    if (end == std::string_view::npos) break;
+    start = end + 1;
+  }
+  return fields;
+}
+
+Server::Server(ConvertOptions options, unsigned int thread_count)
+    : options_{std::move(options)},
+      thread_count_{ThreadPool::ResolveThreadCount(thread_count)} {
+  // The requests are already processed in parallel.
+  options_.thread_count = 1;
+}
+
+void Server::Serve(std::istream& in, std::ostream& out) {
+  std::mutex out_mutex;
+  ThreadPool pool{thread_count_, thread_count_};
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+
+    std::vector<std::string> fields = SplitFields(line);
+    Request request;
+    request.id = fields[0];
+    if (fields.size() < 2) {
+      std::lock_guard lock{out_mutex};
+      WriteResponse(out, request.id, "error", "Missing command.");
+      continue;
+    }
+    request.command = fields[1];
+    request.args.assign(fields.begin() + 2, fields.end());
+
+    // The ROM bytes must be consumed here to keep the framing in sync.
+    if (request.command == "inspect-rom" || request.command == "convert-rom") {
+      std::size_t size = 0;
+      try {
+        // std::stoul accepts signs and spaces, and wraps "-1" around.
+        if (request.args.empty() || request.args[0].empty() ||
+            !std::all_of(request.args[0].begin(), request.args[0].end(),
+                         [](unsigned char c) { return std::isdigit(c); }))
+          throw std::invalid_argument("size");
+        size = std::stoul(request.args[0]);
+      } catch (std::exception&) {
+        std::lock_guard lock{out_mutex};
+        WriteResponse(out, request.id, "error", "Invalid ROM size.");
+        break;  // the stream cannot be resynchronized
+      }
+
+      if (size > Cartridge::kMaximumSize) {
+        in.ignore(size);
+        std::lock_guard lock{out_mutex};
+        WriteResponse(out, request.id, "error", "The input data too large.");
+        continue;
+      }
+
+      request.rom = BufferPool::Default().Acquire(size);
+      if (!in.read(request.rom.data(), size)) {
+        std::lock_guard lock{out_mutex};
+        WriteResponse(out, request.id, "error", "Unexpected end of input.");
+        break;
+      }
+    }
+
+    // std::function needs a copyable task, while the ROM buffer is not.
+    auto task = [this, &out, &out_mutex,
+                 request = std::make_shared<Request>(std::move(request))] {
+      std::string status = "ok";
+      std::string payload;
+      try {
+        payload = Process(*request);
+      } catch (std::exception& e) {
+        status = "error";
+        payload = e.what();
+      } catch (...) {
+        // The client waits for a response to each request.
+        status = "error";
+        payload = "Unknown error.";
+      }
+
+      std::lock_guard lock{out_mutex};
+      WriteResponse(out, request->id, status, payload);
+    };
+    pool.Submit(std::move(task));
+  }
+
+  pool.Wait();
+}
+
+std::string Server::Process(Request& request) {
+  const auto& command = request.command;
+  const auto& args = request.args;
+  const bool from_rom = command == "inspect-rom" || command == "convert-rom";
+
+  std::size_t min_args = 0;
+  if (command == "inspect") {
+    min_args = 1;
+  } else if (command == "inspect-rom") {
+    min_args = 1;
+  } else if (command == "convert") {
+    min_args = 2;
+  } else if (command == "convert-rom") {
+    min_args = 3;
+  } else {
+    throw std::invalid_argument("Unknown command \"" + command + "\".");
+  }
+  if (args.size() < min_args)
+    throw std::invalid_argument("Too few arguments for " + command + ".");
+
+  std::ostringstream payload;
+  if (command == "inspect") {
+    const InspectionResult result =
+        Saptapper::InspectFile(args[0], hash_types_, options_.limits);
+    if (!result.error.empty()) throw std::runtime_error(result.error);
+    InspectionWriter writer{payload, format_};
+    writer.Begin();
+    writer.Write(result);
+    writer.End();
+    return payload.str();
+  }
+
+  const unsigned int hash_types = command == "inspect-rom"
+                                     ? hash_types_
+                                     : Saptapper::hash_types(options_);
+  Cartridge cartridge =
+      from_rom ? Cartridge::LoadFromBuffer(std::move(request.rom), hash_types)
+               : Cartridge::LoadFromFile(args[0], hash_types);
+
+  if (command == "inspect-rom") {
+    const InspectionResult result =
+        Saptapper::InspectCartridge(cartridge, options_.limits);
+    InspectionWriter writer{payload, format_};
+    writer.Begin();
+    writer.Write(result);
+    writer.End();
+  } else {
+    const std::filesystem::path outdir{args[1]};
+    const std::filesystem::path basename{
+        args.size() >= 3 ? std::filesystem::path{args[2]}
+                         : std::filesystem::path{args[0]}.stem()};
+    const auto paths = Saptapper::ConvertToGsfSet(
+        cartridge, basename, outdir, options_);
+    for (const auto& path : paths) payload << path.string() << '\n';
+  }
+
+  return payload.str();
+}
+
+void Server::WriteResponse(std::ostream& out, std::string_view id,
+                           std::string_view status, std::string_view payload) {
+  out << id << '\t' << status << '\t' << payload.size() << '\n';
+  out.write(payload.data(), payload.size());
+  out.flush();
+}
+
+}  // namespace saptapper
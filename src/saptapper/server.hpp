@@ -0,0 +1,75 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_SERVER_HPP_
+#define SAPTAPPER_SERVER_HPP_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer_pool.hpp"
+#include "inspection.hpp"
+#include "saptapper.hpp"
+
+namespace saptapper {
+
+/// Long-running request processor for the --serve mode.
+///
+/// Requests are read from an input stream and responses are written to an
+/// output stream, both framed as follows. Fields are separated by a tab.
+///
+/// Request:  <id> TAB <command> [TAB <argument>...] LF [<payload>]
+/// Response: <id> TAB ok|error TAB <size> LF <payload of size bytes>
+///
+/// Commands:
+///   inspect <romfile>
+///   inspect-rom <size> (followed by the ROM bytes)
+///   convert <romfile> <outdir> [<basename>]
+///   convert-rom <size> <outdir> <basename> (followed by the ROM bytes)
+///
+/// The payload of a successful inspect is the inspection result, and that of
+/// a successful convert is the list of written files, one per line. Requests
+/// are processed concurrently, so responses may arrive out of order.
+class Server {
+ public:
+  explicit Server(ConvertOptions options, unsigned int thread_count = 0);
+
+  InspectionWriter::Format format() const noexcept { return format_; }
+
+  /// Sets the format of the inspection results.
+  void set_format(InspectionWriter::Format format) noexcept {
+    format_ = format;
+  }
+
+  /// The hashes of the inspection results (RomHashes::Type flags).
+  unsigned int hash_types() const noexcept { return hash_types_; }
+  void set_hash_types(unsigned int hash_types) noexcept {
+    hash_types_ = hash_types;
+  }
+
+  /// Processes requests until the end of the input.
+  void Serve(std::istream& in, std::ostream& out);
+
+ private:
+  struct Request {
+    std::string id;
+    std::string command;
+    std::vector<std::string> args;
+    PooledBuffer rom;
+  };
+
+  ConvertOptions options_;
+  unsigned int thread_count_;
+  InspectionWriter::Format format_ = InspectionWriter::Format::kTable;
+  unsigned int hash_types_ = RomHashes::kNone;
+
+  std::string Process(Request& request);
+
+  static void WriteResponse(std::ostream& out, std::string_view id,
+                            std::string_view status, std::string_view payload);
+};
+
+}  // namespace saptapper
+
+#endif
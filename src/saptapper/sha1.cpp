@@ -0,0 +1,254 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAPTAPPER_USE_SHA_NI
+#define SAPTAPPER_TARGET_SHA __attribute__((target("sse4.1,sha")))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SAPTAPPER_USE_SHA_NI
+#define SAPTAPPER_TARGET_SHA
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace saptapper {
+
+static inline std::uint32_t rotl32(std::uint32_t value, int shift) noexcept {
+  return (value << shift) | (value >> (32 - shift));
+}
+
+static inline std::uint32_t load_be32(const std::uint8_t* p) noexcept {
+  return (static_cast<std::uint32_t>(p[0]) << 24) |
+         (static_cast<std::uint32_t>(p[1]) << 16) |
+         (static_cast<std::uint32_t>(p[2]) << 8) | p[3];
+}
+
+void Sha1::Reset() noexcept {
+  state_ = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  buffer_size_ = 0;
+  length_ = 0;
+}
+
+void Sha1::Update(const void* data, std::size_t size) noexcept {
+  auto p = static_cast<const std::uint8_t*>(data);
+  length_ += size;
+
+  if (buffer_size_ != 0) {
+    const std::size_t fill = std::min(kBlockSize - buffer_size_, size);
+    std::memcpy(&buffer_[buffer_size_], p, fill);
+    buffer_size_ += fill;
+    p += fill;
+    size -= fill;
+    if (buffer_size_ < kBlockSize) return;
+    ProcessBlocks(buffer_.data(), 1);
+    buffer_size_ = 0;
+  }
+
+  const std::size_t count = size / kBlockSize;
+  if (count != 0) {
+    ProcessBlocks(p, count);
+    p += count * kBlockSize;
+    size -= count * kBlockSize;
+  }
+
+  if (size != 0) {
+    std::memcpy(buffer_.data(), p, size);
+    buffer_size_ = size;
+  }
+}
+
+Sha1::digest_type Sha1::Finish() noexcept {
+  const std::uint64_t bit_length = length_ * 8;
+
+  std::uint8_t padding[kBlockSize * 2]{0x80};
+  const std::size_t padding_size =
+      (buffer_size_ < 56 ? 56 - buffer_size_ : 120 - buffer_size_);
+  std::uint8_t length_bytes[8];
+  for (int i = 0; i < 8; i++)
+    length_bytes[i] = static_cast<std::uint8_t>(bit_length >> (56 - 8 * i));
+  Update(padding, padding_size);
+  Update(length_bytes, sizeof(length_bytes));
+
+  digest_type digest;
+  for (std::size_t i = 0; i < state_.size(); i++) {
+    digest[i * 4] = static_cast<std::uint8_t>(state_[i] >> 24);
+    digest[i * 4 + 1] = static_cast<std::uint8_t>(state_[i] >> 16);
+    digest[i * 4 + 2] = static_cast<std::uint8_t>(state_[i] >> 8);
+    digest[i * 4 + 3] = static_cast<std::uint8_t>(state_[i]);
+  }
+  return digest;
+}
+
+std::string Sha1::ToHex(const digest_type& digest) {
+  static constexpr char kHexDigits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(digest.size() * 2);
+  for (const auto byte : digest) {
+    hex.push_back(kHexDigits[byte >> 4]);
+    hex.push_back(kHexDigits[byte & 15]);
+  }
+  return hex;
+}
+
+#ifdef SAPTAPPER_USE_SHA_NI
+
+static bool HasShaNi() noexcept {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  const auto ecx1 = static_cast<unsigned int>(info[2]);
+  __cpuidex(info, 7, 0);
+  const auto ebx7 = static_cast<unsigned int>(info[1]);
+#else
+  unsigned int eax, ebx, ecx1, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx1, &edx)) return false;
+  unsigned int ebx7, ecx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx)) return false;
+#endif
+  const bool ssse3 = (ecx1 & (1u << 9)) != 0;
+  const bool sse41 = (ecx1 & (1u << 19)) != 0;
+  const bool sha = (ebx7 & (1u << 29)) != 0;
+  return ssse3 && sse41 && sha;
+}
+
+static const bool kHasShaNi = HasShaNi();
+
+SAPTAPPER_TARGET_SHA
+static inline __m128i Rounds4(__m128i abcd, __m128i e, int group) noexcept {
+  // The function and the constant change every 20 rounds.
+  switch (group / 5) {
+    case 0:
+      return _mm_sha1rnds4_epu32(abcd, e, 0);
+    case 1:
+      return _mm_sha1rnds4_epu32(abcd, e, 1);
+    case 2:
+      return _mm_sha1rnds4_epu32(abcd, e, 2);
+    default:
+      return _mm_sha1rnds4_epu32(abcd, e, 3);
+  }
+}
+
+// Processes the blocks with the SHA extensions, four rounds per instruction.
+// The message schedule of the group g is kept in msg[g % 4], and is completed
+// over the three groups before it.
+SAPTAPPER_TARGET_SHA
+static void ProcessBlocksShaNi(std::uint32_t* state, const std::uint8_t* data,
+                               std::size_t count) noexcept {
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+  __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+  for (; count != 0; count--, data += 64) {
+    const __m128i abcd_save = abcd;
+    const __m128i e0_save = e0;
+
+    __m128i msg[4];
+    for (int i = 0; i < 4; i++) {
+      msg[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)),
+          byte_swap);
+    }
+
+    __m128i e[2] = {e0, e0};
+#ifdef __GNUC__
+#pragma GCC unroll 20
+#endif
+    for (int g = 0; g < 20; g++) {
+      __m128i& current = e[g & 1];
+      const __m128i w = msg[g & 3];
+      current = g == 0 ? _mm_add_epi32(current, w)
+                       : _mm_sha1nexte_epu32(current, w);
+      e[(g + 1) & 1] = abcd;
+      abcd = Rounds4(abcd, current, g);
+
+      if (g >= 3 && g + 1 < 20)
+        msg[(g + 1) & 3] = _mm_sha1msg2_epu32(msg[(g + 1) & 3], w);
+      if (g >= 2 && g + 2 < 20)
+        msg[(g + 2) & 3] = _mm_xor_si128(msg[(g + 2) & 3], w);
+      if (g >= 1 && g + 3 < 20)
+        msg[(g + 3) & 3] = _mm_sha1msg1_epu32(msg[(g + 3) & 3], w);
+    }
+
+    e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+#endif
+
+bool Sha1::accelerated() noexcept {
+#ifdef SAPTAPPER_USE_SHA_NI
+  return kHasShaNi;
+#else
+  return false;
+#endif
+}
+
+void Sha1::ProcessBlocks(const std::uint8_t* data, std::size_t count) noexcept {
+#ifdef SAPTAPPER_USE_SHA_NI
+  if (kHasShaNi) {
+    ProcessBlocksShaNi(state_.data(), data, count);
+    return;
+  }
+#endif
+
+  for (; count != 0; count--, data += kBlockSize) {
+    std::uint32_t w[80];
+    for (int t = 0; t < 16; t++) w[t] = load_be32(data + t * 4);
+    for (int t = 16; t < 80; t++)
+      w[t] = rotl32(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+
+    std::uint32_t a = state_[0];
+    std::uint32_t b = state_[1];
+    std::uint32_t c = state_[2];
+    std::uint32_t d = state_[3];
+    std::uint32_t e = state_[4];
+    for (int t = 0; t < 80; t++) {
+      std::uint32_t f;
+      std::uint32_t k;
+      if (t < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (t < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (t < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      const std::uint32_t temp = rotl32(a, 5) + f + e + k + w[t];
+      e = d;
+      d = c;
+      c = rotl32(b, 30);
+      b = a;
+      a = temp;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+  }
+}
+
+}  // namespace saptapper
@@ -0,0 +1,59 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_SHA1_HPP_
+#define SAPTAPPER_SHA1_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace saptapper {
+
+/// SHA-1 message digest (FIPS 180-4).
+///
+/// Blocks are processed with the SHA extensions (SHA-NI) when the CPU has
+/// them.
+class Sha1 {
+ public:
+  using digest_type = std::array<std::uint8_t, 20>;
+
+  Sha1() { Reset(); }
+
+  void Reset() noexcept;
+
+  void Update(const void* data, std::size_t size) noexcept;
+
+  void Update(std::string_view data) noexcept {
+    Update(data.data(), data.size());
+  }
+
+  /// Finishes the computation. Call Reset before reusing the object.
+  digest_type Finish() noexcept;
+
+  static digest_type Digest(std::string_view data) noexcept {
+    Sha1 sha1;
+    sha1.Update(data);
+    return sha1.Finish();
+  }
+
+  static std::string ToHex(const digest_type& digest);
+
+  /// Returns true if the SHA extensions are used.
+  static bool accelerated() noexcept;
+
+ private:
+  static constexpr std::size_t kBlockSize = 64;
+
+  std::array<std::uint32_t, 5> state_;
+  std::array<std::uint8_t, kBlockSize> buffer_;
+  std::size_t buffer_size_;
+  std::uint64_t length_;
+
+  void ProcessBlocks(const std::uint8_t* data, std::size_t count) noexcept;
+};
+
+}  // namespace saptapper
+
+#endif
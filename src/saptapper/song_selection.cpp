@@ -0,0 +1,132 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "song_selection.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "bytes.hpp"
+#include "mp2k_driver.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+static int ParseSongNumber(std::string_view str, std::string_view spec) {
+  int value = 0;
+  const auto result = std::from_chars(str.data(), str.data() + str.size(),
+                                      value);
+  if (str.empty() || result.ec != std::errc{} ||
+      result.ptr != str.data() + str.size() || value < 0) {
+    throw std::invalid_argument("Invalid song selection \"" +
+                                std::string(spec) + "\".");
+  }
+  return value;
+}
+
+SongSelection SongSelection::Parse(std::string_view spec) {
+  SongSelection selection;
+  std::string_view rest = spec;
+  while (true) {
+    const std::size_t comma = rest.find(',');
+    const std::string_view item = rest.substr(0, comma);
+    const std::size_t dash = item.find('-');
+    Range range;
+    range.first = ParseSongNumber(item.substr(0, dash), spec);
+    if (dash == std::string_view::npos) {
+      range.last = range.first;
+    } else if (dash + 1 < item.size()) {
+      range.last = ParseSongNumber(item.substr(dash + 1), spec);
+      if (*range.last < range.first) {
+        throw std::invalid_argument("Invalid song selection \"" +
+                                    std::string(spec) + "\".");
+      }
+    }
+    selection.ranges_.push_back(range);
+
+    if (comma == std::string_view::npos) break;
+    rest.remove_prefix(comma + 1);
+  }
+  return selection;
+}
+
+bool SongSelection::Contains(int song) const noexcept {
+  if (ranges_.empty()) return true;
+  return std::any_of(ranges_.begin(), ranges_.end(), [song](const Range& r) {
+    return song >= r.first && (!r.last || song <= *r.last);
+  });
+}
+
+std::optional<int> SongSelection::last() const noexcept {
+  if (ranges_.empty()) return std::nullopt;
+  int last = 0;
+  for (const Range& range : ranges_) {
+    if (!range.last) return std::nullopt;
+    last = std::max(last, *range.last);
+  }
+  return last;
+}
+
+std::string SongSelection::ToString() const {
+  std::ostringstream str;
+  if (ranges_.empty()) str << "all";
+  for (std::size_t i = 0; i < ranges_.size(); i++) {
+    const Range& range = ranges_[i];
+    if (i != 0) str << ',';
+    str << range.first;
+    if (!range.last) {
+      str << '-';
+    } else if (*range.last != range.first) {
+      str << '-' << *range.last;
+    }
+  }
+  if (limit_ != 0) str << ";limit=" << limit_;
+  return str.str();
+}
+
+SongEnumerator::SongEnumerator(std::string_view rom,
+                               const Mp2kDriverParam& param,
+                               SongSelection selection, bool skip_duplicated,
+                               bool skip_silent)
+    : rom_{rom},
+      table_offset_{to_offset(param.song_table())},
+      song_count_{param.song_table() != agbnullptr ? param.song_count() : 0},
+      selection_{std::move(selection)},
+      skip_duplicated_{skip_duplicated},
+      skip_silent_{skip_silent} {
+  const std::optional<int> last = selection_.last();
+  if (last) song_count_ = std::min(song_count_, *last + 1);
+}
+
+std::optional<SongDescriptor> SongEnumerator::Next() {
+  constexpr agbsize_t kEntrySize = 8;
+  while (next_song_ < song_count_) {
+    if (selection_.limit() != 0 && yielded_ >= selection_.limit()) break;
+
+    const int song = next_song_++;
+    const agbsize_t pos = table_offset_ + kEntrySize * song;
+    if (pos + kEntrySize > rom_.size()) break;
+
+    SongDescriptor descriptor{song, ReadInt32L(&rom_[pos]),
+                              Mp2kDriver::kNoSong};
+    const auto [first, inserted] =
+        first_songs_.emplace(ReadInt64L(&rom_[pos]), song);
+    // An entry at the very end of the ROM is never a duplicate, as in
+    // Mp2kDriver::FindIdenticalSong.
+    if (!inserted && pos + kEntrySize < rom_.size())
+      descriptor.origin = first->second;
+
+    if (skip_duplicated_ && descriptor.origin != Mp2kDriver::kNoSong) continue;
+    if (!selection_.Contains(song)) continue;
+    if (skip_silent_ && Mp2kDriver::IsSilentSong(rom_, descriptor.header))
+      continue;
+    yielded_++;
+    return descriptor;
+  }
+  return std::nullopt;
+}
+
+}  // namespace saptapper
@@ -0,0 +1,89 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_SONG_SELECTION_HPP_
+#define SAPTAPPER_SONG_SELECTION_HPP_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "mp2k_driver_param.hpp"
+#include "types.hpp"
+
+namespace saptapper {
+
+/// Set of song numbers to be converted, such as "0-9,12,20-".
+class SongSelection {
+ public:
+  /// Selects all songs.
+  SongSelection() = default;
+
+  /// Parses comma-separated song numbers and ranges. A range without the end
+  /// ("20-") continues to the last song. Throws std::invalid_argument if the
+  /// selection is malformed.
+  static SongSelection Parse(std::string_view spec);
+
+  bool all() const noexcept { return ranges_.empty() && limit_ == 0; }
+
+  /// The maximum number of songs to be enumerated, or 0 for no limit.
+  int limit() const noexcept { return limit_; }
+  void set_limit(int limit) noexcept { limit_ = limit; }
+
+  bool Contains(int song) const noexcept;
+
+  /// Returns the largest selected song number, or nullopt if unbounded.
+  std::optional<int> last() const noexcept;
+
+  std::string ToString() const;
+
+ private:
+  struct Range {
+    int first;
+    std::optional<int> last;
+  };
+
+  std::vector<Range> ranges_;
+  int limit_ = 0;
+};
+
+/// A song of the song table.
+struct SongDescriptor {
+  int number;
+  agbptr_t header;
+  /// The first song which has the same table entry, or Mp2kDriver::kNoSong.
+  int origin;
+};
+
+/// Walks the song table on demand, yielding the selected songs in the order
+/// of the table.
+///
+/// Only the part of the table up to the last yielded song is read, and the
+/// duplicate check costs O(1) per song. Silent songs are skipped after the
+/// selection, so only the selected songs are parsed.
+class SongEnumerator {
+ public:
+  SongEnumerator(std::string_view rom, const Mp2kDriverParam& param,
+                 SongSelection selection, bool skip_duplicated = true,
+                 bool skip_silent = false);
+
+  /// Returns the next song, or nullopt when there are no more songs.
+  std::optional<SongDescriptor> Next();
+
+ private:
+  std::string_view rom_;
+  agbsize_t table_offset_;
+  int song_count_;
+  SongSelection selection_;
+  bool skip_duplicated_;
+  bool skip_silent_;
+  int next_song_ = 0;
+  int yielded_ = 0;
+  // The first song of each table entry.
+  std::unordered_map<std::uint64_t, int> first_songs_;
+};
+
+}  // namespace saptapper
+
+#endif
@@ -9,10 +9,12 @@
 
 namespace saptapper {
 
-template <class _Ty, size_t _NumOfColumns, size_t _NumOfRows>
-static std::ostream& tabulate(
-    std::ostream& stream, std::array<_Ty, _NumOfColumns> header,
-    std::array<std::array<_Ty, _NumOfColumns>, _NumOfRows> items) {
+/// Writes the rows as a table. The rows can be any container of
+/// std::array<_Ty, _NumOfColumns>.
+template <class _Ty, size_t _NumOfColumns, class _Rows>
+static std::ostream& tabulate(std::ostream& stream,
+                              std::array<_Ty, _NumOfColumns> header,
+                              const _Rows& items) {
   // Determine column lengths.
   //
   // Note that it doesn't calculate proper lengths for non-ASCII characters.
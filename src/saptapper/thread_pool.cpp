@@ -0,0 +1,80 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "thread_pool.hpp"
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace saptapper {
+
+ThreadPool::ThreadPool(unsigned int thread_count, std::size_t max_queued)
+    : max_queued_{max_queued} {
+  thread_count = ResolveThreadCount(thread_count);
+  threads_.reserve(thread_count);
+  for (unsigned int i = 0; i < thread_count; i++)
+    threads_.emplace_back(&ThreadPool::RunWorker, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock lock{mutex_};
+    stopping_ = true;
+  }
+  task_available_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::unique_lock lock{mutex_};
+    queue_available_.wait(lock, [this] {
+      return max_queued_ == 0 || tasks_.size() < max_queued_;
+    });
+    tasks_.push(std::move(task));
+  }
+  task_available_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock lock{mutex_};
+  idle_.wait(lock, [this] { return tasks_.empty() && running_ == 0; });
+}
+
+unsigned int ThreadPool::ResolveThreadCount(
+    unsigned int thread_count) noexcept {
+  if (thread_count != 0) return thread_count;
+  const unsigned int hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads != 0 ? hardware_threads : 1;
+}
+
+void ThreadPool::RunWorker() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{mutex_};
+      task_available_.wait(lock,
+                           [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;  // stopping
+      task = std::move(tasks_.front());
+      tasks_.pop();
+      running_++;
+    }
+    queue_available_.notify_one();
+
+    try {
+      task();
+    } catch (...) {
+      // Submit does not report errors. Async stores them in the future.
+    }
+
+    {
+      std::unique_lock lock{mutex_};
+      running_--;
+      if (tasks_.empty() && running_ == 0) idle_.notify_all();
+    }
+  }
+}
+
+}  // namespace saptapper
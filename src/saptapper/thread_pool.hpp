@@ -0,0 +1,78 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_THREAD_POOL_HPP_
+#define SAPTAPPER_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace saptapper {
+
+/// Fixed-size pool of worker threads with a bounded task queue.
+class ThreadPool {
+ public:
+  /// Starts the worker threads.
+  /// @param thread_count the number of threads, or 0 for the number of
+  /// hardware threads.
+  /// @param max_queued the maximum number of tasks waiting for a worker, or 0
+  /// for no limit. Submit blocks while the queue is full.
+  explicit ThreadPool(unsigned int thread_count = 0,
+                      std::size_t max_queued = 0);
+
+  /// Waits for all tasks to finish and stops the worker threads.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned int size() const noexcept {
+    return static_cast<unsigned int>(threads_.size());
+  }
+
+  /// Queues a task. Exceptions thrown from the task are discarded, use Async
+  /// to receive them.
+  void Submit(std::function<void()> task);
+
+  /// Queues a task and returns the future of its result.
+  template <typename Function>
+  auto Async(Function&& function)
+      -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+    using result_t = std::invoke_result_t<std::decay_t<Function>>;
+    auto task = std::make_shared<std::packaged_task<result_t()>>(
+        std::forward<Function>(function));
+    std::future<result_t> result = task->get_future();
+    Submit([task] { (*task)(); });
+    return result;
+  }
+
+  /// Waits until all queued tasks have finished.
+  void Wait();
+
+  /// Returns the number of threads to use for the given setting.
+  static unsigned int ResolveThreadCount(unsigned int thread_count) noexcept;
+
+ private:
+  std::vector<std::thread> threads_;
+  std::queue<std::function<void()>> tasks_;
+  std::size_t max_queued_;
+  std::size_t running_ = 0;
+  bool stopping_ = false;
+  std::mutex mutex_;
+  std::condition_variable task_available_;
+  std::condition_variable queue_available_;
+  std::condition_variable idle_;
+
+  void RunWorker();
+};
+
+}  // namespace saptapper
+
+#endif
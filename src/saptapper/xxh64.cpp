@@ -0,0 +1,121 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#include "xxh64.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "bytes.hpp"
+
+namespace saptapper {
+
+static constexpr std::uint64_t kPrime1 = 0x9e3779b185ebca87;
+static constexpr std::uint64_t kPrime2 = 0xc2b2ae3d27d4eb4f;
+static constexpr std::uint64_t kPrime3 = 0x165667b19e3779f9;
+static constexpr std::uint64_t kPrime4 = 0x85ebca77c2b2ae63;
+static constexpr std::uint64_t kPrime5 = 0x27d4eb2f165667c5;
+
+static inline std::uint64_t rotl64(std::uint64_t value, int shift) noexcept {
+  return (value << shift) | (value >> (64 - shift));
+}
+
+static inline std::uint64_t Round(std::uint64_t acc,
+                                  std::uint64_t input) noexcept {
+  acc += input * kPrime2;
+  acc = rotl64(acc, 31);
+  return acc * kPrime1;
+}
+
+static inline std::uint64_t MergeRound(std::uint64_t acc,
+                                       std::uint64_t value) noexcept {
+  acc ^= Round(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+void Xxh64::Reset(std::uint64_t seed) noexcept {
+  acc_ = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+  buffer_size_ = 0;
+  length_ = 0;
+  seed_ = seed;
+}
+
+void Xxh64::Update(const void* data, std::size_t size) noexcept {
+  auto p = static_cast<const std::uint8_t*>(data);
+  length_ += size;
+
+  if (buffer_size_ != 0) {
+    const std::size_t fill = std::min(kStripeSize - buffer_size_, size);
+    std::memcpy(&buffer_[buffer_size_], p, fill);
+    buffer_size_ += fill;
+    p += fill;
+    size -= fill;
+    if (buffer_size_ < kStripeSize) return;
+    ProcessStripes(buffer_.data(), 1);
+    buffer_size_ = 0;
+  }
+
+  const std::size_t count = size / kStripeSize;
+  if (count != 0) {
+    ProcessStripes(p, count);
+    p += count * kStripeSize;
+    size -= count * kStripeSize;
+  }
+
+  if (size != 0) {
+    std::memcpy(buffer_.data(), p, size);
+    buffer_size_ = size;
+  }
+}
+
+std::uint64_t Xxh64::value() const noexcept {
+  std::uint64_t hash;
+  if (length_ >= kStripeSize) {
+    hash = rotl64(acc_[0], 1) + rotl64(acc_[1], 7) + rotl64(acc_[2], 12) +
+           rotl64(acc_[3], 18);
+    for (const std::uint64_t acc : acc_) hash = MergeRound(hash, acc);
+  } else {
+    hash = seed_ + kPrime5;
+  }
+  hash += length_;
+
+  const std::uint8_t* p = buffer_.data();
+  std::size_t size = buffer_size_;
+  for (; size >= 8; p += 8, size -= 8) {
+    hash ^= Round(0, ReadInt64L(p));
+    hash = rotl64(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (size >= 4) {
+    hash ^= ReadInt32L(p) * kPrime1;
+    hash = rotl64(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+    size -= 4;
+  }
+  for (; size != 0; p++, size--) {
+    hash ^= *p * kPrime5;
+    hash = rotl64(hash, 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+void Xxh64::ProcessStripes(const std::uint8_t* data,
+                           std::size_t count) noexcept {
+  std::uint64_t acc0 = acc_[0];
+  std::uint64_t acc1 = acc_[1];
+  std::uint64_t acc2 = acc_[2];
+  std::uint64_t acc3 = acc_[3];
+  for (; count != 0; count--, data += kStripeSize) {
+    acc0 = Round(acc0, ReadInt64L(data));
+    acc1 = Round(acc1, ReadInt64L(data + 8));
+    acc2 = Round(acc2, ReadInt64L(data + 16));
+    acc3 = Round(acc3, ReadInt64L(data + 24));
+  }
+  acc_ = {acc0, acc1, acc2, acc3};
+}
+
+}  // namespace saptapper
@@ -0,0 +1,50 @@
+// Saptapper: Automated GSF ripper for MusicPlayer2000.
+
+#ifndef SAPTAPPER_XXH64_HPP_
+#define SAPTAPPER_XXH64_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace saptapper {
+
+/// 64-bit xxHash (XXH64), a fast non-cryptographic hash for cache keys.
+class Xxh64 {
+ public:
+  explicit Xxh64(std::uint64_t seed = 0) { Reset(seed); }
+
+  void Reset(std::uint64_t seed = 0) noexcept;
+
+  void Update(const void* data, std::size_t size) noexcept;
+
+  void Update(std::string_view data) noexcept {
+    Update(data.data(), data.size());
+  }
+
+  /// Returns the hash of the data so far. More data can be added after it.
+  std::uint64_t value() const noexcept;
+
+  static std::uint64_t Digest(std::string_view data,
+                              std::uint64_t seed = 0) noexcept {
+    Xxh64 xxh64{seed};
+    xxh64.Update(data);
+    return xxh64.value();
+  }
+
+ private:
+  static constexpr std::size_t kStripeSize = 32;
+
+  std::array<std::uint64_t, 4> acc_;
+  std::array<std::uint8_t, kStripeSize> buffer_;
+  std::size_t buffer_size_;
+  std::uint64_t length_;
+  std::uint64_t seed_;
+
+  void ProcessStripes(const std::uint8_t* data, std::size_t count) noexcept;
+};
+
+}  // namespace saptapper
+
+#endif